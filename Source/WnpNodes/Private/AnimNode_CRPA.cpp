@@ -1,38 +1,106 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "AnimNode_CRPA.h"
+#include "CRPACurveControlMatrix.h"
+#include "CRPAHotPath.h"
+#include "CRPAOutputCache.h"
+#include "CRPAPoseAtlas.h"
+#include "CRPAScalability.h"
 #include "ControlRig.h"
 #include "ControlRigComponent.h"
 #include "Components/SkeletalMeshComponent.h"
+#include "Animation/AnimClassInterface.h"
 #include "Animation/AnimInstanceProxy.h"
+#include "Animation/AnimNode_Inertialization.h"
+#include "Animation/AnimSequence.h"
+#include "Animation/AttributesRuntime.h"
+#include "Animation/BlendProfile.h"
+#include "AnimationRuntime.h"
 #include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "Hash/CityHash.h"
+#include "UObject/GarbageCollection.h"
 
 #if WITH_EDITOR
 #include "Editor.h"
 #endif
 
 FAnimNode_CRPA::FAnimNode_CRPA()
-	: NeutralPoseAsset(nullptr), PoseAsset(nullptr), ControlRig(nullptr)
+	: ControlRig(nullptr)
 	  , Alpha(1.f)
 	  , AlphaInputType(EAnimAlphaInputType::Float)
 	  , bAlphaBoolEnabled(true)
 	  , bSetRefPoseFromSkeleton(false)
 	  , AlphaCurveName(NAME_None)
+	  , BlendMask(nullptr)
+	  , bInertializeOnToggle(false)
+	  , InertializationDuration(0.2f)
+	  , AlphaCurveUID(SmartName::MaxUID)
+	  , UpdateDeltaTime(0.f)
+	  , PoseAtlas(nullptr)
+	  , PoseIndex(INDEX_NONE)
+	  , BlendPoseIndex(INDEX_NONE)
+	  , PoseBlend(0.f)
+	  , AppliedPoseIndex(INDEX_NONE)
+	  , AppliedBlendPoseIndex(INDEX_NONE)
+	  , AppliedPoseBlend(0.f)
+	  , CurveControlMatrix(nullptr)
+	  , BakedRigHash(0)
+	  , ResolvedBindingsSerial(0)
+	  , bBakedBindingsValid(false)
 	  , LODThreshold(INDEX_NONE)
+	  , RigLODBlendTime(0.2f)
+	  , ActiveRigIndex(0)
+	  , RigLODBlendRemaining(0.f)
+	  , BakedSequence(nullptr)
+	  , BakedLOD(INDEX_NONE)
+	  , bRestrictToAffectedBones(false)
+	  , bOnlyWriteChangedControls(false)
+	  , RigSharingGroup(NAME_None)
+	  , bEvaluateAsync(false)
+	  , bShareOutput(false)
+	  , PinInputHash(0)
+	  , PinInputHashFrame(MAX_uint64)
+	  , bPinsHashable(false)
+	  , ActiveBoneSetHash(0)
+	  , OutputCacheConfigHash(0)
+	  , bSkipWhenNotRendered(false)
+	  , NotRenderedTime(0.2f)
+	  , CatchUpEvaluations(1)
+	  , bRecentlyRendered(true)
+	  , PendingCatchUpEvaluations(0)
+	  , RigResultFrame(MAX_uint64)
+	  , CaptureSession(INDEX_NONE)
 {
 }
 
 FAnimNode_CRPA::~FAnimNode_CRPA()
 {
+	WaitForAsyncEvaluation();
+
 	if (ControlRig)
 	{
 		ControlRig->OnInitialized_AnyThread().RemoveAll(this);
 	}
+
+	for (UControlRig* LODControlRig : LODControlRigs)
+	{
+		if (LODControlRig)
+		{
+			LODControlRig->OnInitialized_AnyThread().RemoveAll(this);
+		}
+	}
 }
 
 void FAnimNode_CRPA::HandleOnInitialized_AnyThread(URigVMHost*, const FName&)
 {
 	RefPoseSetterHash.Reset();
+
+	// the controls are back to their initial values
+	ChangedControlWriter.Invalidate();
+	BoneSetCaches.Reset();
+	AppliedPoseIndex = INDEX_NONE;
+	WrittenMatrixOutputs.Reset();
 }
 
 void FAnimNode_CRPA::OnInitializeAnimInstance(const FAnimInstanceProxy* InProxy,
@@ -40,94 +108,253 @@ void FAnimNode_CRPA::OnInitializeAnimInstance(const FAnimInstanceProxy* InProxy,
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
+	WaitForAsyncEvaluation();
+	RigResultFrame = MAX_uint64;
+
 	if (ControlRigClass)
 	{
-		ControlRig = NewObject<UControlRig>(InAnimInstance->GetOwningComponent(), ControlRigClass);
-		ControlRig->Initialize(true);
-		ControlRig->RequestInit();
+		auto CreateControlRig = [InAnimInstance](UClass* InControlRigClass)
+		{
+			UControlRig* NewControlRig = NewObject<UControlRig>(InAnimInstance->GetOwningComponent(), InControlRigClass);
+			NewControlRig->Initialize(true);
+			NewControlRig->RequestInit();
+			return NewControlRig;
+		};
+
+		if (RigSharingGroup.IsNone())
+		{
+			SharedRig.Reset();
+			ControlRig = CreateControlRig(ControlRigClass);
+		}
+		else
+		{
+			SharedRig = CRPARigSharing::Acquire(InAnimInstance, RigSharingGroup, ControlRigClass,
+			                                    [&]() { return CreateControlRig(ControlRigClass); });
+			ControlRig = SharedRig->ControlRig.Get();
+		}
+
 		RefPoseSetterHash.Reset();
 		ControlRig->OnInitialized_AnyThread().AddRaw(this, &FAnimNode_CRPA::HandleOnInitialized_AnyThread);
 
+		// all rigs of the LOD chain are created now, swapping only changes which one runs
+		LODControlRigs.Reset();
+		ActiveRigIndex = 0;
+		RigLODBlendRemaining = 0.f;
+		if (!SharedRig.IsValid() && RigLODs.Num() > 0)
+		{
+			LODControlRigs.Add(ControlRig);
+			for (const FCRPARigLOD& RigLOD : RigLODs)
+			{
+				UControlRig* LODControlRig = ControlRig;
+				if (RigLOD.ControlRigClass)
+				{
+					LODControlRig = CreateControlRig(RigLOD.ControlRigClass);
+					LODControlRig->OnInitialized_AnyThread().AddRaw(this, &FAnimNode_CRPA::HandleOnInitialized_AnyThread);
+				}
+				LODControlRigs.Add(LODControlRig);
+			}
+		}
+
 		UpdateControlRigRefPoseIfNeeded(InProxy);
 	}
 
+	// the shared cache allocates its pool here, so storing outputs never allocates in evaluate
+	if (bShareOutput || CRPAScalability::IsCachedOutputForced())
+	{
+		CRPAOutputCache::Reserve();
+	}
+
 	FAnimNode_ControlRigBase::OnInitializeAnimInstance(InProxy, InAnimInstance);
 
 	InitializeProperties(InAnimInstance, GetTargetClass());
+
+	// the rigs were just initialized, only record what they were initialized with
+	RigCompileHashes.Reset();
+	ReinitializeChangedRigs();
 }
 
 void FAnimNode_CRPA::GatherDebugData(FNodeDebugData& DebugData)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
+	DebugStats.MarkGathered();
+
 	FString DebugLine = DebugData.GetNodeName(this);
-	DebugLine += FString::Printf(TEXT("(%s)"), *GetNameSafe(ControlRigClass.Get()));
+	DebugLine += FString::Printf(TEXT("(%s)"), *GetNameSafe(ControlRig ? ControlRig->GetClass() : ControlRigClass.Get()));
+	DebugLine += FString::Printf(TEXT(" Alpha: %.2f %s"), InternalBlendAlpha, *DebugStats.ToString());
+	DebugLine += FString::Printf(TEXT(" Pins: %d (%d controls) Curves: %d in %d out"), ResolvedBindings.Num(),
+	                             ChangedControlWriter.Num(), InputCurveBindings.Num() + MatrixInputUIDs.Num(),
+	                             OutputCurveBindings.Num() + ResolvedControlCurves.Num());
+	if (ControlRig)
+	{
+		FResourceSizeEx ResourceSize(EResourceSizeMode::EstimatedTotal);
+		ControlRig->GetResourceSizeEx(ResourceSize);
+		DebugLine += FString::Printf(TEXT(" Rig: %.1fKB"), ResourceSize.GetTotalMemoryBytes() / 1024.f);
+	}
 	DebugData.AddDebugItem(DebugLine);
 	Source.GatherDebugData(DebugData.BranchFlow(1.f));
 }
 
+void FAnimNode_CRPA::PreUpdate(const UAnimInstance* InAnimInstance)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	const USkeletalMeshComponent* Component = InAnimInstance->GetSkelMeshComponent();
+	const bool bRendered = IsRunningDedicatedServer() || Component == nullptr ||
+	                       Component->WasRecentlyRendered(NotRenderedTime);
+	if (bRendered && !bRecentlyRendered)
+	{
+		PendingCatchUpEvaluations = CatchUpEvaluations;
+	}
+	bRecentlyRendered = bRendered;
+}
+
 void FAnimNode_CRPA::Update_AnyThread(const FAnimationUpdateContext& Context)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	if (IsLODEnabled(Context.AnimInstanceProxy))
+	// pins are written into the rig below
+	WaitForAsyncEvaluation();
+
 	{
-		GetEvaluateGraphExposedInputs().Execute(Context);
+		// the source is updated by the base class, so it stays out of the scope
+		CRPA_HOT_PATH_SCOPE()
 
-		// alpha handlers
-		InternalBlendAlpha = 0.f;
-		switch (AlphaInputType)
+		if (IsLODEnabled(Context.AnimInstanceProxy))
 		{
-		case EAnimAlphaInputType::Float:
-			InternalBlendAlpha = AlphaScaleBias.ApplyTo(AlphaScaleBiasClamp.ApplyTo(Alpha, Context.GetDeltaTime()));
-			break;
-		case EAnimAlphaInputType::Bool:
-			InternalBlendAlpha = AlphaBoolBlend.ApplyTo(bAlphaBoolEnabled, Context.GetDeltaTime());
-			break;
-		case EAnimAlphaInputType::Curve:
-			if (UAnimInstance* AnimInstance = Cast<UAnimInstance>(Context.AnimInstanceProxy->GetAnimInstanceObject()))
+			GetEvaluateGraphExposedInputs().Execute(Context);
+			UpdateDeltaTime = Context.GetDeltaTime();
+
+			// alpha handlers
+			InternalBlendAlpha = 0.f;
+			switch (AlphaInputType)
 			{
-				InternalBlendAlpha = AlphaScaleBiasClamp.ApplyTo(AnimInstance->GetCurveValue(AlphaCurveName),
-				                                                 Context.GetDeltaTime());
+			case EAnimAlphaInputType::Float:
+				InternalBlendAlpha = AlphaScaleBias.ApplyTo(AlphaScaleBiasClamp.ApplyTo(Alpha, Context.GetDeltaTime()));
+				break;
+			case EAnimAlphaInputType::Bool:
+				// with inertialization the graph smooths the switch, so the rig doesn't run through a fade
+				InternalBlendAlpha = bInertializeOnToggle ? (bAlphaBoolEnabled ? 1.f : 0.f)
+				                                          : AlphaBoolBlend.ApplyTo(bAlphaBoolEnabled, Context.GetDeltaTime());
+				break;
+			case EAnimAlphaInputType::Curve:
+				// the curve is read from the source pose in evaluate, by the UID resolved in cache bones
+				InternalBlendAlpha = 1.f;
+				break;
+			};
+
+			// Make sure Alpha is clamped between 0 and 1.
+			InternalBlendAlpha = FMath::Clamp<float>(InternalBlendAlpha, 0.f, 1.f);
+
+			RigLODBlendRemaining = FMath::Max(RigLODBlendRemaining - Context.GetDeltaTime(), 0.f);
+
+			// the rig doesn't run at baked LODs or off screen, so its pins aren't needed
+			if (bRecentlyRendered && !IsBakedLOD(Context.AnimInstanceProxy))
+			{
+				PropagateInputProperties(Context.AnimInstanceProxy->GetAnimInstanceObject());
 			}
-			break;
-		};
-
-		// Make sure Alpha is clamped between 0 and 1.
-		InternalBlendAlpha = FMath::Clamp<float>(InternalBlendAlpha, 0.f, 1.f);
+		}
+		else
+		{
+			InternalBlendAlpha = 0.f;
+		}
 
-		PropagateInputProperties(Context.AnimInstanceProxy->GetAnimInstanceObject());
+		UpdateControlRigRefPoseIfNeeded(Context.AnimInstanceProxy);
 	}
-	else
+
+	if (bInertializeOnToggle)
 	{
-		InternalBlendAlpha = 0.f;
+		RequestInertializationOnToggle(Context);
 	}
 
-	UpdateControlRigRefPoseIfNeeded(Context.AnimInstanceProxy);
 	FAnimNode_ControlRigBase::Update_AnyThread(Context);
 
-	TRACE_ANIM_NODE_VALUE(Context, TEXT("Class"), *GetNameSafe(ControlRigClass.Get()));
+	TRACE_ANIM_NODE_VALUE(Context, TEXT("Class"), ControlRigClass.Get());
 }
 
 void FAnimNode_CRPA::Initialize_AnyThread(const FAnimationInitializeContext& Context)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
+	WaitForAsyncEvaluation();
 	FAnimNode_ControlRigBase::Initialize_AnyThread(Context);
 
 	AlphaBoolBlend.Reinitialize();
 	AlphaScaleBiasClamp.Reinitialize();
+	WasActive.Reset();
+	RigResultFrame = MAX_uint64;
+}
+
+void FAnimNode_CRPA::RequestInertializationOnToggle(const FAnimationUpdateContext& Context)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	// a curve alpha is only read in evaluate, too late to request anything, so the node counts as on for it
+	const bool bActive = IsLODEnabled(Context.AnimInstanceProxy) && FAnimWeight::IsRelevant(InternalBlendAlpha);
+	if (WasActive.IsSet() && WasActive.GetValue() != bActive)
+	{
+		if (UE::Anim::IInertializationRequester* InertializationRequester =
+			Context.GetMessage<UE::Anim::IInertializationRequester>())
+		{
+			InertializationRequester->RequestInertialization(InertializationDuration);
+			InertializationRequester->AddDebugRecord(*Context.AnimInstanceProxy, Context.GetCurrentNodeId());
+		}
+		else
+		{
+			FAnimNode_Inertialization::LogRequestError(Context, Source);
+		}
+
+		// the rig didn't run while the node was off, give rigs with state the same catch up as after being off screen
+		if (bActive)
+		{
+			PendingCatchUpEvaluations = CatchUpEvaluations;
+		}
+	}
+	WasActive = bActive;
 }
 
 void FAnimNode_CRPA::CacheBones_AnyThread(const FAnimationCacheBonesContext& Context)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	FAnimNode_ControlRigBase::CacheBones_AnyThread(Context);
+	WaitForAsyncEvaluation();
 
 	FBoneContainer& RequiredBones = Context.AnimInstanceProxy->GetRequiredBones();
+
+	// the rig is swapped first so everything below is resolved against the rig of the new LOD
+	if (LODControlRigs.Num() > 0)
+	{
+		const int32 RigIndex = FindRigLOD(Context.AnimInstanceProxy->GetLODLevel());
+		if (RigIndex != ActiveRigIndex)
+		{
+			SwapRigLOD(RigIndex, RequiredBones);
+		}
+	}
+
+	// the results of the bone set being left are moved into its cache entry, going back to a bone set seen before
+	// moves them back after the base node, so nothing of this node is resolved or reported again
+	const uint32 BoneSetHash = RequiredBones.IsValid() ? HashCombine(ComputeBoneSetHash(RequiredBones), ActiveRigIndex) : 0;
+	ParkBoneSetCache();
+	ActiveBoneSetHash = BoneSetHash;
+
+	FAnimNode_ControlRigBase::CacheBones_AnyThread(Context);
+
+	if (BoneSetHash != 0 && RestoreBoneSetCache(BoneSetHash))
+	{
+		OutputCacheConfigHash = ComputeOutputCacheConfigHash();
+		return;
+	}
+
 	InputToCurveMappingUIDs.Reset();
 	InputToControlIndex.Reset();
+	AffectedBoneIndices.Reset();
+	BoneBlendWeights.Reset();
+	InputCurveBindings.Reset();
+	OutputCurveBindings.Reset();
+	BakedBoneIndices.Reset();
+	OutputBoneIndices.Reset();
+	OutputCurveUIDs.Reset();
+	AlphaCurveUID = SmartName::MaxUID;
 
 	if (RequiredBones.IsValid())
 	{
@@ -136,6 +363,16 @@ void FAnimNode_CRPA::CacheBones_AnyThread(const FAnimationCacheBonesContext& Con
 		const FSmartNameMapping* CurveMapping = RequiredBones.GetSkeletonAsset()->GetSmartNameContainer(
 			USkeleton::AnimCurveMappingName);
 
+		// control targets are known when the anim BP compiles, only curves depend on the skeleton
+		TMap<FName, int32> BakedControlIndices;
+		if (bBakedBindingsValid)
+		{
+			for (const FCRPABakedBinding& Binding : BakedMappingBindings)
+			{
+				BakedControlIndices.Add(Binding.Name, Binding.ControlIndex);
+			}
+		}
+
 		auto CacheMapping = [&](const TMap<FName, FName>& Mapping, const FSmartNameMapping* CurveNameMapping,
 		                        const FAnimationCacheBonesContext& InContext, URigHierarchy* InHierarchy)
 		{
@@ -154,7 +391,12 @@ void FAnimNode_CRPA::CacheBones_AnyThread(const FAnimationCacheBonesContext& Con
 						InputToCurveMappingUIDs.Add(Iter.Value()) = Found;
 						continue;
 					}
-					else if (InHierarchy)
+					else if (const int32* BakedControlIndex = BakedControlIndices.Find(TargetPath))
+					{
+						InputToControlIndex.Add(TargetPath, *BakedControlIndex);
+						continue;
+					}
+					else if (InHierarchy && !bBakedBindingsValid)
 					{
 						const FRigElementKey Key(TargetPath, ERigElementType::Control);
 						if (const FRigControlElement* ControlElement = InHierarchy->Find<FRigControlElement>(Key))
@@ -180,223 +422,1611 @@ void FAnimNode_CRPA::CacheBones_AnyThread(const FAnimationCacheBonesContext& Con
 
 		CacheMapping(InputMapping, CurveMapping, Context, Hierarchy);
 		CacheMapping(OutputMapping, CurveMapping, Context, Hierarchy);
+
+		// resolve the float variables of the curve mappings once, missing ones are reported here instead of every frame
+		auto CacheCurveBindings = [&](const TMap<FName, FName>& Mapping, bool bInput, TArray<FCRPACurveBinding>& OutBindings)
+		{
+			UControlRig* CurrentControlRig = GetControlRig();
+			for (auto Iter = Mapping.CreateConstIterator(); Iter; ++Iter)
+			{
+				const SmartName::UID_Type* UID = InputToCurveMappingUIDs.Find(Iter.Value());
+				if (CurrentControlRig == nullptr || Iter.Key() == NAME_None || UID == nullptr || *UID == SmartName::MaxUID)
+				{
+					continue;
+				}
+
+				const FRigVMExternalVariable Variable = CurrentControlRig->GetPublicVariableByName(Iter.Key());
+				if (CRPABindings::IsCurveVariable(Variable) && (!bInput || !Variable.bIsReadOnly))
+				{
+					FCRPACurveBinding& Binding = OutBindings.AddDefaulted_GetRef();
+					Binding.VariableName = Iter.Key();
+					Binding.CurveUID = *UID;
+					Binding.VariableOffset = Variable.Property->GetOffset_ForInternal();
+					Binding.bDouble = Variable.Property->IsA<FDoubleProperty>();
+				}
+				else
+				{
+					UE_LOG(LogAnimation, Warning, TEXT("[%s] Missing %s Variable [%s]"),
+					       *GetNameSafe(CurrentControlRig->GetClass()), bInput ? TEXT("Input") : TEXT("Output"),
+					       *Iter.Key().ToString());
+				}
+			}
+		};
+
+		CacheCurveBindings(InputMapping, true, InputCurveBindings);
+		CacheCurveBindings(OutputMapping, false, OutputCurveBindings);
+		CacheCurveControlMatrix(CurveMapping, Hierarchy);
+		CacheControlCurveOutputs(CurveMapping, Hierarchy);
+
+		CacheAffectedBones(RequiredBones);
+
+		if (AlphaInputType == EAnimAlphaInputType::Curve && AlphaCurveName != NAME_None)
+		{
+			AlphaCurveUID = CurveMapping->FindUID(AlphaCurveName);
+		}
+
+		if (BakedSequence && BakedSequence->GetSkeleton() == RequiredBones.GetSkeletonAsset())
+		{
+			for (const FTrackToSkeletonMap& Track : BakedSequence->CompressedData.CompressedTrackToSkeletonMapTable)
+			{
+				const FCompactPoseBoneIndex BoneIndex = RequiredBones.GetCompactPoseIndexFromSkeletonIndex(Track.BoneTreeIndex);
+				if (BoneIndex.IsValid())
+				{
+					BakedBoneIndices.Add(BoneIndex.GetInt());
+				}
+			}
+			BakedBoneIndices.Sort();
+		}
+		else if (BakedSequence)
+		{
+			UE_LOG(LogAnimation, Warning, TEXT("Baked sequence %s isn't made for the skeleton %s"),
+			       *GetNameSafe(BakedSequence), *GetNameSafe(RequiredBones.GetSkeletonAsset()));
+		}
+
+		if (BlendMask)
+		{
+			const int32 NumBones = RequiredBones.GetCompactPoseNumBones();
+			BoneBlendWeights.SetNumUninitialized(NumBones);
+			for (FCompactPoseBoneIndex BoneIndex(0); BoneIndex < NumBones; ++BoneIndex)
+			{
+				const int32 SkeletonIndex = RequiredBones.GetSkeletonIndex(BoneIndex);
+				BoneBlendWeights[BoneIndex.GetInt()] = FMath::Clamp(BlendMask->GetBoneBlendScale(SkeletonIndex), 0.f, 1.f);
+			}
+		}
+
+		// after CacheAffectedBones, so only the transferred bones are stored. Always resolved, a.CRPA.ForceCachedOutput
+		// can turn the cache on without the bones being cached again
+		for (const TPair<uint16, uint16>& Pair : ControlRigBoneOutputMappingByIndex)
+		{
+			OutputBoneIndices.AddUnique(Pair.Value);
+		}
+		for (const TPair<FName, uint16>& Pair : ControlRigBoneOutputMappingByName)
+		{
+			OutputBoneIndices.AddUnique(Pair.Value);
+		}
+		OutputBoneIndices.Sort();
+
+		for (const FCRPACurveBinding& Binding : OutputCurveBindings)
+		{
+			OutputCurveUIDs.AddUnique(Binding.CurveUID);
+		}
+		for (const FCRPAResolvedControlCurve& ControlCurve : ResolvedControlCurves)
+		{
+			OutputCurveUIDs.AddUnique(ControlCurve.CurveUID);
+		}
+
+		StoreBoneSetCache(BoneSetHash);
 	}
+
+	OutputCacheConfigHash = ComputeOutputCacheConfigHash();
 }
 
-void FAnimNode_CRPA::Evaluate_AnyThread(FPoseContext& Output)
+struct FCRPABoneSetCache
 {
-	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+	uint32 BoneSetHash = 0;
+
+	decltype(FAnimNode_CRPA::ControlRigBoneInputMappingByIndex) ControlRigBoneInputMappingByIndex;
+	decltype(FAnimNode_CRPA::ControlRigBoneOutputMappingByIndex) ControlRigBoneOutputMappingByIndex;
+	decltype(FAnimNode_CRPA::ControlRigBoneInputMappingByName) ControlRigBoneInputMappingByName;
+	decltype(FAnimNode_CRPA::ControlRigBoneOutputMappingByName) ControlRigBoneOutputMappingByName;
+	decltype(FAnimNode_CRPA::InputToCurveMappingUIDs) InputToCurveMappingUIDs;
+	decltype(FAnimNode_CRPA::InputToControlIndex) InputToControlIndex;
+
+	TArray<int32> AffectedBoneIndices;
+	TArray<float> BoneBlendWeights;
+	TArray<FCRPACurveBinding> InputCurveBindings;
+	TArray<FCRPACurveBinding> OutputCurveBindings;
+	SmartName::UID_Type AlphaCurveUID = SmartName::MaxUID;
+	TArray<SmartName::UID_Type> MatrixInputUIDs;
+	TArray<FCRPAChannelControl> MatrixControls;
+	TArray<FCRPAResolvedControlCurve> ResolvedControlCurves;
+	TArray<int32> BakedBoneIndices;
+	TArray<int32> OutputBoneIndices;
+	TArray<SmartName::UID_Type> OutputCurveUIDs;
+};
+
+// a character rarely has more LODs than this
+static constexpr int32 MaxBoneSetCaches = 8;
+
+uint32 FAnimNode_CRPA::ComputeBoneSetHash(const FBoneContainer& RequiredBones)
+{
+	const TArray<FBoneIndexType>& BoneIndices = RequiredBones.GetBoneIndicesArray();
+	const uint32 Hash = GetTypeHash(RequiredBones.GetSkeletonAsset());
+	return FCrc::MemCrc32(BoneIndices.GetData(), BoneIndices.Num() * sizeof(FBoneIndexType), Hash);
+}
 
-	// evaluate 
-	FAnimNode_ControlRigBase::Evaluate_AnyThread(Output);
+template <typename FuncType>
+void FAnimNode_CRPA::ForEachBoneSetMember(FCRPABoneSetCache& Cache, FuncType&& Func)
+{
+	Func(Cache.ControlRigBoneInputMappingByIndex, ControlRigBoneInputMappingByIndex);
+	Func(Cache.ControlRigBoneOutputMappingByIndex, ControlRigBoneOutputMappingByIndex);
+	Func(Cache.ControlRigBoneInputMappingByName, ControlRigBoneInputMappingByName);
+	Func(Cache.ControlRigBoneOutputMappingByName, ControlRigBoneOutputMappingByName);
+	Func(Cache.InputToCurveMappingUIDs, InputToCurveMappingUIDs);
+	Func(Cache.InputToControlIndex, InputToControlIndex);
+	Func(Cache.AffectedBoneIndices, AffectedBoneIndices);
+	Func(Cache.BoneBlendWeights, BoneBlendWeights);
+	Func(Cache.InputCurveBindings, InputCurveBindings);
+	Func(Cache.OutputCurveBindings, OutputCurveBindings);
+	Func(Cache.AlphaCurveUID, AlphaCurveUID);
+	Func(Cache.MatrixInputUIDs, MatrixInputUIDs);
+	Func(Cache.MatrixControls, MatrixControls);
+	Func(Cache.ResolvedControlCurves, ResolvedControlCurves);
+	Func(Cache.BakedBoneIndices, BakedBoneIndices);
+	Func(Cache.OutputBoneIndices, OutputBoneIndices);
+	Func(Cache.OutputCurveUIDs, OutputCurveUIDs);
 }
 
-void FAnimNode_CRPA::PostSerialize(const FArchive& Ar)
+bool FAnimNode_CRPA::RestoreBoneSetCache(uint32 BoneSetHash)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	// after compile, we have to reinitialize
-	// because it needs new execution code
-	// since memory has changed
-	if (Ar.IsObjectReferenceCollector())
+	const int32 Index = BoneSetCaches.IndexOfByPredicate([BoneSetHash](const TSharedPtr<FCRPABoneSetCache>& Cache)
 	{
-		if (ControlRig)
-		{
-			ControlRig->Initialize();
-		}
+		return Cache->BoneSetHash == BoneSetHash;
+	});
+	if (Index == INDEX_NONE)
+	{
+		return false;
 	}
+
+	TSharedPtr<FCRPABoneSetCache> Cache = BoneSetCaches[Index];
+	BoneSetCaches.RemoveAt(Index, 1, false);
+	BoneSetCaches.Add(Cache);
+
+	ForEachBoneSetMember(*Cache, [](auto& Cached, auto& Live) { Live = MoveTemp(Cached); });
+	WrittenMatrixOutputs.Reset();
+	return true;
 }
 
-void FAnimNode_CRPA::UpdateInput(UControlRig* InControlRig, const FPoseContext& InOutput)
+void FAnimNode_CRPA::ParkBoneSetCache()
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	FAnimNode_ControlRigBase::UpdateInput(InControlRig, InOutput);
-
-	// now go through variable mapping table and see if anything is mapping through input
-	if (InputMapping.Num() > 0 && InControlRig)
-	{
-		for (auto Iter = InputMapping.CreateConstIterator(); Iter; ++Iter)
+	// gone if the caches were dropped since the bone set became active, the results are resolved again then
+	const uint32 BoneSetHash = ActiveBoneSetHash;
+	const TSharedPtr<FCRPABoneSetCache>* Cache = BoneSetCaches.FindByPredicate(
+		[BoneSetHash](const TSharedPtr<FCRPABoneSetCache>& Entry)
 		{
-			// we need to have list of variables using pin
-			const FName SourcePath = Iter.Key();
-			if (SourcePath != NAME_None)
-			{
-				const FName CurveName = Iter.Value();
+			return Entry->BoneSetHash == BoneSetHash;
+		});
+	if (BoneSetHash != 0 && Cache)
+	{
+		ForEachBoneSetMember(**Cache, [](auto& Cached, auto& Live) { Cached = MoveTemp(Live); });
+	}
+}
 
-				SmartName::UID_Type UID = *InputToCurveMappingUIDs.Find(CurveName);
-				if (UID != SmartName::MaxUID)
-				{
-					const float Value = InOutput.Curve.Get(UID);
+void FAnimNode_CRPA::StoreBoneSetCache(uint32 BoneSetHash)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-					FRigVMExternalVariable Variable = InControlRig->GetPublicVariableByName(SourcePath);
-					if (!Variable.bIsReadOnly && Variable.TypeName == TEXT("float"))
-					{
-						Variable.SetValue<float>(Value);
-					}
-					else
-					{
-						UE_LOG(LogAnimation, Warning, TEXT("[%s] Missing Input Variable [%s]"),
-						       *GetNameSafe(InControlRig->GetClass()), *SourcePath.ToString());
-					}
-				}
-			}
-		}
+	// the most recent entry is the active bone set, so it is never the one dropped
+	if (BoneSetCaches.Num() >= MaxBoneSetCaches)
+	{
+		BoneSetCaches.RemoveAt(0);
 	}
+
+	// the entry stays empty while its bone set is active, ParkBoneSetCache fills it when the node leaves it
+	TSharedPtr<FCRPABoneSetCache> Cache = MakeShared<FCRPABoneSetCache>();
+	Cache->BoneSetHash = BoneSetHash;
+	BoneSetCaches.Add(Cache);
 }
 
-void FAnimNode_CRPA::UpdateOutput(UControlRig* InControlRig, FPoseContext& InOutput)
+void FAnimNode_CRPA::CacheAffectedBones(const FBoneContainer& RequiredBones)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	FAnimNode_ControlRigBase::UpdateOutput(InControlRig, InOutput);
+	if (!bRestrictToAffectedBones || (BakedAffectedBones.Num() == 0 && AdditionalAffectedBones.Num() == 0))
+	{
+		return;
+	}
 
-	if (OutputMapping.Num() > 0 && InControlRig)
+	// parents are needed as well, otherwise global space transfers would read stale parent transforms
+	TBitArray<> AffectedMask(false, RequiredBones.GetCompactPoseNumBones());
+	auto AddBoneAndParents = [&](FBoneReference BoneReference)
 	{
-		for (auto Iter = OutputMapping.CreateConstIterator(); Iter; ++Iter)
+		if (!BoneReference.Initialize(RequiredBones))
 		{
-			// we need to have list of variables using pin
-			const FName SourcePath = Iter.Key();
-			// const FName CurveName = Iter.Value();
+			return;
+		}
 
-			if (SourcePath != NAME_None)
-			{
-				FRigVMExternalVariable Variable = InControlRig->GetPublicVariableByName(SourcePath);
-				if (Variable.TypeName == TEXT("float"))
-				{
-					float Value = Variable.GetValue<float>();
-					SmartName::UID_Type* UID = InputToCurveMappingUIDs.Find(Iter.Value());
-					if (UID)
-					{
-						InOutput.Curve.Set(*UID, Value);
-					}
-				}
-				else
-				{
-					UE_LOG(LogAnimation, Warning, TEXT("[%s] Missing Output Variable [%s]"),
-					       *GetNameSafe(ControlRig->GetClass()), *SourcePath.ToString());
-				}
-			}
+		FCompactPoseBoneIndex BoneIndex = BoneReference.GetCompactPoseIndex(RequiredBones);
+		while (BoneIndex.IsValid() && !AffectedMask[BoneIndex.GetInt()])
+		{
+			AffectedMask[BoneIndex.GetInt()] = true;
+			BoneIndex = RequiredBones.GetParentBoneIndex(BoneIndex);
 		}
-	}
-}
+	};
 
-void FAnimNode_CRPA::UpdateControlRigRefPoseIfNeeded(const FAnimInstanceProxy* InProxy, bool bIncludePoseInHash)
-{
-	if (!bSetRefPoseFromSkeleton)
+	for (const FName& BoneName : BakedAffectedBones)
 	{
-		return;
+		AddBoneAndParents(FBoneReference(BoneName));
 	}
 
-	int32 ExpectedHash = 0;
-	ExpectedHash = HashCombine(ExpectedHash, (int32)reinterpret_cast<uintptr_t>(InProxy->GetAnimInstanceObject()));
-	ExpectedHash = HashCombine(ExpectedHash, (int32)reinterpret_cast<uintptr_t>(InProxy->GetSkelMeshComponent()));
-
-	if (InProxy->GetSkelMeshComponent())
+	for (const FBoneReference& BoneReference : AdditionalAffectedBones)
 	{
-		ExpectedHash = HashCombine(ExpectedHash,
-		                           (int32)reinterpret_cast<uintptr_t>(InProxy->GetSkelMeshComponent()->
-		                                                                       GetSkeletalMeshAsset()));
+		AddBoneAndParents(BoneReference);
 	}
 
-	if (bIncludePoseInHash)
+	// compact pose indices are sorted parent first, iterating the mask keeps that order
+	for (TConstSetBitIterator<> It(AffectedMask); It; ++It)
 	{
-		FMemMark Mark(FMemStack::Get());
-		FCompactPose RefPose;
-		RefPose.ResetToRefPose(InProxy->GetRequiredBones());
+		AffectedBoneIndices.Add(It.GetIndex());
+	}
 
-		for (const FCompactPoseBoneIndex& BoneIndex : RefPose.ForEachBoneIndex())
-		{
-			const FTransform& Transform = RefPose.GetRefPose(BoneIndex);
-			const FQuat Rotation = Transform.GetRotation();
+	auto IsAffected = [&AffectedMask](uint16 CompactIndex)
+	{
+		return AffectedMask.IsValidIndex(CompactIndex) && AffectedMask[CompactIndex];
+	};
 
-			ExpectedHash = HashCombine(ExpectedHash, GetTypeHash(Transform.GetTranslation()));
-			ExpectedHash = HashCombine(ExpectedHash,
-			                           GetTypeHash(FVector4(Rotation.X, Rotation.Y, Rotation.Z, Rotation.W)));
-			ExpectedHash = HashCombine(ExpectedHash, GetTypeHash(Transform.GetScale3D()));
-		}
+	// the mappings are keyed by rig index and store the compact pose index as value
+	ControlRigBoneInputMappingByIndex.RemoveAll([&IsAffected](const TPair<uint16, uint16>& Pair)
+	{
+		return !IsAffected(Pair.Value);
+	});
+	ControlRigBoneOutputMappingByIndex.RemoveAll([&IsAffected](const TPair<uint16, uint16>& Pair)
+	{
+		return !IsAffected(Pair.Value);
+	});
 
-		if (RefPoseSetterHash.IsSet() && (ExpectedHash == RefPoseSetterHash.GetValue()))
+	for (auto Iter = ControlRigBoneInputMappingByName.CreateIterator(); Iter; ++Iter)
+	{
+		if (!IsAffected(Iter.Value()))
 		{
-			return;
+			Iter.RemoveCurrent();
 		}
-
-		// ControlRig->SetBoneInitialTransformsFromCompactPose(&RefPose);
 	}
-	else
+	for (auto Iter = ControlRigBoneOutputMappingByName.CreateIterator(); Iter; ++Iter)
 	{
-		if (RefPoseSetterHash.IsSet() && (ExpectedHash == RefPoseSetterHash.GetValue()))
+		if (!IsAffected(Iter.Value()))
 		{
-			return;
+			Iter.RemoveCurrent();
 		}
-
-		ControlRig->SetBoneInitialTransformsFromAnimInstanceProxy(InProxy);
 	}
-
-	RefPoseSetterHash = ExpectedHash;
 }
 
-void FAnimNode_CRPA::SetIOMapping(bool bInput, const FName& SourceProperty, const FName& TargetCurve)
+void FAnimNode_CRPA::Evaluate_AnyThread(FPoseContext& Output)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	UClass* TargetClass = GetTargetClass();
-	if (TargetClass)
+	FPoseContext SourcePose(Output);
+	if (Source.GetLinkNode())
 	{
-		UControlRig* CDO = TargetClass->GetDefaultObject<UControlRig>();
-		if (CDO)
-		{
-			TMap<FName, FName>& MappingData = (bInput) ? InputMapping : OutputMapping;
+		Source.Evaluate(SourcePose);
+	}
+	else
+	{
+		SourcePose.ResetToRefPose();
+	}
 
-			// if it's valid as of now, we add it
-			bool bIsReadOnly = CDO->GetPublicVariableByName(SourceProperty).bIsReadOnly;
-			if (!bInput || !bIsReadOnly)
-			{
-				if (TargetCurve == NAME_None)
-				{
-					MappingData.Remove(SourceProperty);
-				}
-				else
-				{
-					MappingData.FindOrAdd(SourceProperty) = TargetCurve;
-				}
-			}
-		}
+	if (AlphaInputType == EAnimAlphaInputType::Curve && IsLODEnabled(Output.AnimInstanceProxy))
+	{
+		const float CurveValue = AlphaCurveUID != SmartName::MaxUID ? SourcePose.Curve.Get(AlphaCurveUID) : 0.f;
+		InternalBlendAlpha = FMath::Clamp<float>(AlphaScaleBiasClamp.ApplyTo(CurveValue, UpdateDeltaTime), 0.f, 1.f);
 	}
-}
 
-FName FAnimNode_CRPA::GetIOMapping(bool bInput, const FName& SourceProperty) const
-{
-	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+	FCRPADebugStatsScope StatsScope(DebugStats);
+
+	if (CRPACapture::IsCapturing())
+	{
+		WaitForAsyncEvaluation();
+		CaptureFrame(SourcePose);
+	}
+	else if (CaptureWriter.IsValid())
+	{
+		CaptureWriter.Reset();
+	}
+
+	// from here on the node should not touch the heap once warmed up
+	CRPA_HOT_PATH_SCOPE()
+
+	// off screen a rig of its own holding a result keeps outputting it, see RunControlRig
+	const bool bBaked = IsBakedLOD(Output.AnimInstanceProxy);
+	if (!bRecentlyRendered && !bBaked && (SharedRig.IsValid() || RigResultFrame == MAX_uint64))
+	{
+		StatsScope.Evaluation = ECRPAEvaluation::SkippedNotRendered;
+		RigResultFrame = MAX_uint64;
+		Output = SourcePose;
+		return;
+	}
+
+	if ((bBaked || (CanExecute() && GetControlRig())) && FAnimWeight::IsRelevant(InternalBlendAlpha))
+	{
+		if (!bBaked)
+		{
+			RunCatchUpEvaluations(SourcePose);
+		}
+
+		const bool bHasBlendMask = BoneBlendWeights.Num() == SourcePose.Pose.GetNumBones();
+
+		// at full weight the output only differs on the transferred bones already
+		if (FAnimWeight::IsFullWeight(InternalBlendAlpha) && !bHasBlendMask)
+		{
+			StatsScope.Evaluation = bBaked ? SampleBakedSequence(SourcePose) : RunControlRig(SourcePose);
+			BlendRigLODPose(SourcePose);
+			Output = SourcePose;
+			return;
+		}
+
+		FPoseContext ControlRigPose(SourcePose);
+		ControlRigPose = SourcePose;
+		StatsScope.Evaluation = bBaked ? SampleBakedSequence(ControlRigPose) : RunControlRig(ControlRigPose);
+		BlendRigLODPose(ControlRigPose);
+
+		Output = SourcePose;
+
+		// same result as the base node, the rig pose made additive to the source and accumulated on it with the alpha
+		ControlRigPose.Curve.ConvertToAdditive(SourcePose.Curve);
+		UE::Anim::Attributes::ConvertToAdditive(SourcePose.CustomAttributes, ControlRigPose.CustomAttributes);
+		if (!bHasBlendMask && !IsRestrictedToAffectedBones())
+		{
+			FAnimationRuntime::ConvertPoseToAdditive(ControlRigPose.Pose, SourcePose.Pose);
+			FAnimationPoseData OutputPoseData(Output);
+			const FAnimationPoseData AdditivePoseData(ControlRigPose);
+			FAnimationRuntime::AccumulateAdditivePose(OutputPoseData, AdditivePoseData, InternalBlendAlpha,
+			                                          AAT_LocalSpaceBase);
+			return;
+		}
+
+		// the engine only blends whole poses, so the mask and the bone subset go bone by bone the same way.
+		// Bones outside of the affected subset are the source pose in both, so their additive is the identity.
+		auto AccumulateBone = [&](int32 BoneIndex)
+		{
+			const FCompactPoseBoneIndex Bone(BoneIndex);
+			const float Weight = bHasBlendMask ? InternalBlendAlpha * BoneBlendWeights[BoneIndex] : InternalBlendAlpha;
+			FTransform Additive = ControlRigPose.Pose[Bone];
+			FAnimationRuntime::ConvertTransformToAdditive(Additive, SourcePose.Pose[Bone]);
+			FTransform::BlendFromIdentityAndAccumulate(Output.Pose[Bone], Additive, ScalarRegister(Weight));
+			Output.Pose[Bone].NormalizeRotation();
+		};
+
+		if (IsRestrictedToAffectedBones())
+		{
+			for (const int32 BoneIndex : AffectedBoneIndices)
+			{
+				AccumulateBone(BoneIndex);
+			}
+		}
+		else
+		{
+			for (int32 BoneIndex = 0; BoneIndex < Output.Pose.GetNumBones(); ++BoneIndex)
+			{
+				AccumulateBone(BoneIndex);
+			}
+		}
+
+		Output.Curve.Accumulate(ControlRigPose.Curve, InternalBlendAlpha);
+		UE::Anim::Attributes::AccumulateAttributes(ControlRigPose.CustomAttributes, Output.CustomAttributes,
+		                                           InternalBlendAlpha, AAT_LocalSpaceBase);
+	}
+	else
+	{
+		StatsScope.Evaluation = IsLODEnabled(Output.AnimInstanceProxy) ? ECRPAEvaluation::SkippedAlpha
+		                                                               : ECRPAEvaluation::SkippedLOD;
+		RigResultFrame = MAX_uint64;
+		Output = SourcePose;
+	}
+}
+
+ECRPAEvaluation FAnimNode_CRPA::RunControlRig(FPoseContext& InOutput)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	if (!SharedRig.IsValid())
+	{
+		// the hierarchy still holds the last result, or the last async task writes it
+		WaitForAsyncEvaluation();
+
+		// the first frame back in view is evaluated before the mesh is rendered, so off screen the last result is kept
+		// rather than the source pose, which would show for that frame
+		if (!bRecentlyRendered && RigResultFrame != MAX_uint64)
+		{
+			UpdateOutput(ControlRig, InOutput);
+			return ECRPAEvaluation::SkippedNotRendered;
+		}
+
+		// pins hashed in this frame's update, a.CRPA.ForceCachedOutput may have been turned on after it
+		if (!bEvaluateAsync && (bShareOutput || CRPAScalability::IsCachedOutputForced()) &&
+			PinInputHashFrame == GFrameCounter)
+		{
+			return RunControlRigCached(InOutput);
+		}
+
+		// once there is a result the scalability limits can skip the rig, before a task is launched
+		if (RigResultFrame != MAX_uint64)
+		{
+			if (!CRPAScalability::IsEvaluationFrame(PointerHash(this)))
+			{
+				UpdateOutput(ControlRig, InOutput);
+				return ECRPAEvaluation::ReducedRate;
+			}
+			if (!CRPAScalability::TryConsumeEvaluation())
+			{
+				UpdateOutput(ControlRig, InOutput);
+				return ECRPAEvaluation::SkippedBudget;
+			}
+		}
+		else
+		{
+			CRPAScalability::TryConsumeEvaluation();
+		}
+
+		if (bEvaluateAsync)
+		{
+			RunControlRigAsync(InOutput);
+			return ECRPAEvaluation::Async;
+		}
+
+		RigResultFrame = GFrameCounter;
+		ExecuteControlRig(InOutput);
+		return ECRPAEvaluation::Executed;
+	}
+
+	// nodes of one anim instance evaluate on the same thread, so the frame stamp needs no lock
+	// pins are in the rig already, see RigSharingGroup, the rest of what the rig reads has to match the last execution
+	const uint64 InputKey = ComputeOutputCacheKey(InOutput, 0);
+	if (SharedRig->LastExecutedFrame != GFrameCounter || SharedRig->LastInputKey != InputKey)
+	{
+		SharedRig->LastExecutedFrame = GFrameCounter;
+		SharedRig->LastInputKey = InputKey;
+		ExecuteControlRig(InOutput);
+		return ECRPAEvaluation::Executed;
+	}
+
+	UpdateOutput(ControlRig, InOutput);
+	return ECRPAEvaluation::SharedOutput;
+}
+
+void FAnimNode_CRPA::RunControlRigAsync(FPoseContext& InOutput)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	WaitForAsyncEvaluation();
+
+	// without a finished task there is nothing to output yet, after frames the node wasn't evaluated the last result
+	// is reused like the other paths do
+	const bool bHasResult = RigResultFrame != MAX_uint64;
+	RigResultFrame = GFrameCounter;
+	if (!bHasResult)
+	{
+		ExecuteControlRig(InOutput);
+		return;
+	}
+
+	UControlRig* CurrentControlRig = GetControlRig();
+
+	// the hierarchy still holds the previous result, read it before this frame's inputs overwrite it
+	FPoseContext InputPose(InOutput);
+	InputPose = InOutput;
+	UpdateOutput(CurrentControlRig, InOutput);
+	UpdateInput(CurrentControlRig, InputPose);
+
+	AsyncEvaluationTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [CurrentControlRig]()
+	{
+		// the rig is referenced by the node, this only keeps GC from running under it
+		FGCScopeGuard GCGuard;
+		CurrentControlRig->Evaluate_AnyThread();
+	});
+}
+
+void FAnimNode_CRPA::RunCatchUpEvaluations(const FPoseContext& InSourcePose)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	// a shared rig catches up through the node that executes it, an async one outputs a frame late anyway
+	if (PendingCatchUpEvaluations <= 0 || SharedRig.IsValid() || bEvaluateAsync)
+	{
+		PendingCatchUpEvaluations = 0;
+		return;
+	}
+
+	// every run starts from the source pose, only the state the rig keeps carries over
+	FPoseContext CatchUpPose(InSourcePose);
+	for (; PendingCatchUpEvaluations > 0; --PendingCatchUpEvaluations)
+	{
+		CatchUpPose = InSourcePose;
+		ExecuteControlRig(CatchUpPose);
+	}
+}
+
+int32 FAnimNode_CRPA::GetLODThreshold() const
+{
+	return CRPAScalability::GetLODThreshold(LODThreshold);
+}
+
+bool FAnimNode_CRPA::IsBakedLOD(const FAnimInstanceProxy* InProxy) const
+{
+	return BakedSequence && BakedLOD != INDEX_NONE && InProxy->GetLODLevel() >= BakedLOD;
+}
+
+ECRPAEvaluation FAnimNode_CRPA::SampleBakedSequence(FPoseContext& InOutput) const
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	const int32 NumKeys = BakedSequence->GetNumberOfSampledKeys();
+	if (BakedBoneIndices.Num() == 0 || NumKeys == 0)
+	{
+		return ECRPAEvaluation::Baked;
+	}
+
+	auto SampleFrame = [this, NumKeys](int32 InFrame, FPoseContext& OutPose)
+	{
+		FAnimationPoseData PoseData(OutPose);
+		const double Time = BakedSequence->GetTimeAtFrame(FMath::Clamp(InFrame, 0, NumKeys - 1));
+		BakedSequence->GetAnimationPose(PoseData, FAnimExtractContext(Time));
+	};
+
+	// without an atlas the sequence holds the one pose asset the rig was baked with
+	const bool bUseAtlas = PoseAtlas != nullptr && PoseIndex != INDEX_NONE;
+	FPoseContext BakedPose(InOutput);
+	SampleFrame(bUseAtlas ? PoseIndex : 0, BakedPose);
+
+	if (bUseAtlas && BlendPoseIndex != INDEX_NONE && PoseBlend > 0.f)
+	{
+		FPoseContext BlendPose(InOutput);
+		SampleFrame(BlendPoseIndex, BlendPose);
+		for (const int32 BoneIndex : BakedBoneIndices)
+		{
+			const FCompactPoseBoneIndex Bone(BoneIndex);
+			BakedPose.Pose[Bone].BlendWith(BlendPose.Pose[Bone], FMath::Min(PoseBlend, 1.f));
+		}
+		BakedPose.Curve.LerpTo(BlendPose.Curve, FMath::Min(PoseBlend, 1.f));
+	}
+
+	// the rig was baked on the ref pose, so what it changed from there is added on top of the source pose
+	for (const int32 BoneIndex : BakedBoneIndices)
+	{
+		const FCompactPoseBoneIndex Bone(BoneIndex);
+		FTransform Delta = BakedPose.Pose[Bone];
+		FAnimationRuntime::ConvertTransformToAdditive(Delta, InOutput.Pose.GetRefPose(Bone));
+		FTransform::BlendFromIdentityAndAccumulate(InOutput.Pose[Bone], Delta, ScalarRegister(1.f));
+		InOutput.Pose[Bone].NormalizeRotation();
+	}
+	InOutput.Curve.Combine(BakedPose.Curve);
+	return ECRPAEvaluation::Baked;
+}
+
+ECRPAEvaluation FAnimNode_CRPA::RunControlRigCached(FPoseContext& InOutput)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	OutputCacheBones.SetNumUninitialized(OutputBoneIndices.Num(), false);
+	OutputCacheCurves.SetNumUninitialized(OutputCurveUIDs.Num(), false);
+
+	const uint64 Key = ComputeOutputCacheKey(InOutput, PinInputHash);
+	if (CRPAOutputCache::Find(Key, OutputCacheBones, OutputCacheCurves))
+	{
+		for (int32 Index = 0; Index < OutputBoneIndices.Num(); ++Index)
+		{
+			InOutput.Pose[FCompactPoseBoneIndex(OutputBoneIndices[Index])] = OutputCacheBones[Index];
+		}
+		for (int32 Index = 0; Index < OutputCurveUIDs.Num(); ++Index)
+		{
+			InOutput.Curve.Set(OutputCurveUIDs[Index], OutputCacheCurves[Index]);
+		}
+		return ECRPAEvaluation::Cached;
+	}
+
+	RigResultFrame = GFrameCounter;
+	ExecuteControlRig(InOutput);
+
+	for (int32 Index = 0; Index < OutputBoneIndices.Num(); ++Index)
+	{
+		OutputCacheBones[Index] = InOutput.Pose[FCompactPoseBoneIndex(OutputBoneIndices[Index])];
+	}
+	for (int32 Index = 0; Index < OutputCurveUIDs.Num(); ++Index)
+	{
+		OutputCacheCurves[Index] = InOutput.Curve.Get(OutputCurveUIDs[Index]);
+	}
+	CRPAOutputCache::Store(Key, OutputCacheBones, OutputCacheCurves);
+	return ECRPAEvaluation::Executed;
+}
+
+uint64 FAnimNode_CRPA::ComputeOutputCacheKey(const FPoseContext& InSourcePose, uint64 InPinHash) const
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	auto HashValue = [](const auto& Value, uint64 Hash)
+	{
+		return CityHash64WithSeed(reinterpret_cast<const char*>(&Value), sizeof(Value), Hash);
+	};
+
+	// assets and selection can be pins, so they are hashed every frame rather than with the settings
+	const UClass* RigClass = ControlRig->GetClass();
+	const USkeletalMesh* SkeletalMesh = InSourcePose.Pose.GetBoneContainer().GetSkeletalMeshAsset();
+	const UCRPAPoseAtlas* Atlas = PoseAtlas;
+	const UCRPACurveControlMatrix* Matrix = CurveControlMatrix;
+	uint64 Key = HashValue(RigClass, InPinHash);
+	Key = HashValue(SkeletalMesh, Key);
+	Key = HashValue(ActiveBoneSetHash, Key);
+	Key = HashValue(OutputCacheConfigHash, Key);
+	Key = HashValue(Atlas, Key);
+	Key = HashValue(PoseIndex, Key);
+	Key = HashValue(BlendPoseIndex, Key);
+	Key = HashValue(PoseBlend, Key);
+	Key = HashValue(Matrix, Key);
+
+	for (const FCRPACurveBinding& Binding : InputCurveBindings)
+	{
+		Key = HashValue(InSourcePose.Curve.Get(Binding.CurveUID), Key);
+	}
+	for (const SmartName::UID_Type CurveUID : MatrixInputUIDs)
+	{
+		Key = HashValue(CurveUID != SmartName::MaxUID ? InSourcePose.Curve.Get(CurveUID) : 0.f, Key);
+	}
+
+	const auto& Bones = InSourcePose.Pose.GetBones();
+	return CityHash64WithSeed(reinterpret_cast<const char*>(Bones.GetData()), Bones.Num() * sizeof(FTransform), Key);
+}
+
+uint64 FAnimNode_CRPA::ComputeOutputCacheConfigHash() const
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	auto HashName = [](const FName& Name, uint64 Hash)
+	{
+		const FNameEntryId ComparisonIndex = Name.GetComparisonIndex();
+		const int32 Number = Name.GetNumber();
+		Hash = CityHash64WithSeed(reinterpret_cast<const char*>(&ComparisonIndex), sizeof(ComparisonIndex), Hash);
+		return CityHash64WithSeed(reinterpret_cast<const char*>(&Number), sizeof(Number), Hash);
+	};
+
+	uint64 Hash = 0;
+	for (const TMap<FName, FName>* Mapping : {&InputMapping, &OutputMapping})
+	{
+		const int32 NumPairs = Mapping->Num();
+		Hash = CityHash64WithSeed(reinterpret_cast<const char*>(&NumPairs), sizeof(NumPairs), Hash);
+		for (const TPair<FName, FName>& Pair : *Mapping)
+		{
+			Hash = HashName(Pair.Value, HashName(Pair.Key, Hash));
+		}
+	}
+
+	for (const FCRPAControlCurveOutput& Output : ControlCurveOutputs)
+	{
+		Hash = HashName(Output.Curve, HashName(Output.Control, Hash));
+		Hash = CityHash64WithSeed(reinterpret_cast<const char*>(&Output.Channel), sizeof(Output.Channel), Hash);
+	}
+
+	// pins the rig doesn't have are dropped from the bindings, the names keep those nodes apart
+	for (const FName& PinName : DestPropertyNames)
+	{
+		Hash = HashName(PinName, Hash);
+	}
+
+	const uint32 PoseAssetHash = GetTypeHash(PoseAsset.ToSoftObjectPath());
+	const uint32 NeutralPoseAssetHash = GetTypeHash(NeutralPoseAsset.ToSoftObjectPath());
+	Hash = CityHash64WithSeed(reinterpret_cast<const char*>(&PoseAssetHash), sizeof(PoseAssetHash), Hash);
+	Hash = CityHash64WithSeed(reinterpret_cast<const char*>(&NeutralPoseAssetHash), sizeof(NeutralPoseAssetHash), Hash);
+
+	// what is stored, which differs between nodes on the same bone set with other affected bones or curve outputs
+	Hash = CityHash64WithSeed(reinterpret_cast<const char*>(OutputBoneIndices.GetData()),
+	                          OutputBoneIndices.Num() * sizeof(int32), Hash);
+	return CityHash64WithSeed(reinterpret_cast<const char*>(OutputCurveUIDs.GetData()),
+	                          OutputCurveUIDs.Num() * sizeof(SmartName::UID_Type), Hash);
+}
+
+void FAnimNode_CRPA::WaitForAsyncEvaluation()
+{
+	if (AsyncEvaluationTask.IsValid())
+	{
+		DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+		AsyncEvaluationTask.Wait();
+		AsyncEvaluationTask = UE::Tasks::FTask();
+	}
+}
+
+void FAnimNode_CRPA::CaptureFrame(const FPoseContext& SourcePose)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	UControlRig* CurrentControlRig = GetControlRig();
+	URigHierarchy* Hierarchy = CurrentControlRig ? CurrentControlRig->GetHierarchy() : nullptr;
+	if (Hierarchy == nullptr)
+	{
+		return;
+	}
+
+	UObject* AnimInstance = SourcePose.AnimInstanceProxy->GetAnimInstanceObject();
+	if (!CaptureWriter.IsValid() || CaptureSession != CRPACapture::GetSession())
+	{
+		CaptureSession = CRPACapture::GetSession();
+
+		// the node is replayed from a copy of the one in the anim class, found by its property
+		FCRPACaptureHeader Header;
+		Header.ControlRigClassPath = GetPathNameSafe(ControlRigClass);
+		Header.AnimClassPath = GetPathNameSafe(AnimInstance->GetClass());
+		Header.SkeletonPath = GetPathNameSafe(SourcePose.Pose.GetBoneContainer().GetSkeletonAsset());
+		if (const IAnimClassInterface* AnimClassInterface = IAnimClassInterface::GetFromClass(AnimInstance->GetClass()))
+		{
+			for (const FStructProperty* NodeProperty : AnimClassInterface->GetAnimNodeProperties())
+			{
+				if (NodeProperty->ContainerPtrToValuePtr<void>(AnimInstance) == static_cast<void*>(this))
+				{
+					Header.NodePropertyName = NodeProperty->GetFName();
+				}
+			}
+		}
+
+		const USkeletalMeshComponent* Component = SourcePose.AnimInstanceProxy->GetSkelMeshComponent();
+		const FString OwnerName = GetNameSafe(Component ? Component->GetOwner() : nullptr);
+		CaptureWriter = FCRPACaptureWriter::Create(CRPACapture::MakeFilename(OwnerName), Header);
+		if (!CaptureWriter.IsValid())
+		{
+			return;
+		}
+
+		CaptureWriter->WritePinNames(SourceProperties);
+	}
+
+	// a rig LOD swap or a reinitialized rig resolves the pins again
+	if (CaptureWriter->BindingsSerial != ResolvedBindingsSerial)
+	{
+		CaptureWriter->BindingsSerial = ResolvedBindingsSerial;
+		CaptureWriter->WriteBindings(CurrentControlRig, ResolvedBindings);
+	}
+
+	// scratch arrays come from the anim worker's mem stack
+	FMemMark Mark(FMemStack::Get());
+
+	// same order as UpdateInput
+	TArray<float, TMemStackAllocator<>> CurveValues;
+	CurveValues.Reserve(InputCurveBindings.Num());
+	for (const FCRPACurveBinding& Binding : InputCurveBindings)
+	{
+		CurveValues.Add(SourcePose.Curve.Get(Binding.CurveUID));
+	}
+
+	// names only change with the required bones
+	const FBoneContainer& RequiredBones = SourcePose.Pose.GetBoneContainer();
+	if (CaptureWriter->BoneContainerSerial != RequiredBones.GetSerialNumber())
+	{
+		CaptureWriter->BoneContainerSerial = RequiredBones.GetSerialNumber();
+
+		const FReferenceSkeleton& RefSkeleton = RequiredBones.GetReferenceSkeleton();
+		TArray<FName, TMemStackAllocator<>> BoneNames;
+		BoneNames.Reserve(SourcePose.Pose.GetNumBones());
+		for (const FCompactPoseBoneIndex BoneIndex : SourcePose.Pose.ForEachBoneIndex())
+		{
+			BoneNames.Add(RefSkeleton.GetBoneName(RequiredBones.MakeMeshPoseIndex(BoneIndex).GetInt()));
+		}
+
+		TArray<FName, TMemStackAllocator<>> CurveVariableNames;
+		CurveVariableNames.Reserve(InputCurveBindings.Num());
+		for (const FCRPACurveBinding& Binding : InputCurveBindings)
+		{
+			CurveVariableNames.Add(Binding.VariableName);
+		}
+
+		CaptureWriter->WriteBoneNames(BoneNames, SourcePose.AnimInstanceProxy->GetLODLevel());
+		CaptureWriter->WriteInputCurveNames(CurveVariableNames);
+	}
+
+	CaptureWriter->WriteFrame(UpdateDeltaTime, InternalBlendAlpha, SourcePose.Pose.GetBones(), CurveValues, AnimInstance,
+	                          ResolvedBindings, CurrentControlRig, Hierarchy);
+}
+
+void FAnimNode_CRPA::PostSerialize(const FArchive& Ar)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	// after compile, we have to reinitialize
+	// because it needs new execution code
+	// since memory has changed
+	// reference collection also runs for GC and many editor operations, so only changed rigs are initialized
+	if (Ar.IsObjectReferenceCollector() && ReinitializeChangedRigs())
+	{
+		ResolveRigLODBindings();
+	}
+}
+
+// rig initializations done because a compile changed the rig, stays flat in steady state
+static std::atomic<int32> NumRigReinitializations(0);
+
+static FAutoConsoleCommand RigReinitializationsCommand(
+	TEXT("CRPA.RigReinitializations"),
+	TEXT("Log how many times CRPA nodes initialized their rig again after a compile. Args: [Reset]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		UE_LOG(LogAnimation, Display, TEXT("CRPA rig reinitializations: %d"), NumRigReinitializations.load());
+		if (Args.Num() > 0 && Args[0] == TEXT("Reset"))
+		{
+			NumRigReinitializations = 0;
+		}
+	}));
+
+bool FAnimNode_CRPA::ReinitializeChangedRigs()
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	TArray<UControlRig*, TInlineAllocator<4>> Rigs;
+	for (UControlRig* LODControlRig : LODControlRigs)
+	{
+		Rigs.AddUnique(LODControlRig);
+	}
+	if (Rigs.Num() == 0)
+	{
+		Rigs.Add(ControlRig);
+	}
+
+	// a rig seen for the first time was just initialized by whoever created it
+	const int32 NumKnownRigs = RigCompileHashes.Num();
+	RigCompileHashes.SetNumZeroed(Rigs.Num());
+
+	bool bReinitialized = false;
+	for (int32 RigIndex = 0; RigIndex < Rigs.Num(); ++RigIndex)
+	{
+		if (Rigs[RigIndex] == nullptr)
+		{
+			continue;
+		}
+
+		const uint32 CompileHash = CRPABindings::ComputeRigCompileHash(Rigs[RigIndex]);
+		if (CompileHash == RigCompileHashes[RigIndex])
+		{
+			continue;
+		}
+
+		RigCompileHashes[RigIndex] = CompileHash;
+		if (RigIndex < NumKnownRigs)
+		{
+			WaitForAsyncEvaluation();
+			Rigs[RigIndex]->Initialize();
+			++NumRigReinitializations;
+			RigResultFrame = MAX_uint64;
+			bReinitialized = true;
+		}
+	}
+	return bReinitialized;
+}
+
+void FAnimNode_CRPA::UpdateInput(UControlRig* InControlRig, const FPoseContext& InOutput)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	FAnimNode_ControlRigBase::UpdateInput(InControlRig, InOutput);
+
+	// now go through variable mapping table and see if anything is mapping through input
+	if (InControlRig)
+	{
+		uint8* ControlRigMemory = reinterpret_cast<uint8*>(InControlRig);
+		for (const FCRPACurveBinding& Binding : InputCurveBindings)
+		{
+			const float Value = InOutput.Curve.Get(Binding.CurveUID);
+			if (Binding.bDouble)
+			{
+				*reinterpret_cast<double*>(ControlRigMemory + Binding.VariableOffset) = Value;
+			}
+			else
+			{
+				*reinterpret_cast<float*>(ControlRigMemory + Binding.VariableOffset) = Value;
+			}
+		}
+
+		if (MatrixControls.Num() > 0)
+		{
+			ApplyCurveControlMatrix(InControlRig->GetHierarchy(), InOutput.Curve);
+		}
+	}
+}
+
+void FAnimNode_CRPA::UpdateOutput(UControlRig* InControlRig, FPoseContext& InOutput)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	FAnimNode_ControlRigBase::UpdateOutput(InControlRig, InOutput);
+
+	if (InControlRig)
+	{
+		const uint8* ControlRigMemory = reinterpret_cast<const uint8*>(InControlRig);
+		for (const FCRPACurveBinding& Binding : OutputCurveBindings)
+		{
+			const uint8* ValuePtr = ControlRigMemory + Binding.VariableOffset;
+			InOutput.Curve.Set(Binding.CurveUID, Binding.bDouble ? static_cast<float>(*reinterpret_cast<const double*>(ValuePtr))
+			                                                     : *reinterpret_cast<const float*>(ValuePtr));
+		}
+
+		URigHierarchy* Hierarchy = InControlRig->GetHierarchy();
+		if (Hierarchy && ResolvedControlCurves.Num() > 0)
+		{
+			// entries are sorted by control, so each control value is converted once
+			int32 ControlIndex = INDEX_NONE;
+			FEulerTransform Transform;
+			for (const FCRPAResolvedControlCurve& ControlCurve : ResolvedControlCurves)
+			{
+				if (ControlCurve.ControlIndex != ControlIndex)
+				{
+					ControlIndex = ControlCurve.ControlIndex;
+					const FRigControlValue Value = Hierarchy->GetControlValue(ControlIndex, ERigControlValueType::Current);
+					Transform = FEulerTransform(Value.GetAsTransform(ControlCurve.ControlType, ControlCurve.PrimaryAxis));
+				}
+
+				InOutput.Curve.Set(ControlCurve.CurveUID, CRPABindings::GetChannel(Transform, ControlCurve.Channel));
+			}
+		}
+	}
+}
+
+void FAnimNode_CRPA::CacheCurveControlMatrix(const FSmartNameMapping* InCurveMapping, URigHierarchy* InHierarchy)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	MatrixInputUIDs.Reset();
+	MatrixControls.Reset();
+	WrittenMatrixOutputs.Reset();
+
+	if (CurveControlMatrix == nullptr || InHierarchy == nullptr)
+	{
+		return;
+	}
+
+	for (const FName& CurveName : CurveControlMatrix->GetInputCurves())
+	{
+		MatrixInputUIDs.Add(InCurveMapping->FindUID(CurveName));
+	}
+
+	// channels of one control are contiguous in the matrix
+	const TArray<FName>& ChannelControls = CurveControlMatrix->GetChannelControls();
+	for (int32 Channel = 0; Channel < ChannelControls.Num(); ++Channel)
+	{
+		if (Channel > 0 && ChannelControls[Channel] == ChannelControls[Channel - 1])
+		{
+			// nothing to extend if the control is missing
+			FCRPAChannelControl* Control = MatrixControls.Num() > 0 ? &MatrixControls.Last() : nullptr;
+			if (Control && Control->FirstChannel + Control->NumChannels == Channel)
+			{
+				++Control->NumChannels;
+			}
+			continue;
+		}
+
+		const FRigElementKey ControlKey(ChannelControls[Channel], ERigElementType::Control);
+		const FRigControlElement* ControlElement = InHierarchy->Find<FRigControlElement>(ControlKey);
+		if (ControlElement == nullptr)
+		{
+			UE_LOG(LogAnimation, Warning, TEXT("[%s] Curve matrix %s drives missing control %s"),
+			       *GetNameSafe(ControlRigClass.Get()), *GetNameSafe(CurveControlMatrix),
+			       *ChannelControls[Channel].ToString());
+			continue;
+		}
+
+		FCRPAChannelControl& Control = MatrixControls.AddDefaulted_GetRef();
+		Control.ControlIndex = ControlElement->GetIndex();
+		Control.ControlType = ControlElement->Settings.ControlType;
+		Control.PrimaryAxis = ControlElement->Settings.PrimaryAxis;
+		const FRigControlValue InitialValue =
+			InHierarchy->GetControlValue(ControlElement->GetIndex(), ERigControlValueType::Initial);
+		Control.InitialValue = FEulerTransform(InitialValue.GetAsTransform(Control.ControlType, Control.PrimaryAxis));
+		Control.FirstChannel = Channel;
+		Control.NumChannels = 1;
+	}
+
+	MatrixInputs.SetNumZeroed(CurveControlMatrix->GetInputStride());
+	MatrixOutputs.SetNumZeroed(CurveControlMatrix->GetNumChannels());
+}
+
+void FAnimNode_CRPA::CacheControlCurveOutputs(const FSmartNameMapping* InCurveMapping, const URigHierarchy* InHierarchy)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	ResolvedControlCurves.Reset();
+	if (InHierarchy == nullptr)
+	{
+		return;
+	}
+
+	for (const FCRPAControlCurveOutput& Output : ControlCurveOutputs)
+	{
+		const FRigElementKey ControlKey(Output.Control, ERigElementType::Control);
+		const FRigControlElement* ControlElement = InHierarchy->Find<FRigControlElement>(ControlKey);
+		const SmartName::UID_Type CurveUID = InCurveMapping->FindUID(Output.Curve);
+		if (ControlElement == nullptr || CurveUID == SmartName::MaxUID)
+		{
+			UE_LOG(LogAnimation, Warning, TEXT("[%s] Can't output control %s to curve %s"),
+			       *GetNameSafe(ControlRigClass.Get()), *Output.Control.ToString(), *Output.Curve.ToString());
+			continue;
+		}
+
+		FCRPAResolvedControlCurve& Resolved = ResolvedControlCurves.AddDefaulted_GetRef();
+		Resolved.ControlIndex = ControlElement->GetIndex();
+		Resolved.ControlType = ControlElement->Settings.ControlType;
+		Resolved.PrimaryAxis = ControlElement->Settings.PrimaryAxis;
+		Resolved.Channel = Output.Channel;
+		Resolved.CurveUID = CurveUID;
+	}
+
+	ResolvedControlCurves.StableSort([](const FCRPAResolvedControlCurve& A, const FCRPAResolvedControlCurve& B)
+	{
+		return A.ControlIndex < B.ControlIndex;
+	});
+}
+
+void FAnimNode_CRPA::ApplyCurveControlMatrix(URigHierarchy* InHierarchy, const FBlendedCurve& InCurves)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	if (InHierarchy == nullptr || CurveControlMatrix == nullptr ||
+		MatrixOutputs.Num() != CurveControlMatrix->GetNumChannels())
+	{
+		return;
+	}
+
+	for (int32 Input = 0; Input < MatrixInputUIDs.Num(); ++Input)
+	{
+		MatrixInputs[Input] = MatrixInputUIDs[Input] != SmartName::MaxUID ? InCurves.Get(MatrixInputUIDs[Input]) : 0.f;
+	}
+
+	CurveControlMatrix->Multiply(MatrixInputs.GetData(), MatrixOutputs.GetData());
+
+	const bool bCompareWithWritten = bOnlyWriteChangedControls && WrittenMatrixOutputs.Num() == MatrixOutputs.Num();
+	const TArray<ECRPAControlChannel>& Channels = CurveControlMatrix->GetChannels();
+	FRigControlValue Value;
+	for (const FCRPAChannelControl& Control : MatrixControls)
+	{
+		if (bCompareWithWritten &&
+			FMemory::Memcmp(&MatrixOutputs[Control.FirstChannel], &WrittenMatrixOutputs[Control.FirstChannel],
+			                Control.NumChannels * sizeof(float)) == 0)
+		{
+			continue;
+		}
+
+		FRigControlElement* ControlElement = InHierarchy->Get<FRigControlElement>(Control.ControlIndex);
+		if (ControlElement == nullptr)
+		{
+			continue;
+		}
+
+		FEulerTransform Transform = Control.InitialValue;
+		for (int32 Channel = Control.FirstChannel; Channel < Control.FirstChannel + Control.NumChannels; ++Channel)
+		{
+			const double InitialValue = CRPABindings::GetChannel(Control.InitialValue, Channels[Channel]);
+			CRPABindings::SetChannel(Transform, Channels[Channel], InitialValue + MatrixOutputs[Channel]);
+		}
+
+		Value.SetFromTransform(Transform.ToFTransform(), Control.ControlType, Control.PrimaryAxis);
+		InHierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
+	}
+
+	if (bOnlyWriteChangedControls)
+	{
+		WrittenMatrixOutputs = MatrixOutputs;
+	}
+}
+
+void FAnimNode_CRPA::UpdateControlRigRefPoseIfNeeded(const FAnimInstanceProxy* InProxy, bool bIncludePoseInHash)
+{
+	if (!bSetRefPoseFromSkeleton)
+	{
+		return;
+	}
+
+	int32 ExpectedHash = 0;
+	ExpectedHash = HashCombine(ExpectedHash, (int32)reinterpret_cast<uintptr_t>(InProxy->GetAnimInstanceObject()));
+	ExpectedHash = HashCombine(ExpectedHash, (int32)reinterpret_cast<uintptr_t>(InProxy->GetSkelMeshComponent()));
+
+	if (InProxy->GetSkelMeshComponent())
+	{
+		ExpectedHash = HashCombine(ExpectedHash,
+		                           (int32)reinterpret_cast<uintptr_t>(InProxy->GetSkelMeshComponent()->
+		                                                                       GetSkeletalMeshAsset()));
+	}
+
+	if (bIncludePoseInHash)
+	{
+		FMemMark Mark(FMemStack::Get());
+		FCompactPose RefPose;
+		RefPose.ResetToRefPose(InProxy->GetRequiredBones());
+
+		for (const FCompactPoseBoneIndex& BoneIndex : RefPose.ForEachBoneIndex())
+		{
+			const FTransform& Transform = RefPose.GetRefPose(BoneIndex);
+			const FQuat Rotation = Transform.GetRotation();
+
+			ExpectedHash = HashCombine(ExpectedHash, GetTypeHash(Transform.GetTranslation()));
+			ExpectedHash = HashCombine(ExpectedHash,
+			                           GetTypeHash(FVector4(Rotation.X, Rotation.Y, Rotation.Z, Rotation.W)));
+			ExpectedHash = HashCombine(ExpectedHash, GetTypeHash(Transform.GetScale3D()));
+		}
+
+		if (RefPoseSetterHash.IsSet() && (ExpectedHash == RefPoseSetterHash.GetValue()))
+		{
+			return;
+		}
+
+		// ControlRig->SetBoneInitialTransformsFromCompactPose(&RefPose);
+	}
+	else
+	{
+		if (RefPoseSetterHash.IsSet() && (ExpectedHash == RefPoseSetterHash.GetValue()))
+		{
+			return;
+		}
+
+		ControlRig->SetBoneInitialTransformsFromAnimInstanceProxy(InProxy);
+	}
+
+	RefPoseSetterHash = ExpectedHash;
+}
+
+void FAnimNode_CRPA::SetIOMapping(bool bInput, const FName& SourceProperty, const FName& TargetCurve)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	UClass* TargetClass = GetTargetClass();
+	if (TargetClass)
+	{
+		UControlRig* CDO = TargetClass->GetDefaultObject<UControlRig>();
+		if (CDO)
+		{
+			TMap<FName, FName>& MappingData = (bInput) ? InputMapping : OutputMapping;
+
+			// if it's valid as of now, we add it
+			bool bIsReadOnly = CDO->GetPublicVariableByName(SourceProperty).bIsReadOnly;
+			if (!bInput || !bIsReadOnly)
+			{
+				if (TargetCurve == NAME_None)
+				{
+					MappingData.Remove(SourceProperty);
+				}
+				else
+				{
+					MappingData.FindOrAdd(SourceProperty) = TargetCurve;
+				}
+			}
+		}
+	}
+}
+
+FName FAnimNode_CRPA::GetIOMapping(bool bInput, const FName& SourceProperty) const
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
 	const TMap<FName, FName>& MappingData = (bInput) ? InputMapping : OutputMapping;
 	if (const FName* NameFound = MappingData.Find(SourceProperty))
 	{
-		return *NameFound;
+		return *NameFound;
+	}
+
+	return NAME_None;
+}
+
+void FAnimNode_CRPA::InitializeProperties(const UObject* InSourceInstance, UClass* InTargetClass)
+{
+	// Build property lists
+	SourceProperties.Reset(SourcePropertyNames.Num());
+	DestProperties.Reset(SourcePropertyNames.Num());
+
+	check(SourcePropertyNames.Num() == DestPropertyNames.Num());
+
+	for (int32 Idx = 0; Idx < SourcePropertyNames.Num(); ++Idx)
+	{
+		FName& SourceName = SourcePropertyNames[Idx];
+		UClass* SourceClass = InSourceInstance->GetClass();
+
+		FProperty* SourceProperty = FindFProperty<FProperty>(SourceClass, SourceName);
+		SourceProperties.Add(SourceProperty);
+		DestProperties.Add(nullptr);
+	}
+
+	ResolveRigLODBindings();
+}
+
+bool FAnimNode_CRPA::CanUseBakedBindings(const UControlRig* InControlRig) const
+{
+	if (InControlRig == nullptr || BakedRigHash == 0 || BakedBindings.Num() != DestPropertyNames.Num())
+	{
+		return false;
+	}
+
+	return CRPABindings::ComputeRigHash(InControlRig) == BakedRigHash;
+}
+
+void FAnimNode_CRPA::ResolveBindings(const UControlRig* InControlRig)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	ResolvedBindings.Reset(SourceProperties.Num());
+	bBakedBindingsValid = CanUseBakedBindings(InControlRig);
+	bPinsHashable = false;
+
+	if (InControlRig == nullptr)
+	{
+		return;
+	}
+
+	for (int32 PropIdx = 0; PropIdx < SourceProperties.Num(); ++PropIdx)
+	{
+		FCRPABakedBinding Binding;
+		if (bBakedBindingsValid)
+		{
+			Binding = BakedBindings[PropIdx];
+		}
+		else if (!CRPABindings::ResolveByName(InControlRig, DestPropertyNames[PropIdx], Binding))
+		{
+			continue;
+		}
+
+		// the baked table keeps pins that bind to nothing as type none
+		if (Binding.Type == ECRPABindingType::None)
+		{
+			continue;
+		}
+
+		if (!CRPABindings::IsCompatible(SourceProperties[PropIdx], Binding, InControlRig))
+		{
+			continue;
+		}
+
+		FCRPAResolvedBinding& Resolved = ResolvedBindings.AddDefaulted_GetRef();
+		Resolved.Name = DestPropertyNames[PropIdx];
+		Resolved.SourceProperty = SourceProperties[PropIdx];
+		Resolved.ControlIndex = Binding.ControlIndex;
+		Resolved.VariableOffset = Binding.VariableOffset;
+		Resolved.Type = Binding.Type;
+		Resolved.ControlType = Binding.ControlType;
+	}
+
+	++ResolvedBindingsSerial;
+	BoneSetCaches.Reset();
+
+	// nodes of one anim instance initialize on the same thread
+	if (SharedRig.IsValid())
+	{
+		for (const FCRPAResolvedBinding& Binding : ResolvedBindings)
+		{
+			const void* Owner = SharedRig->PinOwners.FindOrAdd(Binding.Name, this);
+			UE_CLOG(Owner != this, LogAnimation, Warning,
+			        TEXT("[%s] Pin %s is written by more than one node of rig sharing group %s, the last one updated wins"),
+			        *GetNameSafe(InControlRig->GetClass()), *Binding.Name.ToString(), *RigSharingGroup.ToString());
+		}
+	}
+
+	bPinsHashable = true;
+	for (const FCRPAResolvedBinding& Binding : ResolvedBindings)
+	{
+		if (!CRPAOutputCache::CanHashValue(Binding.SourceProperty))
+		{
+			bPinsHashable = false;
+			UE_CLOG(bShareOutput, LogAnimation, Warning, TEXT("[%s] Pin %s can't be hashed, output sharing is off for this node"),
+			        *GetNameSafe(InControlRig->GetClass()), *Binding.Name.ToString());
+		}
 	}
 
-	return NAME_None;
+	PoseAtlasControlIndices.Reset();
+	AppliedPoseIndex = INDEX_NONE;
+	if (PoseAtlas)
+	{
+		if (const URigHierarchy* Hierarchy = InControlRig->GetHierarchy())
+		{
+			const TArray<FName>& ControlNames = PoseAtlas->GetControlNames();
+			const TArray<ERigControlType>& ControlTypes = PoseAtlas->GetControlTypes();
+			for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+			{
+				// controls missing from the rig or of another type are skipped, and rotators from atlases built before
+				// they were left out
+				int32 ControlIndex = Hierarchy->GetIndex(FRigElementKey(ControlNames[Control], ERigElementType::Control));
+				const FRigControlElement* ControlElement = Hierarchy->Get<FRigControlElement>(ControlIndex);
+				if (ControlElement == nullptr || ControlElement->Settings.ControlType != ControlTypes[Control] ||
+					ControlTypes[Control] == ERigControlType::Rotator ||
+					ControlTypes[Control] == ERigControlType::EulerTransform)
+				{
+					ControlIndex = INDEX_NONE;
+				}
+				PoseAtlasControlIndices.Add(ControlIndex);
+			}
+		}
+	}
+
+	ChangedControlWriter.Reset(ResolvedBindings, PoseAtlasControlIndices);
 }
 
-void FAnimNode_CRPA::InitializeProperties(const UObject* InSourceInstance, UClass* InTargetClass)
+void FAnimNode_CRPA::ResolveRigLODBindings()
 {
-	// Build property lists
-	SourceProperties.Reset(SourcePropertyNames.Num());
-	DestProperties.Reset(SourcePropertyNames.Num());
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-	check(SourcePropertyNames.Num() == DestPropertyNames.Num());
+	if (LODControlRigs.Num() == 0)
+	{
+		ResolveBindings(ControlRig);
+		return;
+	}
 
-	for (int32 Idx = 0; Idx < SourcePropertyNames.Num(); ++Idx)
+	LODRigBindings.SetNum(LODControlRigs.Num());
+	for (int32 RigIndex = 0; RigIndex < LODControlRigs.Num(); ++RigIndex)
 	{
-		FName& SourceName = SourcePropertyNames[Idx];
-		UClass* SourceClass = InSourceInstance->GetClass();
+		ResolveBindings(LODControlRigs[RigIndex]);
 
-		FProperty* SourceProperty = FindFProperty<FProperty>(SourceClass, SourceName);
-		SourceProperties.Add(SourceProperty);
-		DestProperties.Add(nullptr);
+		FCRPARigLODBindings& Bindings = LODRigBindings[RigIndex];
+		Bindings.ResolvedBindings = MoveTemp(ResolvedBindings);
+		Bindings.PoseAtlasControlIndices = MoveTemp(PoseAtlasControlIndices);
+		Bindings.bBakedBindingsValid = bBakedBindingsValid;
+		Bindings.bPinsHashable = bPinsHashable;
+	}
+
+	ActivateRigLOD(FMath::Min(ActiveRigIndex, LODControlRigs.Num() - 1));
+}
+
+int32 FAnimNode_CRPA::FindRigLOD(int32 InLODLevel) const
+{
+	// the entry with the highest MinLOD reached, entries don't have to be sorted
+	int32 RigIndex = 0;
+	int32 RigMinLOD = 0;
+	for (int32 Index = 0; Index < RigLODs.Num(); ++Index)
+	{
+		if (RigLODs[Index].MinLOD <= InLODLevel && RigLODs[Index].MinLOD >= RigMinLOD)
+		{
+			RigIndex = Index + 1;
+			RigMinLOD = RigLODs[Index].MinLOD;
+		}
+	}
+	return RigIndex;
+}
+
+void FAnimNode_CRPA::ActivateRigLOD(int32 InRigIndex)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	ActiveRigIndex = InRigIndex;
+	ControlRig = LODControlRigs[InRigIndex];
+	TargetInstance = ControlRig;
+
+	const FCRPARigLODBindings& Bindings = LODRigBindings[InRigIndex];
+	ResolvedBindings = Bindings.ResolvedBindings;
+	PoseAtlasControlIndices = Bindings.PoseAtlasControlIndices;
+	bBakedBindingsValid = Bindings.bBakedBindingsValid;
+	bPinsHashable = Bindings.bPinsHashable;
+
+	// the controls of this rig hold whatever was written the last time it ran
+	ChangedControlWriter.Reset(ResolvedBindings, PoseAtlasControlIndices);
+	++ResolvedBindingsSerial;
+	AppliedPoseIndex = INDEX_NONE;
+	WrittenMatrixOutputs.Reset();
+	RefPoseSetterHash.Reset();
+}
+
+void FAnimNode_CRPA::SwapRigLOD(int32 InRigIndex, const FBoneContainer& RequiredBones)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	// the new rig has no result to reuse yet
+	RigResultFrame = MAX_uint64;
+
+	// the output mappings still belong to the previous rig and bone set, so bones are matched by name
+	RigLODBlendPose.Reset();
+	RigLODBlendRemaining = 0.f;
+	const URigHierarchy* Hierarchy = ControlRig ? ControlRig->GetHierarchy() : nullptr;
+	if (Hierarchy && RequiredBones.IsValid() && RigLODBlendTime > 0.f && FAnimWeight::IsRelevant(InternalBlendAlpha))
+	{
+		const FReferenceSkeleton& RefSkeleton = RequiredBones.GetReferenceSkeleton();
+		auto AddBone = [&](const FName& BoneName, int32 RigBoneIndex)
+		{
+			const int32 MeshIndex = RefSkeleton.FindBoneIndex(BoneName);
+			if (MeshIndex == INDEX_NONE || RigBoneIndex == INDEX_NONE)
+			{
+				return;
+			}
+
+			const FCompactPoseBoneIndex CompactIndex = RequiredBones.MakeCompactPoseIndex(FMeshPoseBoneIndex(MeshIndex));
+			if (CompactIndex.IsValid())
+			{
+				RigLODBlendPose.Emplace(CompactIndex.GetInt(), Hierarchy->GetLocalTransform(RigBoneIndex));
+			}
+		};
+
+		for (const TPair<uint16, uint16>& Pair : ControlRigBoneOutputMappingByIndex)
+		{
+			AddBone(Hierarchy->GetKey(Pair.Key).Name, Pair.Key);
+		}
+		for (const TPair<FName, uint16>& Pair : ControlRigBoneOutputMappingByName)
+		{
+			AddBone(Pair.Key, Hierarchy->GetIndex(FRigElementKey(Pair.Key, ERigElementType::Bone)));
+		}
+
+		RigLODBlendRemaining = RigLODBlendTime;
+	}
+
+	ActivateRigLOD(InRigIndex);
+}
+
+void FAnimNode_CRPA::BlendRigLODPose(FPoseContext& InOutput) const
+{
+	if (RigLODBlendRemaining <= 0.f)
+	{
+		return;
+	}
+
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	const float Weight = FMath::Clamp(RigLODBlendRemaining / RigLODBlendTime, 0.f, 1.f);
+	const int32 NumBones = InOutput.Pose.GetNumBones();
+	for (const TPair<int32, FTransform>& Bone : RigLODBlendPose)
+	{
+		if (Bone.Key < NumBones)
+		{
+			InOutput.Pose[FCompactPoseBoneIndex(Bone.Key)].BlendWith(Bone.Value, Weight);
+		}
+	}
+}
+
+#if WITH_EDITOR
+
+void FAnimNode_CRPA::BakeBindings(const UControlRig* InControlRig)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	BakedBindings.Reset();
+	BakedMappingBindings.Reset();
+	BakedRigHash = 0;
+
+	if (InControlRig == nullptr)
+	{
+		return;
+	}
+
+	// unresolved pins are kept with type none so the table lines up with DestPropertyNames
+	for (const FName& DestName : DestPropertyNames)
+	{
+		CRPABindings::ResolveByName(InControlRig, DestName, BakedBindings.AddDefaulted_GetRef());
+	}
+
+	auto BakeMapping = [&](const TMap<FName, FName>& Mapping)
+	{
+		for (auto Iter = Mapping.CreateConstIterator(); Iter; ++Iter)
+		{
+			FCRPABakedBinding Binding;
+			if (CRPABindings::ResolveByName(InControlRig, Iter.Value(), Binding) &&
+				Binding.Type == ECRPABindingType::Control)
+			{
+				BakedMappingBindings.Add(Binding);
+			}
+		}
+	};
+
+	BakeMapping(InputMapping);
+	BakeMapping(OutputMapping);
+
+	BakedRigHash = CRPABindings::ComputeRigHash(InControlRig);
+}
+
+void FAnimNode_CRPA::BakeAffectedBones(UClass* InControlRigClass)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	BakedAffectedBones.Reset();
+
+	if (!bRestrictToAffectedBones || InControlRigClass == nullptr)
+	{
+		return;
+	}
+
+	UControlRig* ProbeRig = NewObject<UControlRig>(GetTransientPackage(), InControlRigClass, NAME_None, RF_Transient);
+	ProbeRig->Initialize(true);
+
+	URigHierarchy* Hierarchy = ProbeRig->GetHierarchy();
+	if (Hierarchy == nullptr)
+	{
+		ProbeRig->MarkAsGarbage();
+		return;
+	}
+
+	// a bone is affected if any probe moves it away from its initial transform
+	TSet<FName> AffectedBones;
+	auto Probe = [&]()
+	{
+		ProbeRig->Evaluate_AnyThread();
+
+		Hierarchy->ForEach<FRigBoneElement>([&](const FRigBoneElement* BoneElement) -> bool
+		{
+			const FTransform InitialTransform = Hierarchy->GetInitialLocalTransform(BoneElement->GetIndex());
+			if (!Hierarchy->GetLocalTransform(BoneElement->GetIndex()).Equals(InitialTransform, KINDA_SMALL_NUMBER))
+			{
+				AffectedBones.Add(BoneElement->GetName());
+			}
+			return true;
+		});
+
+		Hierarchy->ResetPoseToInitial(ERigElementType::Bone);
+	};
+
+	// rig defaults
+	Probe();
+
+	// the pose asset, this is what the pin defaults are made of
+	if (const UControlRigPoseAsset* LoadedPoseAsset = PoseAsset.LoadSynchronous())
+	{
+		for (const FRigControlCopy& ControlCopy : LoadedPoseAsset->Pose.GetPoses())
+		{
+			if (FRigControlElement* ControlElement = ProbeRig->FindControl(ControlCopy.Name))
+			{
+				Hierarchy->SetControlValue(ControlElement, ControlCopy.Value, ERigControlValueType::Current);
+			}
+		}
+		Probe();
+	}
+
+	// exposed controls and variables can take any value at runtime, so nudge all of them, curve inputs included
+	TArray<FName> InputNames = DestPropertyNames;
+	for (auto Iter = InputMapping.CreateConstIterator(); Iter; ++Iter)
+	{
+		InputNames.AddUnique(Iter.Key());
+	}
+
+	for (const FName& InputName : InputNames)
+	{
+		FRigControlElement* ControlElement = ProbeRig->FindControl(InputName);
+		if (ControlElement == nullptr)
+		{
+			// numbers move by one, which also takes a weight off zero, and bools flip
+			FRigVMExternalVariable Variable = ProbeRig->GetPublicVariableByName(InputName);
+			if (!Variable.IsValid() || Variable.bIsReadOnly || Variable.Property == nullptr)
+			{
+				continue;
+			}
+
+			if (Variable.Property->IsA<FBoolProperty>())
+			{
+				Variable.SetValue<bool>(!Variable.GetValue<bool>());
+			}
+			else if (Variable.Property->IsA<FFloatProperty>())
+			{
+				Variable.SetValue<float>(Variable.GetValue<float>() + 1.f);
+			}
+			else if (Variable.Property->IsA<FDoubleProperty>())
+			{
+				Variable.SetValue<double>(Variable.GetValue<double>() + 1.0);
+			}
+			else if (Variable.Property->IsA<FIntProperty>())
+			{
+				Variable.SetValue<int32>(Variable.GetValue<int32>() + 1);
+			}
+			continue;
+		}
+
+		if (ControlElement->Settings.ControlType == ERigControlType::Bool)
+		{
+			continue;
+		}
+
+		const ERigControlType ControlType = ControlElement->Settings.ControlType;
+		const ERigControlAxis PrimaryAxis = ControlElement->Settings.PrimaryAxis;
+
+		FRigControlValue Value = Hierarchy->GetControlValue(ControlElement, ERigControlValueType::Current);
+		FTransform Transform = Value.GetAsTransform(ControlType, PrimaryAxis);
+		Transform.AddToTranslation(FVector::OneVector);
+		Transform.ConcatenateRotation(FQuat(FRotator(10.0, 10.0, 10.0)));
+		Transform.MultiplyScale3D(FVector(1.1));
+		Value.SetFromTransform(Transform, ControlType, PrimaryAxis);
+
+		Hierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
 	}
+	Probe();
+
+	BakedAffectedBones = AffectedBones.Array();
+	ProbeRig->MarkAsGarbage();
 }
 
+#endif
+
 void FAnimNode_CRPA::PropagateInputProperties(const UObject* InSourceInstance)
 {
 	if (TargetInstance)
@@ -412,205 +2042,66 @@ void FAnimNode_CRPA::PropagateInputProperties(const UObject* InSourceInstance)
 			return;
 		}
 
-		// First copy properties
-		check(SourceProperties.Num() == DestProperties.Num());
-		for (int32 PropIdx = 0; PropIdx < SourceProperties.Num(); ++PropIdx)
-		{
-			FProperty* CallerProperty = SourceProperties[PropIdx];
+		// bindings were resolved at init, so no name lookup happens here
+		ChangedControlWriter.Write(InSourceInstance, TargetHierarchy, bOnlyWriteChangedControls);
 
-			if (FRigControlElement* ControlElement = TargetControlRig->FindControl(DestPropertyNames[PropIdx]))
+		for (const FCRPAResolvedBinding& Binding : ResolvedBindings)
+		{
+			if (Binding.Type != ECRPABindingType::Control)
 			{
-				const uint8* SrcPtr = CallerProperty->ContainerPtrToValuePtr<uint8>(InSourceInstance);
+				const uint8* SrcPtr = Binding.SourceProperty->ContainerPtrToValuePtr<uint8>(InSourceInstance);
+				CRPABindings::Apply(Binding, SrcPtr, TargetControlRig, TargetHierarchy);
+			}
+		}
 
-				bool bIsValid = false;
-				FRigControlValue Value;
-				switch (ControlElement->Settings.ControlType)
-				{
-				case ERigControlType::Bool:
-					{
-						if (ensure(CastField<FBoolProperty>(CallerProperty)))
-						{
-							Value = FRigControlValue::Make<bool>(*(bool*)SrcPtr);
-							bIsValid = true;
-						}
-						break;
-					}
-				case ERigControlType::Float:
-					{
-						if (ensure(CastField<FFloatProperty>(CallerProperty)))
-						{
-							Value = FRigControlValue::Make<float>(*(float*)SrcPtr);
-							bIsValid = true;
-						}
-						break;
-					}
-				case ERigControlType::Integer:
-					{
-						if (ensure(CastField<FIntProperty>(CallerProperty)))
-						{
-							Value = FRigControlValue::Make<int32>(*(int32*)SrcPtr);
-							bIsValid = true;
-						}
-						break;
-					}
-				case ERigControlType::Vector2D:
-					{
-						FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty);
-						if (ensure(StructProperty))
-						{
-							if (ensure(StructProperty->Struct == TBaseStructure<FVector2D>::Get()))
-							{
-								const FVector2D& SrcVector = *(FVector2D*)SrcPtr;
-								Value = FRigControlValue::Make<FVector2D>(SrcVector);
-								bIsValid = true;
-							}
-						}
-						break;
-					}
-				case ERigControlType::Position:
-				case ERigControlType::Scale:
-					{
-						FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty);
-						if (ensure(StructProperty))
-						{
-							if (ensure(StructProperty->Struct == TBaseStructure<FVector>::Get()))
-							{
-								const FVector& SrcVector = *(FVector*)SrcPtr;
-								Value = FRigControlValue::Make<FVector>(SrcVector);
-								bIsValid = true;
-							}
-						}
-						break;
-					}
-				case ERigControlType::Rotator:
-					{
-						FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty);
-						if (ensure(StructProperty))
-						{
-							if (ensure(StructProperty->Struct == TBaseStructure<FRotator>::Get()))
-							{
-								const FRotator& SrcRotator = *(FRotator*)SrcPtr;
-								Value = FRigControlValue::Make<FRotator>(SrcRotator);
-								bIsValid = true;
-							}
-						}
-						break;
-					}
-				case ERigControlType::Transform:
-					{
-						FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty);
-						if (ensure(StructProperty))
-						{
-							if (ensure(StructProperty->Struct == TBaseStructure<FTransform>::Get()))
-							{
-								const FTransform& SrcTransform = *(FTransform*)SrcPtr;
-								Value = FRigControlValue::Make<FTransform>(SrcTransform);
-								bIsValid = true;
-							}
-						}
-						break;
-					}
-				case ERigControlType::TransformNoScale:
-					{
-						FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty);
-						if (ensure(StructProperty))
-						{
-							if (ensure(StructProperty->Struct == TBaseStructure<FTransform>::Get()))
-							{
-								const FTransform& SrcTransform = *(FTransform*)SrcPtr;
-								Value = FRigControlValue::Make<FTransformNoScale>(SrcTransform);
-								bIsValid = true;
-							}
-						}
-						break;
-					}
-				case ERigControlType::EulerTransform:
-					{
-						FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty);
-						if (ensure(StructProperty))
-						{
-							if (ensure(StructProperty->Struct == TBaseStructure<FTransform>::Get()))
-							{
-								const FTransform& SrcTransform = *(FTransform*)SrcPtr;
-								Value = FRigControlValue::Make<FEulerTransform>(FEulerTransform(SrcTransform));
-								bIsValid = true;
-							}
-						}
-						break;
-					}
-				default:
-					{
-						checkNoEntry();
-					}
-				}
+		ApplyPoseAtlas(TargetHierarchy);
 
-				if (bIsValid)
-				{
-					TargetHierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
-				}
-				continue;
+		// without a hash of this frame's pins RunControlRig doesn't use the cache
+		if ((bShareOutput || CRPAScalability::IsCachedOutputForced()) && bPinsHashable)
+		{
+			uint64 Hash = 0;
+			for (const FCRPAResolvedBinding& Binding : ResolvedBindings)
+			{
+				const uint8* SrcPtr = Binding.SourceProperty->ContainerPtrToValuePtr<uint8>(InSourceInstance);
+				Hash = CRPAOutputCache::HashPropertyValue(Binding.SourceProperty, SrcPtr, Hash);
 			}
+			PinInputHash = Hash;
+			PinInputHashFrame = GFrameCounter;
+		}
+	}
+}
 
-			FRigVMExternalVariable Variable = TargetControlRig->GetPublicVariableByName(DestPropertyNames[PropIdx]);
-			if (Variable.IsValid())
-			{
-				if (Variable.bIsReadOnly)
-				{
-					continue;
-				}
+void FAnimNode_CRPA::ApplyPoseAtlas(URigHierarchy* InHierarchy)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
 
-				const uint8* SrcPtr = CallerProperty->ContainerPtrToValuePtr<uint8>(InSourceInstance);
+	if (PoseAtlas == nullptr || PoseAtlasControlIndices.Num() != PoseAtlas->GetNumControls() ||
+		!FMath::IsWithin(PoseIndex, 0, PoseAtlas->GetNumPoses()))
+	{
+		return;
+	}
 
-				if (CastField<FBoolProperty>(CallerProperty) != nullptr && Variable.TypeName == TEXT("bool"))
-				{
-					const bool Value = *(const bool*)SrcPtr;
-					Variable.SetValue<bool>(Value);
-				}
-				else if (CastField<FFloatProperty>(CallerProperty) != nullptr && Variable.TypeName == TEXT("float"))
-				{
-					const float Value = *(const float*)SrcPtr;
-					Variable.SetValue<float>(Value);
-				}
-				else if (CastField<FDoubleProperty>(CallerProperty) != nullptr && Variable.TypeName == TEXT("double"))
-				{
-					const double Value = *(const double*)SrcPtr;
-					Variable.SetValue<double>(Value);
-				}
-				else if (CastField<FIntProperty>(CallerProperty) != nullptr && Variable.TypeName == TEXT("int32"))
-				{
-					const int32 Value = *(const int32*)SrcPtr;
-					Variable.SetValue<int32>(Value);
-				}
-				else if (CastField<FNameProperty>(CallerProperty) != nullptr && Variable.TypeName == TEXT("FName"))
-				{
-					const FName Value = *(const FName*)SrcPtr;
-					Variable.SetValue<FName>(Value);
-				}
-				else if (CastField<FNameProperty>(CallerProperty) != nullptr && Variable.TypeName == TEXT("FString"))
-				{
-					const FString Value = *(const FString*)SrcPtr;
-					Variable.SetValue<FString>(Value);
-				}
-				else if (FStructProperty* StructProperty = CastField<FStructProperty>(CallerProperty))
-				{
-					if (StructProperty->Struct == Variable.TypeObject)
-					{
-						StructProperty->Struct->CopyScriptStruct(Variable.Memory, SrcPtr, 1);
-					}
-				}
-				else if (FArrayProperty* ArrayProperty = CastField<FArrayProperty>(CallerProperty))
-				{
-					if (ensure(ArrayProperty->SameType(Variable.Property)))
-					{
-						ArrayProperty->CopyCompleteValue(Variable.Memory, SrcPtr);
-					}
-				}
-				else
-				{
-					ensureMsgf(false, TEXT("Property %s type %s not recognized"), *CallerProperty->GetName(),
-					           *CallerProperty->GetCPPType());
-				}
-			}
+	// pins bound to atlas controls were written first, so they are only overridden if the atlas is applied again
+	if (bOnlyWriteChangedControls && PoseIndex == AppliedPoseIndex && BlendPoseIndex == AppliedBlendPoseIndex &&
+		PoseBlend == AppliedPoseBlend && !ChangedControlWriter.WroteAtlasControls())
+	{
+		return;
+	}
+	AppliedPoseIndex = PoseIndex;
+	AppliedBlendPoseIndex = BlendPoseIndex;
+	AppliedPoseBlend = PoseBlend;
+
+	PoseAtlas->EvaluatePose(PoseIndex, BlendPoseIndex, PoseBlend, PoseAtlasTransforms);
+
+	const TArray<ERigControlType>& ControlTypes = PoseAtlas->GetControlTypes();
+	FRigControlValue Value;
+	for (int32 Control = 0; Control < PoseAtlasControlIndices.Num(); ++Control)
+	{
+		if (FRigControlElement* ControlElement = InHierarchy->Get<FRigControlElement>(PoseAtlasControlIndices[Control]))
+		{
+			// same axis the atlas was packed with
+			Value.SetFromTransform(PoseAtlasTransforms[Control], ControlTypes[Control], ERigControlAxis::X);
+			InHierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
 		}
 	}
 }
@@ -620,6 +2111,7 @@ void FAnimNode_CRPA::PropagateInputProperties(const UObject* InSourceInstance)
 void FAnimNode_CRPA::HandleObjectsReinstanced_Impl(UObject* InSourceObject, UObject* InTargetObject,
                                                    const TMap<UObject*, UObject*>& OldToNewInstanceMap)
 {
+	WaitForAsyncEvaluation();
 	Super::HandleObjectsReinstanced_Impl(InSourceObject, InTargetObject, OldToNewInstanceMap);
 
 	if (ControlRig)
@@ -627,6 +2119,12 @@ void FAnimNode_CRPA::HandleObjectsReinstanced_Impl(UObject* InSourceObject, UObj
 		ControlRig->OnInitialized_AnyThread().RemoveAll(this);
 		ControlRig->OnInitialized_AnyThread().AddRaw(this, &FAnimNode_CRPA::HandleOnInitialized_AnyThread);
 	}
+
+	// the rig layout may have changed with the compile
+	if (ReinitializeChangedRigs())
+	{
+		ResolveRigLODBindings();
+	}
 }
 
 #endif
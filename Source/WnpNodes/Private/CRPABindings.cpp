@@ -0,0 +1,423 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPABindings.h"
+#include "ControlRig.h"
+#include "Rigs/RigHierarchy.h"
+#include "RigVMCore/RigVM.h"
+
+namespace CRPABindings
+{
+	static ECRPABindingType GetTypeFromProperty(const FProperty* InProperty)
+	{
+		if (CastField<FBoolProperty>(InProperty))
+		{
+			return ECRPABindingType::Bool;
+		}
+		if (CastField<FFloatProperty>(InProperty))
+		{
+			return ECRPABindingType::Float;
+		}
+		if (CastField<FDoubleProperty>(InProperty))
+		{
+			return ECRPABindingType::Double;
+		}
+		if (CastField<FIntProperty>(InProperty))
+		{
+			return ECRPABindingType::Int32;
+		}
+		if (CastField<FNameProperty>(InProperty))
+		{
+			return ECRPABindingType::Name;
+		}
+		if (CastField<FStrProperty>(InProperty))
+		{
+			return ECRPABindingType::String;
+		}
+		if (CastField<FStructProperty>(InProperty))
+		{
+			return ECRPABindingType::Struct;
+		}
+		if (CastField<FArrayProperty>(InProperty))
+		{
+			return ECRPABindingType::Array;
+		}
+		return ECRPABindingType::None;
+	}
+
+	bool IsCurveVariable(const FRigVMExternalVariable& InVariable)
+	{
+		return InVariable.Property && (InVariable.TypeName == TEXT("float") || InVariable.TypeName == TEXT("double"));
+	}
+
+	// find the rig property living at the offset, this avoids going through the name again
+	const FProperty* FindVariableProperty(const UControlRig* InControlRig, int32 InOffset)
+	{
+		for (TFieldIterator<FProperty> PropertyIt(InControlRig->GetClass()); PropertyIt; ++PropertyIt)
+		{
+			if (PropertyIt->GetOffset_ForInternal() == InOffset)
+			{
+				return *PropertyIt;
+			}
+		}
+		return nullptr;
+	}
+
+	// the hash is stored with the baked bindings, so it is built from strings and values only. FName hashes use the
+	// name table index, which is different in every process.
+	static uint32 HashString(const FString& InString, uint32 InHash)
+	{
+		return FCrc::StrCrc32(*InString.ToLower(), InHash);
+	}
+
+	template <typename ValueType>
+	static uint32 HashValue(ValueType InValue, uint32 InHash)
+	{
+		return FCrc::MemCrc32(&InValue, sizeof(ValueType), InHash);
+	}
+
+	uint32 ComputeRigHash(const UControlRig* InControlRig)
+	{
+		return InControlRig ? ComputeRigHash(InControlRig->GetHierarchy(), InControlRig->GetClass()) : 0;
+	}
+
+	uint32 ComputeRigHash(const URigHierarchy* InHierarchy, const UClass* InControlRigClass)
+	{
+		uint32 Hash = 0;
+		if (InHierarchy)
+		{
+			InHierarchy->ForEach<FRigControlElement>([&Hash](const FRigControlElement* ControlElement) -> bool
+			{
+				Hash = HashString(ControlElement->GetName().ToString(), Hash);
+				Hash = HashValue<int32>(ControlElement->GetIndex(), Hash);
+				Hash = HashValue<uint8>((uint8)ControlElement->Settings.ControlType, Hash);
+				return true;
+			});
+		}
+
+		if (InControlRigClass == nullptr)
+		{
+			return Hash;
+		}
+
+		// only the properties added by rig blueprints, the native layout can't move without a recompile
+		for (TFieldIterator<FProperty> PropertyIt(InControlRigClass); PropertyIt; ++PropertyIt)
+		{
+			const UClass* OwnerClass = PropertyIt->GetOwnerClass();
+			if (OwnerClass == nullptr || OwnerClass->HasAnyClassFlags(CLASS_Native))
+			{
+				continue;
+			}
+
+			Hash = HashString(PropertyIt->GetName(), Hash);
+			Hash = HashValue<int32>(PropertyIt->GetOffset_ForInternal(), Hash);
+			Hash = HashString(PropertyIt->GetClass()->GetName(), Hash);
+			if (const FStructProperty* StructProperty = CastField<FStructProperty>(*PropertyIt))
+			{
+				Hash = HashString(StructProperty->Struct->GetPathName(), Hash);
+			}
+		}
+
+		return Hash;
+	}
+
+	uint32 ComputeRigCompileHash(const UControlRig* InControlRig)
+	{
+		uint32 Hash = ComputeRigHash(InControlRig);
+		if (const URigVM* VM = InControlRig ? InControlRig->GetVM() : nullptr)
+		{
+			Hash = HashCombine(Hash, VM->GetByteCode().GetByteCodeHash());
+		}
+		return Hash;
+	}
+
+	bool ResolveByName(const UControlRig* InControlRig, const FName& InName, FCRPABakedBinding& OutBinding)
+	{
+		OutBinding = FCRPABakedBinding();
+		OutBinding.Name = InName;
+
+		if (InControlRig == nullptr || InName == NAME_None)
+		{
+			return false;
+		}
+
+		if (const FRigControlElement* ControlElement = InControlRig->FindControl(InName))
+		{
+			OutBinding.ControlIndex = ControlElement->GetIndex();
+			OutBinding.ControlType = ControlElement->Settings.ControlType;
+			OutBinding.Type = ECRPABindingType::Control;
+			return true;
+		}
+
+		const FRigVMExternalVariable Variable = InControlRig->GetPublicVariableByName(InName);
+		if (Variable.IsValid() && !Variable.bIsReadOnly && Variable.Property)
+		{
+			OutBinding.VariableOffset = Variable.Property->GetOffset_ForInternal();
+			OutBinding.Type = GetTypeFromProperty(Variable.Property);
+			return OutBinding.Type != ECRPABindingType::None;
+		}
+
+		return false;
+	}
+
+	bool IsCompatible(const FProperty* InSourceProperty, const FCRPABakedBinding& InBinding,
+	                  const UControlRig* InControlRig)
+	{
+		if (InSourceProperty == nullptr)
+		{
+			return false;
+		}
+
+		if (InBinding.Type == ECRPABindingType::Control)
+		{
+			const FStructProperty* StructProperty = CastField<FStructProperty>(InSourceProperty);
+			switch (InBinding.ControlType)
+			{
+			case ERigControlType::Bool:
+				return ensure(CastField<FBoolProperty>(InSourceProperty));
+			case ERigControlType::Float:
+				return ensure(CastField<FFloatProperty>(InSourceProperty));
+			case ERigControlType::Integer:
+				return ensure(CastField<FIntProperty>(InSourceProperty));
+			case ERigControlType::Vector2D:
+				return ensure(StructProperty) && ensure(StructProperty->Struct == TBaseStructure<FVector2D>::Get());
+			case ERigControlType::Position:
+			case ERigControlType::Scale:
+				return ensure(StructProperty) && ensure(StructProperty->Struct == TBaseStructure<FVector>::Get());
+			case ERigControlType::Rotator:
+				return ensure(StructProperty) && ensure(StructProperty->Struct == TBaseStructure<FRotator>::Get());
+			case ERigControlType::Transform:
+			case ERigControlType::TransformNoScale:
+			case ERigControlType::EulerTransform:
+				return ensure(StructProperty) && ensure(StructProperty->Struct == TBaseStructure<FTransform>::Get());
+			default:
+				{
+					checkNoEntry();
+				}
+			}
+			return false;
+		}
+
+		if (GetTypeFromProperty(InSourceProperty) != InBinding.Type)
+		{
+			ensureMsgf(false, TEXT("Property %s type %s not recognized"), *InSourceProperty->GetName(),
+			           *InSourceProperty->GetCPPType());
+			return false;
+		}
+
+		if (InBinding.Type == ECRPABindingType::Struct || InBinding.Type == ECRPABindingType::Array)
+		{
+			const FProperty* VariableProperty = FindVariableProperty(InControlRig, InBinding.VariableOffset);
+			if (VariableProperty == nullptr)
+			{
+				return false;
+			}
+
+			if (InBinding.Type == ECRPABindingType::Struct)
+			{
+				const FStructProperty* VariableStructProperty = CastField<FStructProperty>(VariableProperty);
+				return VariableStructProperty &&
+					CastFieldChecked<FStructProperty>(InSourceProperty)->Struct == VariableStructProperty->Struct;
+			}
+			return ensure(CastFieldChecked<FArrayProperty>(InSourceProperty)->SameType(VariableProperty));
+		}
+
+		return true;
+	}
+
+	bool MakeControlValue(ERigControlType InControlType, const uint8* InSrcPtr, FRigControlValue& OutValue)
+	{
+		switch (InControlType)
+		{
+		case ERigControlType::Bool:
+			OutValue = FRigControlValue::Make<bool>(*(const bool*)InSrcPtr);
+			return true;
+		case ERigControlType::Float:
+			OutValue = FRigControlValue::Make<float>(*(const float*)InSrcPtr);
+			return true;
+		case ERigControlType::Integer:
+			OutValue = FRigControlValue::Make<int32>(*(const int32*)InSrcPtr);
+			return true;
+		case ERigControlType::Vector2D:
+			OutValue = FRigControlValue::Make<FVector2D>(*(const FVector2D*)InSrcPtr);
+			return true;
+		case ERigControlType::Position:
+		case ERigControlType::Scale:
+			OutValue = FRigControlValue::Make<FVector>(*(const FVector*)InSrcPtr);
+			return true;
+		case ERigControlType::Rotator:
+			OutValue = FRigControlValue::Make<FRotator>(*(const FRotator*)InSrcPtr);
+			return true;
+		case ERigControlType::Transform:
+			OutValue = FRigControlValue::Make<FTransform>(*(const FTransform*)InSrcPtr);
+			return true;
+		case ERigControlType::TransformNoScale:
+			OutValue = FRigControlValue::Make<FTransformNoScale>(*(const FTransform*)InSrcPtr);
+			return true;
+		case ERigControlType::EulerTransform:
+			OutValue = FRigControlValue::Make<FEulerTransform>(FEulerTransform(*(const FTransform*)InSrcPtr));
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	double GetChannel(const FEulerTransform& InTransform, ECRPAControlChannel InChannel)
+	{
+		switch (InChannel)
+		{
+		case ECRPAControlChannel::TranslationX: return InTransform.Location.X;
+		case ECRPAControlChannel::TranslationY: return InTransform.Location.Y;
+		case ECRPAControlChannel::TranslationZ: return InTransform.Location.Z;
+		case ECRPAControlChannel::RotationPitch: return InTransform.Rotation.Pitch;
+		case ECRPAControlChannel::RotationYaw: return InTransform.Rotation.Yaw;
+		case ECRPAControlChannel::RotationRoll: return InTransform.Rotation.Roll;
+		case ECRPAControlChannel::ScaleX: return InTransform.Scale.X;
+		case ECRPAControlChannel::ScaleY: return InTransform.Scale.Y;
+		case ECRPAControlChannel::ScaleZ: return InTransform.Scale.Z;
+		default: return 0.0;
+		}
+	}
+
+	void SetChannel(FEulerTransform& InOutTransform, ECRPAControlChannel InChannel, double InValue)
+	{
+		switch (InChannel)
+		{
+		case ECRPAControlChannel::TranslationX: InOutTransform.Location.X = InValue; break;
+		case ECRPAControlChannel::TranslationY: InOutTransform.Location.Y = InValue; break;
+		case ECRPAControlChannel::TranslationZ: InOutTransform.Location.Z = InValue; break;
+		case ECRPAControlChannel::RotationPitch: InOutTransform.Rotation.Pitch = InValue; break;
+		case ECRPAControlChannel::RotationYaw: InOutTransform.Rotation.Yaw = InValue; break;
+		case ECRPAControlChannel::RotationRoll: InOutTransform.Rotation.Roll = InValue; break;
+		case ECRPAControlChannel::ScaleX: InOutTransform.Scale.X = InValue; break;
+		case ECRPAControlChannel::ScaleY: InOutTransform.Scale.Y = InValue; break;
+		case ECRPAControlChannel::ScaleZ: InOutTransform.Scale.Z = InValue; break;
+		default: break;
+		}
+	}
+
+	void Apply(const FCRPAResolvedBinding& InBinding, const uint8* InSrcPtr, UControlRig* InControlRig,
+	           URigHierarchy* InHierarchy)
+	{
+		if (InBinding.Type == ECRPABindingType::Control)
+		{
+			FRigControlElement* ControlElement = InHierarchy->Get<FRigControlElement>(InBinding.ControlIndex);
+			FRigControlValue Value;
+			if (ControlElement == nullptr || !MakeControlValue(InBinding.ControlType, InSrcPtr, Value))
+			{
+				return;
+			}
+
+			InHierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
+			return;
+		}
+
+		uint8* DestPtr = reinterpret_cast<uint8*>(InControlRig) + InBinding.VariableOffset;
+		switch (InBinding.Type)
+		{
+		case ECRPABindingType::Bool:
+			*(bool*)DestPtr = *(const bool*)InSrcPtr;
+			break;
+		case ECRPABindingType::Float:
+			*(float*)DestPtr = *(const float*)InSrcPtr;
+			break;
+		case ECRPABindingType::Double:
+			*(double*)DestPtr = *(const double*)InSrcPtr;
+			break;
+		case ECRPABindingType::Int32:
+			*(int32*)DestPtr = *(const int32*)InSrcPtr;
+			break;
+		case ECRPABindingType::Name:
+			*(FName*)DestPtr = *(const FName*)InSrcPtr;
+			break;
+		case ECRPABindingType::String:
+			*(FString*)DestPtr = *(const FString*)InSrcPtr;
+			break;
+		case ECRPABindingType::Struct:
+			CastFieldChecked<FStructProperty>(InBinding.SourceProperty)->Struct->CopyScriptStruct(DestPtr, InSrcPtr, 1);
+			break;
+		case ECRPABindingType::Array:
+			InBinding.SourceProperty->CopyCompleteValue(DestPtr, InSrcPtr);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void FCRPAChangedControlWriter::Reset(TArrayView<const FCRPAResolvedBinding> InBindings,
+                                      TArrayView<const int32> InAtlasControlIndices)
+{
+	SourceProperties.Reset();
+	ControlIndices.Reset();
+	ControlTypes.Reset();
+	AtlasControls.Reset();
+	ValueOffsets.Reset();
+
+	int32 ValueSize = 0;
+	for (const FCRPAResolvedBinding& Binding : InBindings)
+	{
+		if (Binding.Type == ECRPABindingType::Control)
+		{
+			SourceProperties.Add(Binding.SourceProperty);
+			ControlIndices.Add(Binding.ControlIndex);
+			ControlTypes.Add(Binding.ControlType);
+			AtlasControls.Add(InAtlasControlIndices.Contains(Binding.ControlIndex));
+			ValueOffsets.Add(ValueSize);
+			ValueSize += Align(Binding.SourceProperty->GetSize(), 16);
+		}
+	}
+	ValueOffsets.Add(ValueSize);
+
+	Values.SetNumZeroed(ValueSize);
+	ChangedControls.Reset(ControlIndices.Num());
+	bHasWritten = false;
+	bWroteAtlasControls = false;
+}
+
+int32 FCRPAChangedControlWriter::Write(const UObject* InSourceInstance, URigHierarchy* InHierarchy, bool bOnlyChanged)
+{
+	FRigControlValue Value;
+	auto SetControl = [&](int32 Index, const uint8* SrcPtr)
+	{
+		FRigControlElement* ControlElement = InHierarchy->Get<FRigControlElement>(ControlIndices[Index]);
+		if (ControlElement && CRPABindings::MakeControlValue(ControlTypes[Index], SrcPtr, Value))
+		{
+			InHierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
+		}
+	};
+
+	// nothing to compare with, the pins go straight into the hierarchy and the next filtered write sends everything
+	if (!bOnlyChanged)
+	{
+		for (int32 Index = 0; Index < ControlIndices.Num(); ++Index)
+		{
+			SetControl(Index, SourceProperties[Index]->ContainerPtrToValuePtr<uint8>(InSourceInstance));
+		}
+		bHasWritten = false;
+		bWroteAtlasControls = AtlasControls.Contains(true);
+		return ControlIndices.Num();
+	}
+
+	// compare every pin with the last write first, so the hierarchy is only visited for what changed
+	ChangedControls.Reset();
+	for (int32 Index = 0; Index < ControlIndices.Num(); ++Index)
+	{
+		const uint8* SrcPtr = SourceProperties[Index]->ContainerPtrToValuePtr<uint8>(InSourceInstance);
+		uint8* ValuePtr = Values.GetData() + ValueOffsets[Index];
+		const int32 Size = SourceProperties[Index]->GetSize();
+		if (!bHasWritten || FMemory::Memcmp(ValuePtr, SrcPtr, Size) != 0)
+		{
+			FMemory::Memcpy(ValuePtr, SrcPtr, Size);
+			ChangedControls.Add(Index);
+		}
+	}
+	bHasWritten = true;
+
+	bWroteAtlasControls = false;
+	for (const int32 Index : ChangedControls)
+	{
+		SetControl(Index, Values.GetData() + ValueOffsets[Index]);
+		bWroteAtlasControls |= AtlasControls[Index];
+	}
+	return ChangedControls.Num();
+}
@@ -0,0 +1,325 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPACapture.h"
+#include "ControlRig.h"
+#include "EngineLogs.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Paths.h"
+#include "Rigs/RigHierarchy.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/NameAsStringProxyArchive.h"
+#include "Serialization/StructuredArchiveAdapters.h"
+
+namespace CRPACapture
+{
+	static constexpr uint32 FileMagic = 0x41505243; // 'CRPA'
+	static constexpr int32 FileVersion = 2;
+
+	enum class ERecordType : uint8
+	{
+		BoneNames,
+		Bindings,
+		InputCurveNames,
+		Frame,
+		PinNames,
+	};
+
+	static std::atomic<bool> bIsCapturing(false);
+	static std::atomic<int32> Session(0);
+	static std::atomic<int32> FileCounter(0);
+	static FString CaptureDirectory;
+
+	bool IsCapturing()
+	{
+		return bIsCapturing.load(std::memory_order_relaxed);
+	}
+
+	int32 GetSession()
+	{
+		return Session.load(std::memory_order_relaxed);
+	}
+
+	FString MakeFilename(const FString& InOwnerName)
+	{
+		return FPaths::Combine(CaptureDirectory,
+		                       FString::Printf(TEXT("%s_%d_%d.crpa"), *InOwnerName, GetSession(), FileCounter++));
+	}
+
+	void SerializePinValues(FArchive& Ar, TArrayView<const FCRPAResolvedBinding> InBindings,
+	                        TArrayView<const FProperty* const> InVariableProperties, UControlRig* InControlRig,
+	                        URigHierarchy* InHierarchy)
+	{
+		check(InBindings.Num() == InVariableProperties.Num());
+
+		for (int32 Index = 0; Index < InBindings.Num(); ++Index)
+		{
+			const FCRPAResolvedBinding& Binding = InBindings[Index];
+			if (Binding.Type == ECRPABindingType::Control)
+			{
+				FRigControlElement* ControlElement = InHierarchy->Get<FRigControlElement>(Binding.ControlIndex);
+				FRigControlValue Value;
+				if (ControlElement && Ar.IsSaving())
+				{
+					Value = InHierarchy->GetControlValue(ControlElement, ERigControlValueType::Current);
+				}
+
+				FRigControlValue::StaticStruct()->SerializeBin(Ar, &Value);
+
+				if (ControlElement && Ar.IsLoading())
+				{
+					InHierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
+				}
+			}
+			else if (const FProperty* VariableProperty = InVariableProperties[Index])
+			{
+				uint8* Memory = reinterpret_cast<uint8*>(InControlRig) + Binding.VariableOffset;
+				FStructuredArchiveFromArchive StructuredArchive(Ar);
+				VariableProperty->SerializeItem(StructuredArchive.GetSlot(), Memory);
+			}
+		}
+	}
+
+	void SerializeSourcePinValues(FArchive& Ar, TArrayView<const FProperty* const> InSourceProperties,
+	                              UObject* InSourceInstance)
+	{
+		FStructuredArchiveFromArchive StructuredArchive(Ar);
+		for (const FProperty* SourceProperty : InSourceProperties)
+		{
+			if (SourceProperty)
+			{
+				SourceProperty->SerializeItem(StructuredArchive.GetSlot(),
+				                              SourceProperty->ContainerPtrToValuePtr<void>(InSourceInstance));
+			}
+		}
+	}
+
+	static FAutoConsoleCommand StartCaptureCommand(
+		TEXT("CRPA.Capture.Start"),
+		TEXT("Record the inputs of every CRPA node, one file per node instance. Args: [Directory=Saved/CRPACaptures]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			CaptureDirectory = Args.Num() > 0 ? Args[0] : FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("CRPACaptures"));
+			IFileManager::Get().MakeDirectory(*CaptureDirectory, true);
+
+			++Session;
+			bIsCapturing = true;
+			UE_LOG(LogAnimation, Display, TEXT("CRPA capture started in %s"), *CaptureDirectory);
+		}));
+
+	static FAutoConsoleCommand StopCaptureCommand(
+		TEXT("CRPA.Capture.Stop"),
+		TEXT("Stop recording CRPA node inputs"),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			bIsCapturing = false;
+			UE_LOG(LogAnimation, Display, TEXT("CRPA capture stopped"));
+		}));
+}
+
+TSharedPtr<FCRPACaptureWriter> FCRPACaptureWriter::Create(const FString& InFilename, const FCRPACaptureHeader& InHeader)
+{
+	FArchive* FileArchive = IFileManager::Get().CreateFileWriter(*InFilename);
+	if (FileArchive == nullptr)
+	{
+		UE_LOG(LogAnimation, Warning, TEXT("Unable to create CRPA capture file %s"), *InFilename);
+		return nullptr;
+	}
+
+	TSharedPtr<FCRPACaptureWriter> Writer(new FCRPACaptureWriter());
+	Writer->FileArchive.Reset(FileArchive);
+	Writer->Archive = MakeUnique<FNameAsStringProxyArchive>(*FileArchive);
+
+	uint32 Magic = CRPACapture::FileMagic;
+	int32 Version = CRPACapture::FileVersion;
+	FCRPACaptureHeader Header = InHeader;
+	*Writer->Archive << Magic << Version << Header.ControlRigClassPath << Header.AnimClassPath << Header.NodePropertyName
+		<< Header.SkeletonPath;
+
+	return Writer;
+}
+
+FCRPACaptureWriter::~FCRPACaptureWriter()
+{
+	Archive.Reset();
+	if (FileArchive)
+	{
+		FileArchive->Close();
+	}
+}
+
+void FCRPACaptureWriter::WriteBoneNames(TArrayView<const FName> InBoneNames, int32 InLODLevel)
+{
+	uint8 RecordType = (uint8)CRPACapture::ERecordType::BoneNames;
+	TArray<FName> BoneNames(InBoneNames);
+	*Archive << RecordType << BoneNames << InLODLevel;
+}
+
+void FCRPACaptureWriter::WritePinNames(TArrayView<FProperty* const> InSourceProperties)
+{
+	uint8 RecordType = (uint8)CRPACapture::ERecordType::PinNames;
+	TArray<FName> PinNames;
+
+	SourceProperties.Reset(InSourceProperties.Num());
+	for (const FProperty* SourceProperty : InSourceProperties)
+	{
+		if (SourceProperty)
+		{
+			PinNames.Add(SourceProperty->GetFName());
+			SourceProperties.Add(SourceProperty);
+		}
+	}
+
+	*Archive << RecordType << PinNames;
+}
+
+void FCRPACaptureWriter::WriteBindings(const UControlRig* InControlRig, TArrayView<const FCRPAResolvedBinding> InBindings)
+{
+	uint8 RecordType = (uint8)CRPACapture::ERecordType::Bindings;
+	FString ControlRigClassPath = GetPathNameSafe(InControlRig ? InControlRig->GetClass() : nullptr);
+	TArray<FName> BindingNames;
+
+	VariableProperties.Reset(InBindings.Num());
+	for (const FCRPAResolvedBinding& Binding : InBindings)
+	{
+		BindingNames.Add(Binding.Name);
+		VariableProperties.Add(Binding.Type == ECRPABindingType::Control
+			                       ? nullptr
+			                       : CRPABindings::FindVariableProperty(InControlRig, Binding.VariableOffset));
+	}
+
+	*Archive << RecordType << ControlRigClassPath << BindingNames;
+}
+
+void FCRPACaptureWriter::WriteInputCurveNames(TArrayView<const FName> InVariableNames)
+{
+	uint8 RecordType = (uint8)CRPACapture::ERecordType::InputCurveNames;
+	TArray<FName> VariableNames(InVariableNames);
+	*Archive << RecordType << VariableNames;
+}
+
+void FCRPACaptureWriter::WriteFrame(float InDeltaTime, float InAlpha, TArrayView<const FTransform> InSourcePose,
+                                    TArrayView<const float> InInputCurves, UObject* InSourceInstance,
+                                    TArrayView<const FCRPAResolvedBinding> InBindings, UControlRig* InControlRig,
+                                    URigHierarchy* InHierarchy)
+{
+	uint8 RecordType = (uint8)CRPACapture::ERecordType::Frame;
+	*Archive << RecordType << InDeltaTime << InAlpha;
+
+	// single precision is plenty for profiling and halves the file size
+	PoseBuffer.Reset(InSourcePose.Num());
+	for (const FTransform& Transform : InSourcePose)
+	{
+		PoseBuffer.Add(FTransform3f(Transform));
+	}
+	PoseBuffer.BulkSerialize(*Archive);
+
+	int32 NumCurves = InInputCurves.Num();
+	*Archive << NumCurves;
+	Archive->Serialize(const_cast<float*>(InInputCurves.GetData()), NumCurves * sizeof(float));
+
+	{
+		PinBuffer.Reset();
+		FMemoryWriter MemoryWriter(PinBuffer);
+		FNameAsStringProxyArchive PinArchive(MemoryWriter);
+		CRPACapture::SerializePinValues(PinArchive, InBindings, VariableProperties, InControlRig, InHierarchy);
+		*Archive << PinBuffer;
+	}
+
+	{
+		PinBuffer.Reset();
+		FMemoryWriter MemoryWriter(PinBuffer);
+		FNameAsStringProxyArchive PinArchive(MemoryWriter);
+		CRPACapture::SerializeSourcePinValues(PinArchive, SourceProperties, InSourceInstance);
+		*Archive << PinBuffer;
+	}
+}
+
+TSharedPtr<FCRPACaptureReader> FCRPACaptureReader::Open(const FString& InFilename)
+{
+	FArchive* FileArchive = IFileManager::Get().CreateFileReader(*InFilename);
+	if (FileArchive == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to open CRPA capture file %s"), *InFilename);
+		return nullptr;
+	}
+
+	TSharedPtr<FCRPACaptureReader> Reader(new FCRPACaptureReader());
+	Reader->FileArchive.Reset(FileArchive);
+	Reader->Archive = MakeUnique<FNameAsStringProxyArchive>(*FileArchive);
+
+	uint32 Magic = 0;
+	int32 Version = 0;
+	*Reader->Archive << Magic << Version;
+	if (Magic != CRPACapture::FileMagic || Version != CRPACapture::FileVersion)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("%s is not a CRPA capture file (or has an unsupported version)"), *InFilename);
+		return nullptr;
+	}
+
+	FCRPACaptureHeader& Header = Reader->Header;
+	*Reader->Archive << Header.ControlRigClassPath << Header.AnimClassPath << Header.NodePropertyName << Header.SkeletonPath;
+	return Reader;
+}
+
+FCRPACaptureReader::~FCRPACaptureReader()
+{
+	Archive.Reset();
+	if (FileArchive)
+	{
+		FileArchive->Close();
+	}
+}
+
+bool FCRPACaptureReader::ReadFrame(FCRPACaptureFrame& OutFrame)
+{
+	bBoneNamesChanged = false;
+	bPinNamesChanged = false;
+	bBindingsChanged = false;
+	bInputCurvesChanged = false;
+
+	while (!Archive->AtEnd() && !Archive->IsError())
+	{
+		uint8 RecordType = 0;
+		*Archive << RecordType;
+
+		switch ((CRPACapture::ERecordType)RecordType)
+		{
+		case CRPACapture::ERecordType::BoneNames:
+			*Archive << BoneNames << LODLevel;
+			bBoneNamesChanged = true;
+			break;
+		case CRPACapture::ERecordType::PinNames:
+			*Archive << PinNames;
+			bPinNamesChanged = true;
+			break;
+		case CRPACapture::ERecordType::Bindings:
+			*Archive << Header.ControlRigClassPath << BindingNames;
+			bBindingsChanged = true;
+			break;
+		case CRPACapture::ERecordType::InputCurveNames:
+			*Archive << InputCurveVariableNames;
+			bInputCurvesChanged = true;
+			break;
+		case CRPACapture::ERecordType::Frame:
+			{
+				*Archive << OutFrame.DeltaTime << OutFrame.Alpha;
+				OutFrame.SourcePose.BulkSerialize(*Archive);
+
+				int32 NumCurves = 0;
+				*Archive << NumCurves;
+				OutFrame.InputCurves.SetNumUninitialized(NumCurves);
+				Archive->Serialize(OutFrame.InputCurves.GetData(), NumCurves * sizeof(float));
+
+				*Archive << OutFrame.PinData << OutFrame.SourcePinData;
+				return !Archive->IsError();
+			}
+		default:
+			UE_LOG(LogAnimation, Error, TEXT("Corrupted CRPA capture, unknown record %d"), RecordType);
+			return false;
+		}
+	}
+
+	return false;
+}
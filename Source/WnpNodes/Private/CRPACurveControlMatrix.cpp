@@ -0,0 +1,146 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPACurveControlMatrix.h"
+
+// above this ratio of non zero weights the dense rows are faster than the compressed ones
+static constexpr float DenseFillRatio = 0.25f;
+
+void UCRPACurveControlMatrix::Multiply(const float* RESTRICT Inputs, float* RESTRICT Outputs) const
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	const int32 NumChannels = Channels.Num();
+	if (bDense)
+	{
+		check(DenseWeights.Num() == NumChannels * InputStride);
+
+		const float* RESTRICT Row = DenseWeights.GetData();
+		for (int32 Channel = 0; Channel < NumChannels; ++Channel, Row += InputStride)
+		{
+			VectorRegister4Float Sum = VectorZeroFloat();
+			for (int32 Input = 0; Input < InputStride; Input += 4)
+			{
+				Sum = VectorMultiplyAdd(VectorLoad(Row + Input), VectorLoad(Inputs + Input), Sum);
+			}
+
+			alignas(16) float Lanes[4];
+			VectorStoreAligned(Sum, Lanes);
+			Outputs[Channel] = (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+		}
+		return;
+	}
+
+	check(RowStarts.Num() == NumChannels + 1);
+	for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+	{
+		float Sum = 0.f;
+		for (int32 Entry = RowStarts[Channel]; Entry < RowStarts[Channel + 1]; ++Entry)
+		{
+			Sum += SparseWeights[Entry] * Inputs[Columns[Entry]];
+		}
+		Outputs[Channel] = Sum;
+	}
+}
+
+#if WITH_EDITOR
+
+void UCRPACurveControlMatrix::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	if (PropertyChangedEvent.GetMemberPropertyName() == GET_MEMBER_NAME_CHECKED(UCRPACurveControlMatrix, Weights))
+	{
+		Build();
+	}
+}
+
+void UCRPACurveControlMatrix::Build()
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	InputCurves.Reset();
+	ChannelControls.Reset();
+	Channels.Reset();
+	DenseWeights.Reset();
+	RowStarts.Reset();
+	Columns.Reset();
+	SparseWeights.Reset();
+
+	// controls in the order they first appear, their channels next to each other
+	TArray<FName> Controls;
+	TMap<FName, TArray<ECRPAControlChannel>> ControlChannels;
+	for (const FCRPACurveControlWeight& Weight : Weights)
+	{
+		if (Weight.Curve.IsNone() || Weight.Control.IsNone())
+		{
+			continue;
+		}
+
+		InputCurves.AddUnique(Weight.Curve);
+		if (!ControlChannels.Contains(Weight.Control))
+		{
+			Controls.Add(Weight.Control);
+		}
+		ControlChannels.FindOrAdd(Weight.Control).AddUnique(Weight.Channel);
+	}
+
+	TMap<TPair<FName, ECRPAControlChannel>, int32> ChannelIndices;
+	for (const FName& Control : Controls)
+	{
+		for (const ECRPAControlChannel Channel : ControlChannels.FindChecked(Control))
+		{
+			ChannelIndices.Add({Control, Channel}, Channels.Num());
+			ChannelControls.Add(Control);
+			Channels.Add(Channel);
+		}
+	}
+
+	// duplicated entries add up
+	TArray<TMap<int32, float>> Rows;
+	Rows.SetNum(Channels.Num());
+	for (const FCRPACurveControlWeight& Weight : Weights)
+	{
+		if (const int32* Channel = ChannelIndices.Find({Weight.Control, Weight.Channel}))
+		{
+			Rows[*Channel].FindOrAdd(InputCurves.IndexOfByKey(Weight.Curve), 0.f) += Weight.Weight;
+		}
+	}
+
+	int32 NumWeights = 0;
+	for (const TMap<int32, float>& Row : Rows)
+	{
+		NumWeights += Row.Num();
+	}
+
+	InputStride = Align(InputCurves.Num(), 4);
+	bDense = NumWeights >= DenseFillRatio * Channels.Num() * InputCurves.Num();
+	if (bDense)
+	{
+		DenseWeights.SetNumZeroed(Channels.Num() * InputStride);
+		for (int32 Channel = 0; Channel < Rows.Num(); ++Channel)
+		{
+			for (const TPair<int32, float>& Entry : Rows[Channel])
+			{
+				DenseWeights[Channel * InputStride + Entry.Key] = Entry.Value;
+			}
+		}
+	}
+	else
+	{
+		for (TMap<int32, float>& Row : Rows)
+		{
+			Row.KeySort(TLess<int32>());
+			RowStarts.Add(Columns.Num());
+			for (const TPair<int32, float>& Entry : Row)
+			{
+				Columns.Add(Entry.Key);
+				SparseWeights.Add(Entry.Value);
+			}
+		}
+		RowStarts.Add(Columns.Num());
+	}
+
+	MarkPackageDirty();
+}
+
+#endif
@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPADebugStats.h"
+
+void FCRPADebugStats::Record(ECRPAEvaluation InEvaluation, float InMilliseconds)
+{
+	Milliseconds[Head] = InMilliseconds;
+	Evaluations[Head] = InEvaluation;
+	Head = (Head + 1) % HistorySize;
+	NumRecorded = FMath::Min(NumRecorded + 1, HistorySize);
+}
+
+FString FCRPADebugStats::ToString() const
+{
+	if (NumRecorded == 0)
+	{
+		return TEXT("no samples");
+	}
+
+	float Total = 0.f;
+	float Max = 0.f;
+	int32 NumExecuted = 0;
+	for (int32 Sample = 0; Sample < NumRecorded; ++Sample)
+	{
+		Total += Milliseconds[Sample];
+		Max = FMath::Max(Max, Milliseconds[Sample]);
+		NumExecuted += Evaluations[Sample] == ECRPAEvaluation::Executed ? 1 : 0;
+	}
+
+	const int32 Last = (Head + HistorySize - 1) % HistorySize;
+	return FString::Printf(TEXT("%s %.3fms avg %.3fms max %.3fms ran %d/%d"), LexToString(Evaluations[Last]),
+	                       Milliseconds[Last], Total / NumRecorded, Max, NumExecuted, NumRecorded);
+}
+
+const TCHAR* FCRPADebugStats::LexToString(ECRPAEvaluation InEvaluation)
+{
+	switch (InEvaluation)
+	{
+	case ECRPAEvaluation::Executed:
+		return TEXT("Executed");
+	case ECRPAEvaluation::SharedOutput:
+		return TEXT("Shared");
+	case ECRPAEvaluation::Async:
+		return TEXT("Async");
+	case ECRPAEvaluation::Baked:
+		return TEXT("Baked");
+	case ECRPAEvaluation::Cached:
+		return TEXT("Cached");
+	case ECRPAEvaluation::ReducedRate:
+		return TEXT("Reduced rate");
+	case ECRPAEvaluation::SkippedBudget:
+		return TEXT("Skipped (budget)");
+	case ECRPAEvaluation::SkippedLOD:
+		return TEXT("Skipped (LOD)");
+	case ECRPAEvaluation::SkippedAlpha:
+		return TEXT("Skipped (alpha)");
+	case ECRPAEvaluation::SkippedNotRendered:
+		return TEXT("Skipped (not rendered)");
+	default:
+		return TEXT("None");
+	}
+}
@@ -0,0 +1,276 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAHotPath.h"
+
+#if WITH_CRPA_HOT_PATH_CHECKS
+#include "EngineLogs.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/MemoryBase.h"
+#include "HAL/PlatformStackWalk.h"
+#include "Misc/ScopeLock.h"
+
+namespace CRPAHotPath
+{
+	static constexpr int32 MaxStackDepth = 32;
+	static constexpr int32 MaxRecords = 64;
+
+	struct FRecord
+	{
+		uint64 Frames[MaxStackDepth];
+		int32 NumFrames;
+		SIZE_T Size;
+		int32 Count;
+	};
+
+	static thread_local int32 ScopeDepth = 0;
+	static thread_local bool bIsRecording = false;
+
+	static std::atomic<bool> bIsTracking(false);
+	static std::atomic<int32> NumAllocations(0);
+
+	// fixed storage, recording must not allocate itself
+	static FCriticalSection RecordsLock;
+	static FRecord Records[MaxRecords];
+	static int32 NumRecords = 0;
+
+	static void RecordAllocation(SIZE_T Size)
+	{
+		if (ScopeDepth == 0 || bIsRecording || !bIsTracking.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+
+		TGuardValue<bool> RecordingGuard(bIsRecording, true);
+		++NumAllocations;
+
+		uint64 Frames[MaxStackDepth];
+		const int32 NumFrames = FPlatformStackWalk::CaptureStackBackTrace(Frames, MaxStackDepth);
+
+		FScopeLock Lock(&RecordsLock);
+
+		// the same call site usually allocates every frame, only keep it once
+		for (int32 Index = 0; Index < NumRecords; ++Index)
+		{
+			FRecord& Record = Records[Index];
+			if (Record.NumFrames == NumFrames &&
+				FMemory::Memcmp(Record.Frames, Frames, NumFrames * sizeof(uint64)) == 0)
+			{
+				++Record.Count;
+				return;
+			}
+		}
+
+		if (NumRecords < MaxRecords)
+		{
+			FRecord& Record = Records[NumRecords++];
+			FMemory::Memcpy(Record.Frames, Frames, NumFrames * sizeof(uint64));
+			Record.NumFrames = NumFrames;
+			Record.Size = Size;
+			Record.Count = 1;
+		}
+	}
+
+	/** Forwards everything to the allocator it replaced, allocations are recorded on the way */
+	class FTrackingMalloc final : public FMalloc
+	{
+	public:
+		explicit FTrackingMalloc(FMalloc* InInnerMalloc)
+			: InnerMalloc(InInnerMalloc)
+		{
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			RecordAllocation(Count);
+			return InnerMalloc->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			RecordAllocation(Count);
+			return InnerMalloc->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				RecordAllocation(Count);
+			}
+			return InnerMalloc->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				RecordAllocation(Count);
+			}
+			return InnerMalloc->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override
+		{
+			InnerMalloc->Free(Original);
+		}
+
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+		{
+			return InnerMalloc->QuantizeSize(Count, Alignment);
+		}
+
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+		{
+			return InnerMalloc->GetAllocationSize(Original, SizeOut);
+		}
+
+		virtual void Trim(bool bTrimThreadCaches) override
+		{
+			InnerMalloc->Trim(bTrimThreadCaches);
+		}
+
+		virtual void SetupTLSCachesOnCurrentThread() override
+		{
+			InnerMalloc->SetupTLSCachesOnCurrentThread();
+		}
+
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override
+		{
+			InnerMalloc->ClearAndDisableTLSCachesOnCurrentThread();
+		}
+
+		virtual void InitializeStatsMetadata() override
+		{
+			InnerMalloc->InitializeStatsMetadata();
+		}
+
+		virtual void UpdateStats() override
+		{
+			InnerMalloc->UpdateStats();
+		}
+
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override
+		{
+			InnerMalloc->GetAllocatorStats(OutStats);
+		}
+
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override
+		{
+			InnerMalloc->DumpAllocatorStats(Ar);
+		}
+
+		virtual bool IsInternallyThreadSafe() const override
+		{
+			return InnerMalloc->IsInternallyThreadSafe();
+		}
+
+		virtual bool ValidateHeap() override
+		{
+			return InnerMalloc->ValidateHeap();
+		}
+
+		virtual const TCHAR* GetDescriptiveName() override
+		{
+			return InnerMalloc->GetDescriptiveName();
+		}
+
+	private:
+		FMalloc* InnerMalloc;
+	};
+
+	static FTrackingMalloc* TrackingMalloc = nullptr;
+
+	FScope::FScope()
+	{
+		++ScopeDepth;
+	}
+
+	FScope::~FScope()
+	{
+		--ScopeDepth;
+	}
+
+	void Install()
+	{
+		check(IsInGameThread());
+
+		// the proxy forwards to the allocator it wraps, so threads still calling the old GMalloc and blocks from
+		// before are fine. It is never removed, something else may have wrapped it since.
+		if (TrackingMalloc == nullptr)
+		{
+			TrackingMalloc = new FTrackingMalloc(GMalloc);
+			GMalloc = TrackingMalloc;
+			UE_LOG(LogAnimation, Display, TEXT("CRPA hot path: tracking allocator installed over %s"),
+			       TrackingMalloc->GetDescriptiveName());
+		}
+	}
+
+	void StartTracking()
+	{
+		check(IsInGameThread());
+
+		Install();
+
+		{
+			FScopeLock Lock(&RecordsLock);
+			NumRecords = 0;
+		}
+		NumAllocations = 0;
+		bIsTracking = true;
+	}
+
+	int32 StopTracking()
+	{
+		check(IsInGameThread());
+
+		if (!bIsTracking)
+		{
+			return 0;
+		}
+		bIsTracking = false;
+
+		FScopeLock Lock(&RecordsLock);
+		for (int32 Index = 0; Index < NumRecords; ++Index)
+		{
+			const FRecord& Record = Records[Index];
+			UE_LOG(LogAnimation, Warning, TEXT("CRPA hot path allocation of %llu bytes, %d times:"),
+			       (uint64)Record.Size, Record.Count);
+
+			for (int32 Frame = 0; Frame < Record.NumFrames; ++Frame)
+			{
+				ANSICHAR Line[1024];
+				Line[0] = 0;
+				FPlatformStackWalk::ProgramCounterToHumanReadableString(Frame, Record.Frames[Frame], Line, sizeof(Line));
+				UE_LOG(LogAnimation, Warning, TEXT("    %s"), ANSI_TO_TCHAR(Line));
+			}
+		}
+
+		if (NumAllocations > 0)
+		{
+			UE_LOG(LogAnimation, Warning, TEXT("CRPA hot path: %d allocations in total"), NumAllocations.load());
+		}
+		else
+		{
+			UE_LOG(LogAnimation, Display, TEXT("CRPA hot path: no allocations"));
+		}
+
+		return NumAllocations;
+	}
+
+	static FAutoConsoleCommand StartTrackingCommand(
+		TEXT("CRPA.HotPath.Start"),
+		TEXT("Start recording heap allocations made inside CRPA update and evaluate"),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			StartTracking();
+		}));
+
+	static FAutoConsoleCommand StopTrackingCommand(
+		TEXT("CRPA.HotPath.Stop"),
+		TEXT("Stop recording and log the call stacks of the CRPA hot path allocations"),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			StopTracking();
+		}));
+}
+#endif
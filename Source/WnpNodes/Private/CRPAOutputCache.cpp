@@ -0,0 +1,285 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAOutputCache.h"
+#include "HAL/IConsoleManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/ScopeLock.h"
+
+namespace CRPAOutputCache
+{
+	static void Rebuild(IConsoleVariable*);
+
+	static int32 BudgetKB = 2048;
+	static FAutoConsoleVariableRef CVarBudgetKB(
+		TEXT("a.CRPA.OutputCache.BudgetKB"),
+		BudgetKB,
+		TEXT("Memory of the shared CRPA output cache, split into slots of MaxBones and MaxCurves. Least recently used slots are reused"),
+		FConsoleVariableDelegate::CreateStatic(&Rebuild));
+
+	static int32 SlotMaxBones = 128;
+	static FAutoConsoleVariableRef CVarSlotMaxBones(
+		TEXT("a.CRPA.OutputCache.MaxBones"),
+		SlotMaxBones,
+		TEXT("Bones a shared CRPA output can have, larger outputs aren't cached"),
+		FConsoleVariableDelegate::CreateStatic(&Rebuild));
+
+	static int32 SlotMaxCurves = 128;
+	static FAutoConsoleVariableRef CVarSlotMaxCurves(
+		TEXT("a.CRPA.OutputCache.MaxCurves"),
+		SlotMaxCurves,
+		TEXT("Curves a shared CRPA output can have, larger outputs aren't cached"),
+		FConsoleVariableDelegate::CreateStatic(&Rebuild));
+
+	// one output, its bones and curves live at the slot index in the pools below
+	struct FSlot
+	{
+		uint64 Key = 0;
+		int32 NumBones = 0;
+		int32 NumCurves = 0;
+
+		// recency list, Head is the most recently used
+		int32 Prev = INDEX_NONE;
+		int32 Next = INDEX_NONE;
+	};
+
+	// everything is allocated when the pool is built, storing recycles the least recently used slot in place
+	static FCriticalSection Lock;
+	static TArray<FSlot> Slots;
+	static TArray<FTransform> BonePool;
+	static TArray<float> CurvePool;
+	static TMap<uint64, int32> SlotsByKey;
+	static int32 NumUsedSlots = 0;
+	static int32 Head = INDEX_NONE;
+	static int32 Tail = INDEX_NONE;
+	static int32 PoolMaxBones = 0;
+	static int32 PoolMaxCurves = 0;
+	static bool bBuilt = false;
+
+	static uint64 NumHits = 0;
+	static uint64 NumMisses = 0;
+	static uint64 NumEvictions = 0;
+	static uint64 NumTooLarge = 0;
+
+	static void Unlink(int32 InSlot)
+	{
+		FSlot& Slot = Slots[InSlot];
+		(Slot.Prev != INDEX_NONE ? Slots[Slot.Prev].Next : Head) = Slot.Next;
+		(Slot.Next != INDEX_NONE ? Slots[Slot.Next].Prev : Tail) = Slot.Prev;
+		Slot.Prev = Slot.Next = INDEX_NONE;
+	}
+
+	static void LinkAtHead(int32 InSlot)
+	{
+		FSlot& Slot = Slots[InSlot];
+		Slot.Prev = INDEX_NONE;
+		Slot.Next = Head;
+		(Head != INDEX_NONE ? Slots[Head].Prev : Tail) = InSlot;
+		Head = InSlot;
+	}
+
+	// called with the lock held
+	static void BuildPool()
+	{
+		PoolMaxBones = FMath::Max(SlotMaxBones, 0);
+		PoolMaxCurves = FMath::Max(SlotMaxCurves, 0);
+		const SIZE_T SlotSize = sizeof(FSlot) + PoolMaxBones * sizeof(FTransform) + PoolMaxCurves * sizeof(float);
+		const int32 NumSlots = (int32)FMath::Min<SIZE_T>((SIZE_T)FMath::Max(BudgetKB, 0) * 1024 / SlotSize, MAX_int32 / FMath::Max(PoolMaxBones, 1));
+
+		Slots.Empty(NumSlots);
+		Slots.SetNum(NumSlots);
+		BonePool.Empty(NumSlots * PoolMaxBones);
+		BonePool.SetNumUninitialized(NumSlots * PoolMaxBones);
+		CurvePool.Empty(NumSlots * PoolMaxCurves);
+		CurvePool.SetNumUninitialized(NumSlots * PoolMaxCurves);
+		SlotsByKey.Empty(NumSlots);
+		NumUsedSlots = 0;
+		Head = Tail = INDEX_NONE;
+		bBuilt = true;
+	}
+
+	static void Rebuild(IConsoleVariable*)
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bBuilt)
+		{
+			BuildPool();
+		}
+	}
+
+	void Reserve()
+	{
+		DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+		FScopeLock ScopeLock(&Lock);
+		if (!bBuilt)
+		{
+			BuildPool();
+		}
+	}
+
+	bool Find(uint64 InKey, TArrayView<FTransform> OutBones, TArrayView<float> OutCurves)
+	{
+		DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+		FScopeLock ScopeLock(&Lock);
+		const int32* SlotIndex = SlotsByKey.Find(InKey);
+		if (SlotIndex == nullptr || Slots[*SlotIndex].NumBones != OutBones.Num() || Slots[*SlotIndex].NumCurves != OutCurves.Num())
+		{
+			++NumMisses;
+			return false;
+		}
+
+		++NumHits;
+		FMemory::Memcpy(OutBones.GetData(), &BonePool[*SlotIndex * PoolMaxBones], OutBones.Num() * sizeof(FTransform));
+		FMemory::Memcpy(OutCurves.GetData(), &CurvePool[*SlotIndex * PoolMaxCurves], OutCurves.Num() * sizeof(float));
+		Unlink(*SlotIndex);
+		LinkAtHead(*SlotIndex);
+		return true;
+	}
+
+	void Store(uint64 InKey, TArrayView<const FTransform> InBones, TArrayView<const float> InCurves)
+	{
+		DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+		FScopeLock ScopeLock(&Lock);
+		if (Slots.Num() == 0 || InBones.Num() > PoolMaxBones || InCurves.Num() > PoolMaxCurves)
+		{
+			++NumTooLarge;
+			return;
+		}
+		if (SlotsByKey.Contains(InKey))
+		{
+			// another instance stored the same output meanwhile
+			return;
+		}
+
+		int32 SlotIndex = NumUsedSlots;
+		if (NumUsedSlots < Slots.Num())
+		{
+			++NumUsedSlots;
+		}
+		else
+		{
+			SlotIndex = Tail;
+			Unlink(SlotIndex);
+			SlotsByKey.Remove(Slots[SlotIndex].Key);
+			++NumEvictions;
+		}
+
+		FSlot& Slot = Slots[SlotIndex];
+		Slot.Key = InKey;
+		Slot.NumBones = InBones.Num();
+		Slot.NumCurves = InCurves.Num();
+		FMemory::Memcpy(&BonePool[SlotIndex * PoolMaxBones], InBones.GetData(), InBones.Num() * sizeof(FTransform));
+		FMemory::Memcpy(&CurvePool[SlotIndex * PoolMaxCurves], InCurves.GetData(), InCurves.Num() * sizeof(float));
+
+		// the map was reserved for every slot, so this reuses the element the eviction freed
+		SlotsByKey.Add(InKey, SlotIndex);
+		LinkAtHead(SlotIndex);
+	}
+
+	void Reset()
+	{
+		FScopeLock ScopeLock(&Lock);
+		SlotsByKey.Reset();
+		NumUsedSlots = 0;
+		Head = Tail = INDEX_NONE;
+		NumHits = NumMisses = NumEvictions = NumTooLarge = 0;
+	}
+
+	bool CanHashValue(const FProperty* InProperty)
+	{
+		if (const FArrayProperty* ArrayProperty = CastField<FArrayProperty>(InProperty))
+		{
+			return CanHashValue(ArrayProperty->Inner);
+		}
+		if (const FStructProperty* StructProperty = CastField<FStructProperty>(InProperty))
+		{
+			for (TFieldIterator<FProperty> It(StructProperty->Struct); It; ++It)
+			{
+				if (!CanHashValue(*It))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+		return InProperty->IsA<FNumericProperty>() || InProperty->IsA<FBoolProperty>() || InProperty->IsA<FEnumProperty>() ||
+			InProperty->IsA<FNameProperty>() || InProperty->IsA<FStrProperty>();
+	}
+
+	static uint64 HashElement(const FProperty* InProperty, const uint8* InValuePtr, uint64 InSeed)
+	{
+		auto HashBytes = [](const void* Data, SIZE_T Size, uint64 Seed)
+		{
+			return CityHash64WithSeed(static_cast<const char*>(Data), Size, Seed);
+		};
+
+		if (const FBoolProperty* BoolProperty = CastField<FBoolProperty>(InProperty))
+		{
+			// bitfields share their byte with other members
+			const bool bValue = BoolProperty->GetPropertyValue(InValuePtr);
+			return HashBytes(&bValue, sizeof(bValue), InSeed);
+		}
+		if (CastField<FStrProperty>(InProperty))
+		{
+			const FString& String = *reinterpret_cast<const FString*>(InValuePtr);
+			const int32 Len = String.Len();
+			const uint64 Hash = HashBytes(&Len, sizeof(Len), InSeed);
+			return Len > 0 ? HashBytes(*String, Len * sizeof(TCHAR), Hash) : Hash;
+		}
+		if (const FArrayProperty* ArrayProperty = CastField<FArrayProperty>(InProperty))
+		{
+			FScriptArrayHelper ArrayHelper(ArrayProperty, InValuePtr);
+			const int32 Num = ArrayHelper.Num();
+			uint64 Hash = HashBytes(&Num, sizeof(Num), InSeed);
+			for (int32 Index = 0; Index < Num; ++Index)
+			{
+				Hash = HashPropertyValue(ArrayProperty->Inner, ArrayHelper.GetRawPtr(Index), Hash);
+			}
+			return Hash;
+		}
+		if (const FStructProperty* StructProperty = CastField<FStructProperty>(InProperty))
+		{
+			uint64 Hash = InSeed;
+			for (TFieldIterator<FProperty> It(StructProperty->Struct); It; ++It)
+			{
+				Hash = HashPropertyValue(*It, It->ContainerPtrToValuePtr<void>(InValuePtr), Hash);
+			}
+			return Hash;
+		}
+
+		// numbers, enums and names are their bytes
+		return HashBytes(InValuePtr, InProperty->ElementSize, InSeed);
+	}
+
+	uint64 HashPropertyValue(const FProperty* InProperty, const void* InValuePtr, uint64 InSeed)
+	{
+		uint64 Hash = InSeed;
+		for (int32 Index = 0; Index < InProperty->ArrayDim; ++Index)
+		{
+			Hash = HashElement(InProperty, static_cast<const uint8*>(InValuePtr) + Index * InProperty->ElementSize, Hash);
+		}
+		return Hash;
+	}
+
+	static FAutoConsoleCommand StatsCommand(
+		TEXT("CRPA.OutputCache.Stats"),
+		TEXT("Log the hit rate and size of the shared CRPA output cache. Args: [Reset]"),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			{
+				FScopeLock ScopeLock(&Lock);
+				const uint64 NumLookups = NumHits + NumMisses;
+				UE_LOG(LogAnimation, Display,
+				       TEXT("CRPA output cache: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions, %llu too large, %d / %d slots of %d bones %d curves"),
+				       NumHits, NumMisses, NumLookups > 0 ? 100.0 * NumHits / NumLookups : 0.0, NumEvictions, NumTooLarge,
+				       NumUsedSlots, Slots.Num(), PoolMaxBones, PoolMaxCurves);
+			}
+
+			if (Args.Num() > 0 && Args[0] == TEXT("Reset"))
+			{
+				Reset();
+			}
+		}));
+}
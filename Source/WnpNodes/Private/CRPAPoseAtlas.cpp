@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAPoseAtlas.h"
+#include "EngineLogs.h"
+#include "Tools/ControlRigPose.h"
+
+void UCRPAPoseAtlas::EvaluatePose(int32 InPoseIndex, int32 InBlendPoseIndex, float InBlend,
+                                  TArray<FTransform>& OutTransforms) const
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	const int32 NumControls = ControlNames.Num();
+	OutTransforms.SetNumUninitialized(NumControls, false);
+	if (!PoseNames.IsValidIndex(InPoseIndex))
+	{
+		return;
+	}
+
+	const int32 Offset = InPoseIndex * NumControls;
+	if (!PoseNames.IsValidIndex(InBlendPoseIndex) || InBlend <= 0.f)
+	{
+		for (int32 Control = 0; Control < NumControls; ++Control)
+		{
+			OutTransforms[Control] = FTransform(FQuat(Rotations[Offset + Control]),
+			                                    FVector(Translations[Offset + Control]),
+			                                    FVector(Scales[Offset + Control]));
+		}
+		return;
+	}
+
+	const int32 BlendOffset = InBlendPoseIndex * NumControls;
+	const float Blend = FMath::Min(InBlend, 1.f);
+	for (int32 Control = 0; Control < NumControls; ++Control)
+	{
+		const FVector3f Translation = FMath::Lerp(Translations[Offset + Control], Translations[BlendOffset + Control], Blend);
+		const FVector3f Scale = FMath::Lerp(Scales[Offset + Control], Scales[BlendOffset + Control], Blend);
+		const FQuat4f Rotation = FQuat4f::FastLerp(Rotations[Offset + Control], Rotations[BlendOffset + Control], Blend).GetNormalized();
+		OutTransforms[Control] = FTransform(FQuat(Rotation), FVector(Translation), FVector(Scale));
+	}
+}
+
+#if WITH_EDITOR
+
+void UCRPAPoseAtlas::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	const FName PropertyName = PropertyChangedEvent.GetPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UCRPAPoseAtlas, SourcePoses) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(UCRPAPoseAtlas, NeutralPose))
+	{
+		Build();
+	}
+}
+
+void UCRPAPoseAtlas::Build()
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	PoseNames.Reset();
+	ControlNames.Reset();
+	ControlTypes.Reset();
+	Translations.Reset();
+	Rotations.Reset();
+	Scales.Reset();
+
+	TArray<const UControlRigPoseAsset*> Poses;
+	for (const TSoftObjectPtr<UControlRigPoseAsset>& SourcePose : SourcePoses)
+	{
+		if (const UControlRigPoseAsset* Pose = SourcePose.LoadSynchronous())
+		{
+			Poses.Add(Pose);
+			PoseNames.Add(Pose->GetFName());
+		}
+	}
+
+	TArray<FName> SkippedControlNames;
+
+	// the control table is the union of all poses, in the order they first appear
+	for (const UControlRigPoseAsset* Pose : Poses)
+	{
+		for (const FRigControlCopy& ControlCopy : Pose->Pose.CopyOfControls)
+		{
+			// rotations are packed as quaternions, which can't keep the winding of a rotator past 180 degrees
+			if (ControlCopy.ControlType == ERigControlType::Rotator ||
+				ControlCopy.ControlType == ERigControlType::EulerTransform)
+			{
+				if (!SkippedControlNames.Contains(ControlCopy.Name))
+				{
+					SkippedControlNames.Add(ControlCopy.Name);
+					UE_LOG(LogAnimation, Warning, TEXT("%s: control %s is a rotator or euler transform, it is left out of the atlas"),
+					       *GetName(), *ControlCopy.Name.ToString());
+				}
+				continue;
+			}
+
+			if (!ControlNames.Contains(ControlCopy.Name))
+			{
+				ControlNames.Add(ControlCopy.Name);
+				ControlTypes.Add(ControlCopy.ControlType);
+			}
+		}
+	}
+
+	const UControlRigPoseAsset* Neutral = NeutralPose.LoadSynchronous();
+	auto FindControl = [](const UControlRigPoseAsset* InPose, const FName& InName) -> const FRigControlCopy*
+	{
+		const int32* Index = InPose ? InPose->Pose.CopyOfControlsNameToIndex.Find(InName) : nullptr;
+		return Index ? &InPose->Pose.CopyOfControls[*Index] : nullptr;
+	};
+
+	const int32 NumValues = Poses.Num() * ControlNames.Num();
+	Translations.Reserve(NumValues);
+	Rotations.Reserve(NumValues);
+	Scales.Reserve(NumValues);
+
+	for (const UControlRigPoseAsset* Pose : Poses)
+	{
+		for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+		{
+			FTransform Transform = FTransform::Identity;
+			const FRigControlCopy* ControlCopy = FindControl(Pose, ControlNames[Control]);
+			if (ControlCopy == nullptr)
+			{
+				ControlCopy = FindControl(Neutral, ControlNames[Control]);
+			}
+			if (ControlCopy)
+			{
+				// the node writes them back with the same axis, see FAnimNode_CRPA::ApplyPoseAtlas
+				Transform = ControlCopy->Value.GetAsTransform(ControlTypes[Control], ERigControlAxis::X);
+			}
+
+			Translations.Add(FVector3f(Transform.GetTranslation()));
+			Rotations.Add(FQuat4f(Transform.GetRotation()));
+			Scales.Add(FVector3f(Transform.GetScale3D()));
+		}
+	}
+
+	MarkPackageDirty();
+}
+
+#endif
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPARigSharing.h"
+#include "ControlRig.h"
+#include "Misc/ScopeLock.h"
+
+namespace CRPARigSharing
+{
+	struct FSharingKey
+	{
+		TObjectKey<UObject> AnimInstance;
+		FName Group;
+		TObjectKey<UClass> ControlRigClass;
+
+		bool operator==(const FSharingKey& Other) const
+		{
+			return AnimInstance == Other.AnimInstance && Group == Other.Group &&
+				ControlRigClass == Other.ControlRigClass;
+		}
+
+		friend uint32 GetTypeHash(const FSharingKey& Key)
+		{
+			return HashCombine(HashCombine(GetTypeHash(Key.AnimInstance), GetTypeHash(Key.Group)),
+			                   GetTypeHash(Key.ControlRigClass));
+		}
+	};
+
+	// nodes hold the shared rigs, the registry only finds them
+	static FCriticalSection RegistryLock;
+	static TMap<FSharingKey, TWeakPtr<FCRPASharedRig>> Registry;
+
+	TSharedPtr<FCRPASharedRig> Acquire(const UObject* InAnimInstance, const FName& InGroup,
+	                                   const UClass* InControlRigClass, TFunctionRef<UControlRig*()> InCreateRig)
+	{
+		FScopeLock Lock(&RegistryLock);
+
+		for (auto It = Registry.CreateIterator(); It; ++It)
+		{
+			if (!It.Value().IsValid())
+			{
+				It.RemoveCurrent();
+			}
+		}
+
+		const FSharingKey Key{InAnimInstance, InGroup, InControlRigClass};
+		if (TSharedPtr<FCRPASharedRig> SharedRig = Registry.FindRef(Key).Pin())
+		{
+			if (SharedRig->ControlRig.IsValid())
+			{
+				return SharedRig;
+			}
+		}
+
+		TSharedPtr<FCRPASharedRig> SharedRig = MakeShared<FCRPASharedRig>();
+		SharedRig->ControlRig = InCreateRig();
+		Registry.Add(Key, SharedRig);
+		return SharedRig;
+	}
+}
@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAScalability.h"
+#include "HAL/IConsoleManager.h"
+
+#include <atomic>
+
+namespace CRPAScalability
+{
+	static int32 Enable = 1;
+	static FAutoConsoleVariableRef CVarEnable(
+		TEXT("a.CRPA.Enable"),
+		Enable,
+		TEXT("0 turns every CRPA node off, the source pose passes through"),
+		ECVF_Scalability);
+
+	static int32 MaxLOD = INDEX_NONE;
+	static FAutoConsoleVariableRef CVarMaxLOD(
+		TEXT("a.CRPA.MaxLOD"),
+		MaxLOD,
+		TEXT("Highest LOD CRPA nodes run at, on top of their own LOD Threshold. -1 for no limit"),
+		ECVF_Scalability);
+
+	static int32 MaxEvaluationsPerFrame = 0;
+	static FAutoConsoleVariableRef CVarMaxEvaluationsPerFrame(
+		TEXT("a.CRPA.MaxEvaluationsPerFrame"),
+		MaxEvaluationsPerFrame,
+		TEXT("CRPA rig evaluations allowed per frame, nodes over it reuse their last result. 0 for no limit"),
+		ECVF_Scalability);
+
+	static int32 RateDivisor = 1;
+	static FAutoConsoleVariableRef CVarRateDivisor(
+		TEXT("a.CRPA.RateDivisor"),
+		RateDivisor,
+		TEXT("CRPA nodes run their rig every Nth frame and reuse the last result in between"),
+		ECVF_Scalability);
+
+	// not a scalability variable, profiles would turn it on for rigs with state too
+	static int32 ForceCachedOutput = 0;
+	static FAutoConsoleVariableRef CVarForceCachedOutput(
+		TEXT("a.CRPA.ForceCachedOutput"),
+		ForceCachedOutput,
+		TEXT("1 shares rig outputs between identical CRPA nodes as if they all had Share Output set. Only correct for rigs without state"),
+		ECVF_Cheat);
+
+	// the first evaluation of a new frame restarts the count, the budget is allowed to be off by the nodes racing it
+	static std::atomic<uint64> BudgetFrame(MAX_uint64);
+	static std::atomic<int32> NumEvaluations(0);
+
+	int32 GetLODThreshold(int32 InNodeLODThreshold)
+	{
+		if (Enable == 0)
+		{
+			// below INDEX_NONE, which would mean every LOD
+			return MIN_int32;
+		}
+		if (MaxLOD < 0)
+		{
+			return InNodeLODThreshold;
+		}
+		return InNodeLODThreshold == INDEX_NONE ? MaxLOD : FMath::Min(InNodeLODThreshold, MaxLOD);
+	}
+
+	bool IsEvaluationFrame(uint32 InOffset)
+	{
+		return RateDivisor <= 1 || (GFrameCounter + InOffset) % RateDivisor == 0;
+	}
+
+	bool TryConsumeEvaluation()
+	{
+		if (MaxEvaluationsPerFrame <= 0)
+		{
+			return true;
+		}
+
+		uint64 Frame = BudgetFrame.load(std::memory_order_relaxed);
+		if (Frame != GFrameCounter && BudgetFrame.compare_exchange_strong(Frame, GFrameCounter))
+		{
+			NumEvaluations.store(0, std::memory_order_relaxed);
+		}
+		return NumEvaluations.fetch_add(1, std::memory_order_relaxed) < MaxEvaluationsPerFrame;
+	}
+
+	bool IsCachedOutputForced()
+	{
+		return ForceCachedOutput != 0;
+	}
+}
@@ -1,12 +1,20 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "WnpNodes.h"
+#include "CRPAHotPath.h"
 
 #define LOCTEXT_NAMESPACE "FWnpNodesModule"
 
 void FWnpNodesModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+#if WITH_CRPA_HOT_PATH_CHECKS
+	// otherwise the tracking allocator is only installed when tracking starts
+	if (FParse::Param(FCommandLine::Get(), TEXT("CRPAHotPath")))
+	{
+		CRPAHotPath::Install();
+	}
+#endif
 }
 
 void FWnpNodesModule::ShutdownModule()
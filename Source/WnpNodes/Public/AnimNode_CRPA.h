@@ -7,8 +7,43 @@
 #include "Animation/InputScaleBias.h"
 #include "AnimNode_ControlRigBase.h"
 #include "ControlRig/Public/Tools/ControlRigPose.h"
+#include "CRPABindings.h"
+#include "CRPACapture.h"
+#include "CRPADebugStats.h"
+#include "CRPARigSharing.h"
+#include "Tasks/Task.h"
 #include "AnimNode_CRPA.generated.h"
 
+class UBlendProfile;
+class UCRPAPoseAtlas;
+class UCRPACurveControlMatrix;
+class UAnimSequence;
+
+struct FCRPABoneSetCache;
+
+/** Cheaper rig the node swaps to from a LOD on */
+USTRUCT()
+struct WNPNODES_API FCRPARigLOD
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = ControlRig)
+	TSubclassOf<UControlRig> ControlRigClass;
+
+	/** First LOD this rig runs at, it runs until an entry with a higher MinLOD takes over */
+	UPROPERTY(EditAnywhere, Category = ControlRig, meta = (ClampMin = "1"))
+	int32 MinLOD = 1;
+};
+
+// bindings resolved against one rig of the LOD chain
+struct FCRPARigLODBindings
+{
+	TArray<FCRPAResolvedBinding> ResolvedBindings;
+	TArray<int32> PoseAtlasControlIndices;
+	bool bBakedBindingsValid = false;
+	bool bPinsHashable = false;
+};
+
 USTRUCT()
 struct WNPNODES_API FAnimNode_CRPA : public FAnimNode_ControlRigBase
 {
@@ -28,16 +63,113 @@ struct WNPNODES_API FAnimNode_CRPA : public FAnimNode_ControlRigBase
 	virtual void Update_AnyThread(const FAnimationUpdateContext& Context) override;
 	virtual void CacheBones_AnyThread(const FAnimationCacheBonesContext& Context) override;
 	virtual void Evaluate_AnyThread(FPoseContext& Output) override;
-	virtual int32 GetLODThreshold() const override { return LODThreshold; }
+	virtual int32 GetLODThreshold() const override;
+	virtual bool HasPreUpdate() const override { return bSkipWhenNotRendered; }
+	virtual void PreUpdate(const UAnimInstance* InAnimInstance) override;
 	void SetIOMapping(bool bInput, const FName& SourceProperty, const FName& TargetCurve);
 	FName GetIOMapping(bool bInput, const FName& SourceProperty) const;
 
 	virtual void InitializeProperties(const UObject* InSourceInstance, UClass* InTargetClass) override;
 	virtual void PropagateInputProperties(const UObject* InSourceInstance) override;
 
+	UCRPAPoseAtlas* GetPoseAtlas() const { return PoseAtlas; }
+	const TSoftObjectPtr<UControlRigPoseAsset>& GetPoseAsset() const { return PoseAsset; }
+
+#if WITH_EDITOR
+	// resolve pins and mappings against the rig the anim BP is compiled with
+	void BakeBindings(const UControlRig* InControlRig);
+
+	// run a transient instance of the rig class and record which bones it writes
+	void BakeAffectedBones(UClass* InControlRigClass);
+#endif
+
 private:
 	
 	void HandleOnInitialized_AnyThread(URigVMHost*, const FName&);
+
+	// true when the baked tables were resolved against a rig with the same layout as InControlRig
+	bool CanUseBakedBindings(const UControlRig* InControlRig) const;
+	void ResolveBindings(const UControlRig* InControlRig);
+
+	// resolve the bindings of every rig of the LOD chain up front, so swapping rigs only copies them
+	void ResolveRigLODBindings();
+
+	// rig of the LOD chain that runs at InLODLevel
+	int32 FindRigLOD(int32 InLODLevel) const;
+
+	// make a rig of the LOD chain the one the node drives
+	void ActivateRigLOD(int32 InRigIndex);
+
+	// keep the last output of the current rig to fade from, then activate InRigIndex
+	void SwapRigLOD(int32 InRigIndex, const FBoneContainer& RequiredBones);
+
+	// fade the last output of the previous rig out of the rig result
+	void BlendRigLODPose(FPoseContext& InOutput) const;
+
+	// initialize again the rigs whose bytecode or layout changed since the last call, returns true if any did
+	bool ReinitializeChangedRigs();
+
+	// true when the baked sequence replaces the rig at the current LOD
+	bool IsBakedLOD(const FAnimInstanceProxy* InProxy) const;
+
+	// write the baked rig output of the selected atlas poses into the bones the sequence animates
+	ECRPAEvaluation SampleBakedSequence(FPoseContext& InOutput) const;
+
+	// trim the input/output transfers of the base node to the affected bones
+	void CacheAffectedBones(const FBoneContainer& RequiredBones);
+
+	// identifies the required bone set, LODs of a mesh each get their own
+	static uint32 ComputeBoneSetHash(const FBoneContainer& RequiredBones);
+
+	// calls Func(Cached, Live) for every member cache bones derives from the required bones
+	template <typename FuncType>
+	void ForEachBoneSetMember(FCRPABoneSetCache& Cache, FuncType&& Func);
+
+	// move in the cache bones results of a bone set seen before, returns false if it wasn't cached
+	bool RestoreBoneSetCache(uint32 BoneSetHash);
+	// move the results of the active bone set into its entry, before the node leaves it
+	void ParkBoneSetCache();
+	// add an entry for the active bone set, its results stay in the node until it is parked
+	void StoreBoneSetCache(uint32 BoneSetHash);
+
+	// record the inputs of this frame while a CRPA capture is running
+	void CaptureFrame(const FPoseContext& SourcePose);
+
+	// execute the rig, or only read its output when another node of the sharing group already ran it this frame
+	ECRPAEvaluation RunControlRig(FPoseContext& InOutput);
+
+	// output the rig result of the previous frame, then start the rig on this frame's inputs in a task
+	void RunControlRigAsync(FPoseContext& InOutput);
+
+	// request an inertialization when the node turned on or off since the last update
+	void RequestInertializationOnToggle(const FAnimationUpdateContext& Context);
+
+	// the rig executions queued when the mesh became visible, on copies of the source pose
+	void RunCatchUpEvaluations(const FPoseContext& InSourcePose);
+
+	// copy the output of an identical instance from CRPAOutputCache, or execute the rig and store its output
+	ECRPAEvaluation RunControlRigCached(FPoseContext& InOutput);
+
+	// hash of everything the rig reads this frame besides InPinHash, the CRPAOutputCache key with the pin hash
+	uint64 ComputeOutputCacheKey(const FPoseContext& InSourcePose, uint64 InPinHash) const;
+
+	// hash of the node settings that shape the rig output besides its inputs, mappings, curve outputs, transferred bones
+	uint64 ComputeOutputCacheConfigHash() const;
+
+	// anything touching the rig outside of the task has to wait for it first
+	void WaitForAsyncEvaluation();
+
+	// write the selected atlas pose into the controls
+	void ApplyPoseAtlas(URigHierarchy* InHierarchy);
+
+	// resolve the curves and controls of the curve matrix against the skeleton and the rig
+	void CacheCurveControlMatrix(const FSmartNameMapping* InCurveMapping, URigHierarchy* InHierarchy);
+
+	// drive the matrix controls from the curves of the input pose
+	void ApplyCurveControlMatrix(URigHierarchy* InHierarchy, const FBlendedCurve& InCurves);
+
+	// resolve ControlCurveOutputs against the skeleton and the rig
+	void CacheControlCurveOutputs(const FSmartNameMapping* InCurveMapping, const URigHierarchy* InHierarchy);
 #if WITH_EDITOR
 	virtual void HandleObjectsReinstanced_Impl(UObject* InSourceObject, UObject* InTargetObject,
 	                                           const TMap<UObject*, UObject*>& OldToNewInstanceMap) override;
@@ -48,12 +180,16 @@ private:
 	UPROPERTY(EditAnywhere, Category = ControlRig)
 	TSubclassOf<UControlRig> ControlRigClass;
 
-	/** This will be used for comparision and add only required pins*/
+	/*
+	 * This will be used for comparision and add only required pins
+	 * Pose assets are only read in the editor, their values end up in the pin defaults,
+	 * so they are soft references and never loaded with the character
+	 */
 	UPROPERTY(EditAnywhere, Category = ControlRig)
-	UControlRigPoseAsset* NeutralPoseAsset;
+	TSoftObjectPtr<UControlRigPoseAsset> NeutralPoseAsset;
 
 	UPROPERTY(EditAnywhere, Category = ControlRig)
-	UControlRigPoseAsset* PoseAsset;
+	TSoftObjectPtr<UControlRigPoseAsset> PoseAsset;
 
 	UPROPERTY(transient)
 	TObjectPtr<UControlRig> ControlRig;
@@ -86,6 +222,77 @@ private:
 	UPROPERTY(EditAnywhere, Category = Settings)
 	FInputScaleBiasClamp AlphaScaleBiasClamp;
 
+	/** Per bone weights applied on top of alpha, for example to only keep the rig result on the face */
+	UPROPERTY(EditAnywhere, Category = Settings)
+	TObjectPtr<UBlendProfile> BlendMask;
+
+	/*
+	 * Request an inertialization from the graph when the node turns on or off, by the bool input, LOD Threshold or
+	 * alpha becoming irrelevant, instead of fading over evaluated frames. The bool input then switches at once, so the
+	 * rig stops on the frame it's disabled and starts cold on the frame it's enabled. Needs an Inertialization node after this one.
+	 */
+	UPROPERTY(EditAnywhere, Category = Settings)
+	uint8 bInertializeOnToggle : 1;
+
+	UPROPERTY(EditAnywhere, Category = Settings, meta = (EditCondition = "bInertializeOnToggle", ClampMin = "0.0"))
+	float InertializationDuration;
+
+	// whether the node was on in the last update, unset until the first update after initialize
+	TOptional<bool> WasActive;
+
+	// blend mask resolved for the current required bones, indexed by compact pose index
+	TArray<float> BoneBlendWeights;
+
+	// alpha curve resolved in cache bones, read from the source pose curves
+	SmartName::UID_Type AlphaCurveUID;
+
+	// delta time of the last update, evaluate needs it for the curve alpha
+	float UpdateDeltaTime;
+
+	/** Pose library the pose pins select from, its controls are written after the pins and take precedence over them */
+	UPROPERTY(EditAnywhere, Category = PoseAtlas)
+	TObjectPtr<UCRPAPoseAtlas> PoseAtlas;
+
+	/** Atlas pose to apply, nothing is applied when invalid */
+	UPROPERTY(EditAnywhere, Category = PoseAtlas, meta = (PinHiddenByDefault))
+	int32 PoseIndex;
+
+	/** Atlas pose cross-faded in by PoseBlend */
+	UPROPERTY(EditAnywhere, Category = PoseAtlas, meta = (PinHiddenByDefault))
+	int32 BlendPoseIndex;
+
+	UPROPERTY(EditAnywhere, Category = PoseAtlas, meta = (PinHiddenByDefault, ClampMin = "0.0", ClampMax = "1.0"))
+	float PoseBlend;
+
+	// hierarchy index of every atlas control, resolved with the bindings
+	TArray<int32> PoseAtlasControlIndices;
+	TArray<FTransform> PoseAtlasTransforms;
+
+	// last selection written, to skip unchanged selections with bOnlyWriteChangedControls
+	int32 AppliedPoseIndex;
+	int32 AppliedBlendPoseIndex;
+	float AppliedPoseBlend;
+
+	/** Input curves driving control channels through a weight matrix, applied before the rig runs */
+	UPROPERTY(EditAnywhere, Category = CurveMatrix)
+	TObjectPtr<UCRPACurveControlMatrix> CurveControlMatrix;
+
+	// resolved in cache bones, MaxUID for curves the skeleton doesn't have
+	TArray<SmartName::UID_Type> MatrixInputUIDs;
+	TArray<FCRPAChannelControl> MatrixControls;
+
+	// matrix inputs padded to the matrix stride, and the channel values written last
+	TArray<float> MatrixInputs;
+	TArray<float> MatrixOutputs;
+	TArray<float> WrittenMatrixOutputs;
+
+	/** Control channels written to curves after the rig runs, for consumers such as material or morph target drivers */
+	UPROPERTY(EditAnywhere, Category = CurveOutput)
+	TArray<FCRPAControlCurveOutput> ControlCurveOutputs;
+
+	// resolved in cache bones, sorted by control so each control is read once
+	TArray<FCRPAResolvedControlCurve> ResolvedControlCurves;
+
 	// we only save mapping, 
 	// we have to query control rig when runtime 
 	// to ensure type and everything is still valid or not
@@ -99,6 +306,34 @@ private:
 	TMap<FName, FName> OutputTypes;
 	TArray<uint8*> DestParameters;
 
+	// pins (in DestPropertyNames order) and mapping targets resolved when the anim BP compiled
+	UPROPERTY()
+	TArray<FCRPABakedBinding> BakedBindings;
+
+	UPROPERTY()
+	TArray<FCRPABakedBinding> BakedMappingBindings;
+
+	// rig hash the tables above were resolved with, see CRPABindings::ComputeRigHash
+	UPROPERTY()
+	uint32 BakedRigHash;
+
+	// pin bindings used every frame, one per source property
+	TArray<FCRPAResolvedBinding> ResolvedBindings;
+
+	// changes whenever ResolvedBindings are resolved again or swapped for another rig
+	uint32 ResolvedBindingsSerial;
+
+	// the control pins of ResolvedBindings, filtered to the changed ones with bOnlyWriteChangedControls
+	FCRPAChangedControlWriter ChangedControlWriter;
+
+	// input/output mappings between float variables and curves, resolved in cache bones
+	// so update/evaluate neither look up names nor copy external variables
+	TArray<FCRPACurveBinding> InputCurveBindings;
+	TArray<FCRPACurveBinding> OutputCurveBindings;
+
+	// set by ResolveBindings, so cache bones doesn't have to hash the rig again
+	bool bBakedBindingsValid;
+
 	/*
 	 * Max LOD that this node is allowed to run
 	 * For example if you have LODThreadhold to be 2, it will run until LOD 2 (based on 0 index)
@@ -108,11 +343,167 @@ private:
 	UPROPERTY(EditAnywhere, Category = Performance, meta = (DisplayName = "LOD Threshold"))
 	int32 LODThreshold;
 
+	/*
+	 * Progressively cheaper rigs for distant characters, for example reduced face then jaw and eyes only
+	 * The node ControlRigClass runs below the lowest MinLOD. Every rig is created with the node and its pins are
+	 * resolved up front, pins a rig doesn't have are skipped. The affected bones are the ones of the node rig,
+	 * so cheaper rigs should only write a subset of them. Ignored when the rig is shared.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (DisplayName = "Rig LODs"))
+	TArray<FCRPARigLOD> RigLODs;
+
+	/** Time the output of the previous rig fades out over when the LOD swaps rigs */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (DisplayName = "Rig LOD Blend Time", ClampMin = "0.0"))
+	float RigLODBlendTime;
+
+	// the node rig, then one per RigLODs entry
+	UPROPERTY(transient)
+	TArray<TObjectPtr<UControlRig>> LODControlRigs;
+
+	TArray<FCRPARigLODBindings> LODRigBindings;
+	int32 ActiveRigIndex;
+
+	// last output of the previous rig by compact pose index, and how much longer it fades
+	TArray<TPair<int32, FTransform>> RigLODBlendPose;
+	float RigLODBlendRemaining;
+
+	// CRPABindings::ComputeRigCompileHash of every rig the node runs, when it was last initialized
+	TArray<uint32> RigCompileHashes;
+
+	/*
+	 * Rig output baked offline, see CRPABake. Sampled instead of running the rig from BakedLOD on,
+	 * frame N holds the rig output for atlas pose N, or the pose asset when there is no atlas.
+	 * The bake ran on the ref pose, so only how it differs from the ref pose is added on top of the source pose, for the
+	 * bones the sequence has tracks for. The source animation carries through, but the rig doesn't react to it.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	TObjectPtr<UAnimSequence> BakedSequence;
+
+	/** First LOD the baked sequence replaces the rig at, INDEX_NONE to always run the rig. LOD Threshold still applies. */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (DisplayName = "Baked LOD"))
+	int32 BakedLOD;
+
+	// compact pose indices of the bones the baked sequence has tracks for, resolved in cache bones
+	TArray<int32> BakedBoneIndices;
+
+	/*
+	 * Only transfer and blend the bones the rig writes (and their parents)
+	 * The bones are found when the anim BP compiles, all other bones pass through untouched
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	uint8 bRestrictToAffectedBones : 1;
+
+	/** Bones written by the rig that the compile time probe can't find, for example bones only moved by some input poses */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (EditCondition = "bRestrictToAffectedBones"))
+	TArray<FBoneReference> AdditionalAffectedBones;
+
+	UPROPERTY()
+	TArray<FName> BakedAffectedBones;
+
+	// compact pose indices of the affected bones and their parents, sorted parent first
+	TArray<int32> AffectedBoneIndices;
+
+	/*
+	 * Only set the controls whose pin value changed since the last update
+	 * Leave off if the rig sets its own input controls, they would keep the value the rig gave them
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	uint8 bOnlyWriteChangedControls : 1;
+
+	/*
+	 * CRPA nodes of the same anim instance with the same rig class and group share one rig instance
+	 * Each node writes its pins, the rig runs once per frame and every node fed the same source pose, curves and
+	 * settings reads the result. A node fed something else runs the rig again on its own inputs.
+	 * Meant for nodes driving different controls of the same rig on the same pose. Pins, and the pose atlas, are all
+	 * written in the rig before it runs, so a control or variable bound by two nodes of the group gets the value of
+	 * the node updated last for both. Such pins are reported when the nodes initialize.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	FName RigSharingGroup;
+
+	TSharedPtr<FCRPASharedRig> SharedRig;
+
+	/*
+	 * Run the rig in a task that overlaps the rest of the frame and output its result on the next evaluation
+	 * Meant for background characters. The first frame, or the first after the node was skipped by its LOD, alpha or
+	 * rendering, runs in place. The scalability limits apply before a task is launched. Ignored when the rig is shared.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	uint8 bEvaluateAsync : 1;
+
+	UE::Tasks::FTask AsyncEvaluationTask;
+
+	/*
+	 * Share rig outputs between instances with the same rig, mesh, LOD, settings, assets, pin values, input curves and source pose
+	 * For crowds of identical characters, see CRPAOutputCache. Only for rigs whose output depends on nothing
+	 * but those inputs, no simulation or time, and only bones and mapped curves are shared, not rig curves.
+	 * CRPAVerify -File checks a rig gives the same output in another instance. Ignored when shared or async.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	uint8 bShareOutput : 1;
+
+	// pin values of the last update, hashed while the output cache is used, and that update's frame
+	uint64 PinInputHash;
+	uint64 PinInputHashFrame;
+
+	// every resolved pin can be hashed by content, see CRPAOutputCache::CanHashValue, the cache is off otherwise
+	bool bPinsHashable;
+
+	// ComputeBoneSetHash of the current required bones
+	uint32 ActiveBoneSetHash;
+
+	// ComputeOutputCacheConfigHash for the current bone set, updated in cache bones
+	uint64 OutputCacheConfigHash;
+
+	// what the cache stores, the bones the rig writes by compact pose index and the curves it outputs
+	TArray<int32> OutputBoneIndices;
+	TArray<SmartName::UID_Type> OutputCurveUIDs;
+
+	// scratch for cache copies, sized once per bone set
+	TArray<FTransform> OutputCacheBones;
+	TArray<float> OutputCacheCurves;
+
+	/*
+	 * Don't run the rig while the mesh hasn't been rendered for NotRenderedTime, the bones it writes keep its last result
+	 * so the first frame back in view doesn't show the source pose. The source pose passes through if the rig hasn't run
+	 * yet or is shared. For characters close enough to stay under LOD Threshold but off screen. Leave off if gameplay
+	 * reads the bones the rig writes, and ignored on dedicated servers.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	uint8 bSkipWhenNotRendered : 1;
+
+	/** Seconds since the mesh was last rendered before the rig stops running */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (EditCondition = "bSkipWhenNotRendered", ClampMin = "0.0"))
+	float NotRenderedTime;
+
+	/** Extra rig executions on this frame's inputs when the mesh is rendered again or the node turns back on, so rigs with state settle before they're seen */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (EditCondition = "bSkipWhenNotRendered || bInertializeOnToggle", ClampMin = "0"))
+	int32 CatchUpEvaluations;
+
+	// written in PreUpdate on the game thread
+	bool bRecentlyRendered;
+	int32 PendingCatchUpEvaluations;
+
+	// frame the rig last executed or launched its async task for this node, its hierarchy holds that result
+	uint64 RigResultFrame;
+
+	// cache bones results per required bone set, most recent last
+	TArray<TSharedPtr<FCRPABoneSetCache>> BoneSetCaches;
+
+	// filled while showdebug animation shows the node
+	FCRPADebugStats DebugStats;
+
+	// open while a capture session is running, see CRPACapture
+	TSharedPtr<FCRPACaptureWriter> CaptureWriter;
+	int32 CaptureSession;
+
 protected:
 	virtual UClass* GetTargetClass() const override { return *ControlRigClass; }
 	virtual void UpdateInput(UControlRig* InControlRig, const FPoseContext& InOutput) override;
 	virtual void UpdateOutput(UControlRig* InControlRig, FPoseContext& InOutput) override;
 
+	bool IsRestrictedToAffectedBones() const { return bRestrictToAffectedBones && AffectedBoneIndices.Num() > 0; }
+
 	// Helper function to update the initial ref pose within the Control Rig if needed
 	void UpdateControlRigRefPoseIfNeeded(const FAnimInstanceProxy* InProxy, bool bIncludePoseInHash = false);
 
@@ -123,6 +514,9 @@ public:
 	void PostSerialize(const FArchive& Ar);
 
 	friend class UAnimGraphNode_CRPA;
+	friend class UCRPACostReportCommandlet;
+	friend struct FCRPABoneSetCache;
+	friend class FCRPANodeHarness;
 };
 
 template <>
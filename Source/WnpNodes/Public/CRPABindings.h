@@ -0,0 +1,221 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Rigs/RigHierarchyDefines.h"
+#include "Animation/SmartName.h"
+#include "EulerTransform.h"
+#include "CRPABindings.generated.h"
+
+class UControlRig;
+class URigHierarchy;
+struct FRigControlValue;
+struct FRigVMExternalVariable;
+
+/** How a pin is written into the target rig */
+UENUM()
+enum class ECRPABindingType : uint8
+{
+	None,
+	Control,
+	Bool,
+	Float,
+	Double,
+	Int32,
+	Name,
+	String,
+	Struct,
+	Array,
+};
+
+/**
+ * One component of a control value, as seen through its euler transform
+ * Float, integer and bool controls use TranslationX, 2D controls TranslationX and TranslationY
+ */
+UENUM()
+enum class ECRPAControlChannel : uint8
+{
+	TranslationX,
+	TranslationY,
+	TranslationZ,
+	RotationPitch,
+	RotationYaw,
+	RotationRoll,
+	ScaleX,
+	ScaleY,
+	ScaleZ,
+};
+
+/**
+ * Binding resolved while compiling the anim BP
+ * It is only trusted at runtime when the rig hash still matches the one it was baked against
+ */
+USTRUCT()
+struct WNPNODES_API FCRPABakedBinding
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FName Name = NAME_None;
+
+	/** Index of the control in the rig hierarchy, if this binds to a control */
+	UPROPERTY()
+	int32 ControlIndex = INDEX_NONE;
+
+	/** Offset of the public variable inside the rig instance, if this binds to a variable */
+	UPROPERTY()
+	int32 VariableOffset = INDEX_NONE;
+
+	UPROPERTY()
+	ECRPABindingType Type = ECRPABindingType::None;
+
+	UPROPERTY()
+	ERigControlType ControlType = ERigControlType::Bool;
+};
+
+/** Runtime form of a pin binding, no name lookup is required to use it */
+struct WNPNODES_API FCRPAResolvedBinding
+{
+	FName Name = NAME_None;
+	FProperty* SourceProperty = nullptr;
+	int32 ControlIndex = INDEX_NONE;
+	int32 VariableOffset = INDEX_NONE;
+	ECRPABindingType Type = ECRPABindingType::None;
+	ERigControlType ControlType = ERigControlType::Bool;
+};
+
+/** Float rig variable mapped to a curve, resolved in cache bones */
+struct WNPNODES_API FCRPACurveBinding
+{
+	FName VariableName = NAME_None;
+	SmartName::UID_Type CurveUID = SmartName::MaxUID;
+	int32 VariableOffset = INDEX_NONE;
+
+	/** The variable is stored as a double, rig float variables can be */
+	bool bDouble = false;
+};
+
+/** Control channel published as an anim curve */
+USTRUCT()
+struct WNPNODES_API FCRPAControlCurveOutput
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Output")
+	FName Control = NAME_None;
+
+	UPROPERTY(EditAnywhere, Category = "Output")
+	ECRPAControlChannel Channel = ECRPAControlChannel::TranslationX;
+
+	UPROPERTY(EditAnywhere, Category = "Output")
+	FName Curve = NAME_None;
+};
+
+/** FCRPAControlCurveOutput resolved in cache bones */
+struct WNPNODES_API FCRPAResolvedControlCurve
+{
+	int32 ControlIndex = INDEX_NONE;
+	ERigControlType ControlType = ERigControlType::Float;
+	ERigControlAxis PrimaryAxis = ERigControlAxis::X;
+	ECRPAControlChannel Channel = ECRPAControlChannel::TranslationX;
+	SmartName::UID_Type CurveUID = SmartName::MaxUID;
+};
+
+/** Control driven channel by channel, its channels are contiguous in the channel buffer that drives it */
+struct WNPNODES_API FCRPAChannelControl
+{
+	int32 ControlIndex = INDEX_NONE;
+	ERigControlType ControlType = ERigControlType::Float;
+	ERigControlAxis PrimaryAxis = ERigControlAxis::X;
+
+	/** Initial value of the control, channels are offsets from it */
+	FEulerTransform InitialValue = FEulerTransform::Identity;
+
+	int32 FirstChannel = 0;
+	int32 NumChannels = 0;
+};
+
+/**
+ * Writes control pins into the hierarchy, optionally only the ones whose value changed since the last write
+ * Filtering keeps a copy of the last written values to compare with, without it the pins are written as they are
+ */
+struct WNPNODES_API FCRPAChangedControlWriter
+{
+	/**
+	 * Collect the control bindings, the next write sends every control
+	 * InAtlasControlIndices are the controls the pose atlas sets after the pins, see WroteAtlasControls
+	 */
+	void Reset(TArrayView<const FCRPAResolvedBinding> InBindings, TArrayView<const int32> InAtlasControlIndices);
+
+	/** The next write sends every control, for example after the rig was initialized again */
+	void Invalidate() { bHasWritten = false; }
+
+	/** Write the pins of InSourceInstance, every pin unless bOnlyChanged, returns the number of controls set */
+	int32 Write(const UObject* InSourceInstance, URigHierarchy* InHierarchy, bool bOnlyChanged);
+
+	int32 Num() const { return ControlIndices.Num(); }
+
+	/** Whether the last write set a control the pose atlas sets too, the atlas has to be applied again over it */
+	bool WroteAtlasControls() const { return bWroteAtlasControls; }
+
+private:
+	TArray<const FProperty*> SourceProperties;
+	TArray<int32> ControlIndices;
+	TArray<ERigControlType> ControlTypes;
+	TBitArray<> AtlasControls;
+
+	// offset of each control in Values, plus the total size
+	TArray<int32> ValueOffsets;
+
+	// last written pin values, one aligned slot per control, only kept up to date by filtered writes
+	TArray<uint8, TAlignedHeapAllocator<16>> Values;
+
+	// scratch list of the controls to set this write
+	TArray<int32> ChangedControls;
+
+	// Values holds the last write
+	bool bHasWritten = false;
+	bool bWroteAtlasControls = false;
+};
+
+namespace CRPABindings
+{
+	/**
+	 * Hash of everything a baked binding depends on - control names, indices and types
+	 * and the layout of the rig class properties. It doesn't do any name lookup.
+	 * It is saved with the anim BP, so it is the same in every process for the same rig.
+	 */
+	WNPNODES_API uint32 ComputeRigHash(const UControlRig* InControlRig);
+	WNPNODES_API uint32 ComputeRigHash(const URigHierarchy* InHierarchy, const UClass* InControlRigClass);
+
+	/** ComputeRigHash combined with the hash of the rig bytecode, changes whenever a compile changed what the rig runs */
+	WNPNODES_API uint32 ComputeRigCompileHash(const UControlRig* InControlRig);
+
+	/** Resolve a binding by name against the rig. Returns false if nothing named InName can be written. */
+	WNPNODES_API bool ResolveByName(const UControlRig* InControlRig, const FName& InName, FCRPABakedBinding& OutBinding);
+
+	/**
+	 * Validate the source property against a binding type once, so per frame copies don't need to cast fields
+	 * Returns false if the source property can't be written into the binding
+	 */
+	WNPNODES_API bool IsCompatible(const FProperty* InSourceProperty, const FCRPABakedBinding& InBinding,
+	                               const UControlRig* InControlRig);
+
+	/** Whether a rig variable can be mapped to a curve, float and double variables can */
+	WNPNODES_API bool IsCurveVariable(const FRigVMExternalVariable& InVariable);
+
+	/** Rig property a variable binding writes to, found by offset */
+	WNPNODES_API const FProperty* FindVariableProperty(const UControlRig* InControlRig, int32 InOffset);
+
+	/** Control value for a pin of the binding's control type. Returns false for types that can't be set. */
+	WNPNODES_API bool MakeControlValue(ERigControlType InControlType, const uint8* InSrcPtr, FRigControlValue& OutValue);
+
+	/** Channel of a control transform, in degrees for rotations */
+	WNPNODES_API double GetChannel(const FEulerTransform& InTransform, ECRPAControlChannel InChannel);
+	WNPNODES_API void SetChannel(FEulerTransform& InOutTransform, ECRPAControlChannel InChannel, double InValue);
+
+	/** Copy the source value into the rig */
+	WNPNODES_API void Apply(const FCRPAResolvedBinding& InBinding, const uint8* InSrcPtr, UControlRig* InControlRig,
+	                        URigHierarchy* InHierarchy);
+}
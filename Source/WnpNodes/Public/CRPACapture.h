@@ -0,0 +1,143 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CRPABindings.h"
+
+class FArchive;
+class UControlRig;
+class URigHierarchy;
+
+/**
+ * Capture of the inputs a CRPA node fed into its rig, one file per node instance
+ *
+ * The file is a header followed by a stream of records. Bone, pin, binding and curve name records are only
+ * written when they change, frame records refer to the last ones written. Pins are stored twice: as the anim
+ * instance holds them, to replay the node, and as the rig sees them, to replay the rig alone.
+ * Use CRPA.Capture.Start [Directory] / CRPA.Capture.Stop, and replay with -run=CRPAReplay -File=<file>
+ */
+namespace CRPACapture
+{
+	/** true while a capture session is running, cheap enough to test every frame */
+	WNPNODES_API bool IsCapturing();
+
+	/** Increases every time a capture starts, nodes use it to know they have to open a new file */
+	WNPNODES_API int32 GetSession();
+
+	/** File for a new node instance in the current session */
+	WNPNODES_API FString MakeFilename(const FString& InOwnerName);
+
+	/** Pin values as the rig sees them - control values or rig variable memory */
+	WNPNODES_API void SerializePinValues(FArchive& Ar, TArrayView<const FCRPAResolvedBinding> InBindings,
+	                                     TArrayView<const FProperty* const> InVariableProperties,
+	                                     UControlRig* InControlRig, URigHierarchy* InHierarchy);
+
+	/** Pin values as the node reads them, properties of the anim instance. Null properties are skipped. */
+	WNPNODES_API void SerializeSourcePinValues(FArchive& Ar, TArrayView<const FProperty* const> InSourceProperties,
+	                                           UObject* InSourceInstance);
+}
+
+struct WNPNODES_API FCRPACaptureFrame
+{
+	float DeltaTime = 0.f;
+	float Alpha = 0.f;
+
+	/** local space source pose, in the order of the last bone record */
+	TArray<FTransform3f> SourcePose;
+
+	/** values of the input mapped curves, in the order of the last curve record */
+	TArray<float> InputCurves;
+
+	/** pin values, see CRPACapture::SerializePinValues */
+	TArray<uint8> PinData;
+
+	/** pin values in the order of the last pin record, see CRPACapture::SerializeSourcePinValues */
+	TArray<uint8> SourcePinData;
+};
+
+/** What a capture was made with, written once at the start of the file */
+struct WNPNODES_API FCRPACaptureHeader
+{
+	FString ControlRigClassPath;
+
+	/** class of the anim instance the node belongs to, and the node property in it */
+	FString AnimClassPath;
+	FName NodePropertyName = NAME_None;
+
+	FString SkeletonPath;
+};
+
+class WNPNODES_API FCRPACaptureWriter
+{
+public:
+	static TSharedPtr<FCRPACaptureWriter> Create(const FString& InFilename, const FCRPACaptureHeader& InHeader);
+	~FCRPACaptureWriter();
+
+	/** Bones of the pose, for the LOD level they were required at */
+	void WriteBoneNames(TArrayView<const FName> InBoneNames, int32 InLODLevel);
+
+	/** Anim instance properties the node reads its pins from */
+	void WritePinNames(TArrayView<FProperty* const> InSourceProperties);
+
+	/** Pins as resolved against the rig that runs, written again whenever they change, a rig LOD swap for example */
+	void WriteBindings(const UControlRig* InControlRig, TArrayView<const FCRPAResolvedBinding> InBindings);
+	void WriteInputCurveNames(TArrayView<const FName> InVariableNames);
+
+	void WriteFrame(float InDeltaTime, float InAlpha, TArrayView<const FTransform> InSourcePose,
+	                TArrayView<const float> InInputCurves, UObject* InSourceInstance,
+	                TArrayView<const FCRPAResolvedBinding> InBindings, UControlRig* InControlRig,
+	                URigHierarchy* InHierarchy);
+
+	/** Serial number of the bone container the last bone record was written for */
+	uint16 BoneContainerSerial = 0;
+
+	/** Serial number of the node bindings the last binding record was written for */
+	uint32 BindingsSerial = MAX_uint32;
+
+private:
+	FCRPACaptureWriter() = default;
+
+	TUniquePtr<FArchive> FileArchive;
+	TUniquePtr<FArchive> Archive;
+
+	// rig properties of the variable bindings, resolved when the bindings are written
+	TArray<const FProperty*> VariableProperties;
+
+	// anim instance properties of the last pin record
+	TArray<const FProperty*> SourceProperties;
+
+	// scratch buffers reused between frames
+	TArray<FTransform3f> PoseBuffer;
+	TArray<uint8> PinBuffer;
+};
+
+class WNPNODES_API FCRPACaptureReader
+{
+public:
+	static TSharedPtr<FCRPACaptureReader> Open(const FString& InFilename);
+	~FCRPACaptureReader();
+
+	/** Read up to the next frame. Name records found on the way update the arrays below and their flags. */
+	bool ReadFrame(FCRPACaptureFrame& OutFrame);
+
+	/** The rig class is updated by binding records, rig LODs can run another class */
+	FCRPACaptureHeader Header;
+
+	TArray<FName> BoneNames;
+	int32 LODLevel = 0;
+	TArray<FName> PinNames;
+	TArray<FName> BindingNames;
+	TArray<FName> InputCurveVariableNames;
+
+	bool bBoneNamesChanged = false;
+	bool bPinNamesChanged = false;
+	bool bBindingsChanged = false;
+	bool bInputCurvesChanged = false;
+
+private:
+	FCRPACaptureReader() = default;
+
+	TUniquePtr<FArchive> FileArchive;
+	TUniquePtr<FArchive> Archive;
+};
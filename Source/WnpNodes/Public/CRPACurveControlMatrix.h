@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "CRPABindings.h"
+#include "CRPACurveControlMatrix.generated.h"
+
+/** Weight of an input curve on a control channel */
+USTRUCT()
+struct WNPNODES_API FCRPACurveControlWeight
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, Category = "Weight")
+	FName Curve = NAME_None;
+
+	UPROPERTY(EditAnywhere, Category = "Weight")
+	FName Control = NAME_None;
+
+	UPROPERTY(EditAnywhere, Category = "Weight")
+	ECRPAControlChannel Channel = ECRPAControlChannel::TranslationX;
+
+	UPROPERTY(EditAnywhere, Category = "Weight")
+	float Weight = 1.f;
+};
+
+/**
+ * Linear map from input curves to control channels, for example tracking curves driving a face rig
+ * Every channel is the initial value of its control plus the weighted sum of the curves.
+ * The weights are packed in the editor, dense when most of them are used and compressed rows otherwise,
+ * and channels of the same control are kept next to each other.
+ */
+UCLASS(BlueprintType)
+class WNPNODES_API UCRPACurveControlMatrix : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	const TArray<FName>& GetInputCurves() const { return InputCurves; }
+	const TArray<FName>& GetChannelControls() const { return ChannelControls; }
+	const TArray<ECRPAControlChannel>& GetChannels() const { return Channels; }
+
+	int32 GetNumInputs() const { return InputCurves.Num(); }
+	int32 GetNumChannels() const { return Channels.Num(); }
+
+	/** Size of the input buffer Multiply reads, the inputs padded to a whole number of vector registers */
+	int32 GetInputStride() const { return InputStride; }
+
+	/** Outputs = Weights * Inputs. Inputs has GetInputStride entries with the padding zeroed, Outputs one per channel. */
+	void Multiply(const float* RESTRICT Inputs, float* RESTRICT Outputs) const;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+
+	/** Pack the weights */
+	void Build();
+#endif
+
+#if WITH_EDITORONLY_DATA
+	UPROPERTY(EditAnywhere, Category = "Weights")
+	TArray<FCRPACurveControlWeight> Weights;
+#endif
+
+private:
+	UPROPERTY(VisibleAnywhere, Category = "Matrix")
+	TArray<FName> InputCurves;
+
+	UPROPERTY(VisibleAnywhere, Category = "Matrix")
+	TArray<FName> ChannelControls;
+
+	UPROPERTY()
+	TArray<ECRPAControlChannel> Channels;
+
+	UPROPERTY(VisibleAnywhere, Category = "Matrix")
+	bool bDense = true;
+
+	UPROPERTY()
+	int32 InputStride = 0;
+
+	// NumChannels * InputStride, row major
+	UPROPERTY()
+	TArray<float> DenseWeights;
+
+	// compressed rows, RowStarts has NumChannels + 1 entries
+	UPROPERTY()
+	TArray<int32> RowStarts;
+
+	UPROPERTY()
+	TArray<int32> Columns;
+
+	UPROPERTY()
+	TArray<float> SparseWeights;
+};
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** What a CRPA node did with its rig in an evaluation */
+enum class ECRPAEvaluation : uint8
+{
+	None,
+	Executed,
+	// another node of the sharing group ran the rig, only its output was read
+	SharedOutput,
+	// the result of the previous frame was output, the rig runs in a task
+	Async,
+	// the baked sequence was sampled instead
+	Baked,
+	// another instance with the same inputs ran the rig, see CRPAOutputCache
+	Cached,
+	// the last result was output again, see CRPAScalability
+	ReducedRate,
+	SkippedBudget,
+	SkippedLOD,
+	SkippedAlpha,
+	SkippedNotRendered,
+};
+
+/**
+ * Rolling per node counters shown by showdebug animation
+ * Nothing is recorded unless the overlay gathered the node in the last few frames,
+ * so with the overlay off a node only pays a frame number compare per evaluation.
+ */
+struct WNPNODES_API FCRPADebugStats
+{
+	static constexpr int32 HistorySize = 32;
+
+	// recording goes on for this many frames after the overlay last gathered the node
+	static constexpr uint64 RecordFrames = 4;
+
+	bool IsRecording() const { return LastGatherFrame != MAX_uint64 && GFrameCounter <= LastGatherFrame + RecordFrames; }
+	void MarkGathered() { LastGatherFrame = GFrameCounter; }
+
+	void Record(ECRPAEvaluation InEvaluation, float InMilliseconds);
+
+	/** Last evaluation, the average and max cost over the history, and how often the rig ran in it */
+	FString ToString() const;
+
+	static const TCHAR* LexToString(ECRPAEvaluation InEvaluation);
+
+private:
+	uint64 LastGatherFrame = MAX_uint64;
+
+	float Milliseconds[HistorySize] = {};
+	ECRPAEvaluation Evaluations[HistorySize] = {};
+	int32 NumRecorded = 0;
+	int32 Head = 0;
+};
+
+/** Times its scope into the stats when they are recording, the evaluation kind is set by the caller */
+struct FCRPADebugStatsScope
+{
+	explicit FCRPADebugStatsScope(FCRPADebugStats& InStats)
+		: Stats(InStats.IsRecording() ? &InStats : nullptr)
+		  , StartCycles(Stats ? FPlatformTime::Cycles64() : 0)
+	{
+	}
+
+	~FCRPADebugStatsScope()
+	{
+		if (Stats)
+		{
+			Stats->Record(Evaluation, (float)FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles));
+		}
+	}
+
+	ECRPAEvaluation Evaluation = ECRPAEvaluation::None;
+
+private:
+	FCRPADebugStats* Stats;
+	uint64 StartCycles;
+};
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#define WITH_CRPA_HOT_PATH_CHECKS !UE_BUILD_SHIPPING
+
+/**
+ * Allocation checks for the CRPA update and evaluate scopes
+ *
+ * While tracking, every heap allocation made by a thread inside a hot path scope is counted and its call stack kept.
+ * Names aren't checked, the name table can't tell which thread added a name.
+ * The tracking allocator wraps GMalloc the first time tracking starts, or when the module starts with -CRPAHotPath
+ * to also see what allocates before that. Once installed it stays and only forwards while not tracking.
+ * In game: CRPA.HotPath.Start / CRPA.HotPath.Stop, headless: -run=CRPAReplay -File=<capture> -DetectAllocations,
+ * automation: the CRPA.Node.HotPath test
+ */
+namespace CRPAHotPath
+{
+#if WITH_CRPA_HOT_PATH_CHECKS
+	/** Marks the calling thread as running CRPA hot path code */
+	struct WNPNODES_API FScope
+	{
+		FScope();
+		~FScope();
+	};
+
+	/** Wraps GMalloc with the tracking allocator, does nothing if it already is */
+	WNPNODES_API void Install();
+
+	/** Starts counting, installs the tracking allocator first if needed */
+	WNPNODES_API void StartTracking();
+
+	/** Stops counting and logs what was found. Returns the number of allocations. */
+	WNPNODES_API int32 StopTracking();
+#endif
+}
+
+#if WITH_CRPA_HOT_PATH_CHECKS
+#define CRPA_HOT_PATH_SCOPE() CRPAHotPath::FScope PREPROCESSOR_JOIN(CRPAHotPathScope, __LINE__);
+#else
+#define CRPA_HOT_PATH_SCOPE()
+#endif
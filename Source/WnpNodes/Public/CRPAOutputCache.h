@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Rig outputs shared between CRPA node instances, see FAnimNode_CRPA::bShareOutput
+ * Entries are keyed by a hash of everything the rig reads - rig class, mesh and bone set, pin values, input curves
+ * and the source pose - so identical characters in a crowd run the rig once and the others copy the result.
+ * Outputs live in a pool of fixed size slots allocated up front from a.CRPA.OutputCache.BudgetKB, MaxBones and MaxCurves,
+ * a store recycles the least recently used slot in place so nothing is allocated per frame. CRPA.OutputCache.Stats logs the hit rate.
+ */
+namespace CRPAOutputCache
+{
+	/** Allocate the pool if it wasn't yet, called when a node that uses the cache is initialized. Until then nothing is cached. */
+	WNPNODES_API void Reserve();
+
+	/** Copy the output stored for InKey into the views, false on a miss or if the sizes don't match. Thread safe. */
+	WNPNODES_API bool Find(uint64 InKey, TArrayView<FTransform> OutBones, TArrayView<float> OutCurves);
+
+	/** Store the output of an evaluation. Thread safe. */
+	WNPNODES_API void Store(uint64 InKey, TArrayView<const FTransform> InBones, TArrayView<const float> InCurves);
+
+	WNPNODES_API void Reset();
+
+	/** Whether HashPropertyValue can hash values of InProperty by content. Objects, texts, sets and maps can't be. */
+	WNPNODES_API bool CanHashValue(const FProperty* InProperty);
+
+	/** Hash of the value of InProperty at InValuePtr, strings, arrays and structs by their contents */
+	WNPNODES_API uint64 HashPropertyValue(const FProperty* InProperty, const void* InValuePtr, uint64 InSeed);
+}
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "Rigs/RigHierarchyDefines.h"
+#include "CRPAPoseAtlas.generated.h"
+
+class UControlRigPoseAsset;
+
+/**
+ * Many control rig poses packed into one asset
+ * Every pose has a value for every control of the shared control table, stored as translation, rotation and scale
+ * arrays laid out pose after pose, so picking or cross-fading poses is a linear walk over the controls.
+ * The packed data is rebuilt in the editor whenever the source poses change, the source assets are never loaded at runtime.
+ * Rotator and euler transform controls are left out, their winding past 180 degrees doesn't survive the quaternions.
+ */
+UCLASS(BlueprintType)
+class WNPNODES_API UCRPAPoseAtlas : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	int32 GetNumPoses() const { return PoseNames.Num(); }
+	int32 GetNumControls() const { return ControlNames.Num(); }
+
+	const TArray<FName>& GetControlNames() const { return ControlNames; }
+	const TArray<ERigControlType>& GetControlTypes() const { return ControlTypes; }
+
+	/** Index of the pose made from the pose asset InPoseName, resolve it once and drive the node with the index */
+	UFUNCTION(BlueprintPure, Category = "CRPA")
+	int32 FindPoseIndex(FName InPoseName) const { return PoseNames.IndexOfByKey(InPoseName); }
+
+	/**
+	 * Local control transforms of InPoseIndex, blended towards InBlendPoseIndex by InBlend
+	 * InBlendPoseIndex can be INDEX_NONE to only read the first pose. OutTransforms has one entry per control.
+	 */
+	void EvaluatePose(int32 InPoseIndex, int32 InBlendPoseIndex, float InBlend, TArray<FTransform>& OutTransforms) const;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+
+	/** Pack the source poses */
+	void Build();
+#endif
+
+#if WITH_EDITORONLY_DATA
+	/** Poses to pack, each pose is named after its asset */
+	UPROPERTY(EditAnywhere, Category = "Poses")
+	TArray<TSoftObjectPtr<UControlRigPoseAsset>> SourcePoses;
+
+	/** Values for the controls a source pose doesn't contain, identity is used without it */
+	UPROPERTY(EditAnywhere, Category = "Poses")
+	TSoftObjectPtr<UControlRigPoseAsset> NeutralPose;
+#endif
+
+private:
+	UPROPERTY(VisibleAnywhere, Category = "Atlas")
+	TArray<FName> PoseNames;
+
+	UPROPERTY(VisibleAnywhere, Category = "Atlas")
+	TArray<FName> ControlNames;
+
+	UPROPERTY()
+	TArray<ERigControlType> ControlTypes;
+
+	// NumPoses * NumControls entries each, pose major
+	UPROPERTY()
+	TArray<FVector3f> Translations;
+
+	UPROPERTY()
+	TArray<FQuat4f> Rotations;
+
+	UPROPERTY()
+	TArray<FVector3f> Scales;
+};
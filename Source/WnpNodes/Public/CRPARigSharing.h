@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UControlRig;
+
+/** Rig instance shared by the CRPA nodes of one anim instance that use the same sharing group */
+struct WNPNODES_API FCRPASharedRig
+{
+	TWeakObjectPtr<UControlRig> ControlRig;
+
+	/** Frame the rig last executed in, the first relevant node of a frame executes it, the others read its output */
+	uint64 LastExecutedFrame = MAX_uint64;
+
+	/** Inputs of that execution besides the pins, nodes with other inputs execute the rig again */
+	uint64 LastInputKey = 0;
+
+	/** Node that first bound each pin name, to report pins bound by more than one node of the group */
+	TMap<FName, const void*> PinOwners;
+};
+
+namespace CRPARigSharing
+{
+	/**
+	 * Shared rig of InGroup for InAnimInstance and InControlRigClass
+	 * InCreateRig is only called when no node of the group holds the rig yet
+	 */
+	WNPNODES_API TSharedPtr<FCRPASharedRig> Acquire(const UObject* InAnimInstance, const FName& InGroup,
+	                                                const UClass* InControlRigClass,
+	                                                TFunctionRef<UControlRig*()> InCreateRig);
+}
@@ -0,0 +1,27 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Global limits on what every CRPA node may cost, read each frame so they apply without recompiling anim BPs
+ * The a.CRPA.* variables other than ForceCachedOutput are scalability variables, so device profiles and scalability
+ * groups can set them, e.g.
+ *   +CVars=a.CRPA.MaxLOD=1 in a DeviceProfiles.ini profile, or a.CRPA.MaxEvaluationsPerFrame=32 in a Scalability.ini group
+ * Frames a node doesn't run its rig reuse the last result its rig produced.
+ */
+namespace CRPAScalability
+{
+	/** The node LOD threshold limited by a.CRPA.MaxLOD, and below every LOD while a.CRPA.Enable is 0 */
+	WNPNODES_API int32 GetLODThreshold(int32 InNodeLODThreshold);
+
+	/** Whether a node runs its rig this frame under a.CRPA.RateDivisor, InOffset spreads the nodes over the frames */
+	WNPNODES_API bool IsEvaluationFrame(uint32 InOffset);
+
+	/** Count a rig evaluation against a.CRPA.MaxEvaluationsPerFrame, false once the frame is over budget. Thread safe. */
+	WNPNODES_API bool TryConsumeEvaluation();
+
+	/** a.CRPA.ForceCachedOutput, every node behaves as if bShareOutput was set. A debug switch, wrong for rigs with state. */
+	WNPNODES_API bool IsCachedOutputForced();
+}
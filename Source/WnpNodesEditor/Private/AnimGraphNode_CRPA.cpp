@@ -9,6 +9,10 @@
 #include "AnimationGraphSchema.h"
 #include "RigVMBlueprintGeneratedClass.h"
 #include "ControlRigDeveloper/Public/ControlRigBlueprint.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimSequence.h"
+#include "CRPABake.h"
+#include "ToolMenus.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(AnimGraphNode_CRPA)
 
@@ -31,6 +35,50 @@ FText UAnimGraphNode_CRPA::GetTooltipText() const
 	return LOCTEXT("AnimGraphNode_AnimNode_CRPA_Tooltip", "Evaluates a control rig from pose asset");
 }
 
+void UAnimGraphNode_CRPA::GetNodeContextMenuActions(UToolMenu* Menu, UGraphNodeContextMenuContext* Context) const
+{
+	Super::GetNodeContextMenuActions(Menu, Context);
+
+	if (Context->bIsDebugging)
+	{
+		return;
+	}
+
+	FToolMenuSection& Section = Menu->AddSection("AnimGraphNodeCRPA", LOCTEXT("CRPASection", "CRPA"));
+	Section.AddMenuEntry(
+		"BakeCRPAOutput",
+		LOCTEXT("BakeOutput", "Bake Output to Sequence"),
+		LOCTEXT("BakeOutputTooltip", "Bake the rig output for every atlas pose on the preview mesh, the node samples it from Baked LOD on"),
+		FSlateIcon(),
+		FUIAction(FExecuteAction::CreateUObject(const_cast<UAnimGraphNode_CRPA*>(this), &UAnimGraphNode_CRPA::BakeOutput)));
+}
+
+void UAnimGraphNode_CRPA::BakeOutput()
+{
+	UAnimBlueprint* AnimBlueprint = Cast<UAnimBlueprint>(GetBlueprint());
+	USkeletalMesh* PreviewMesh = AnimBlueprint ? AnimBlueprint->GetPreviewMesh() : nullptr;
+	if (PreviewMesh == nullptr)
+	{
+		UE_LOG(LogAnimation, Warning, TEXT("%s needs a preview mesh to bake the CRPA output"), *GetNameSafe(AnimBlueprint));
+		return;
+	}
+
+	CRPABake::FSettings Settings;
+	Settings.ControlRigClass = Node.GetControlRigClass();
+	Settings.SkeletalMesh = PreviewMesh;
+	Settings.PoseAtlas = Node.PoseAtlas;
+	Settings.PoseAsset = Node.PoseAsset.LoadSynchronous();
+	Settings.PackageName = FString::Printf(TEXT("%s_%s_Baked"), *AnimBlueprint->GetPackage()->GetName(), *GetName());
+
+	if (UAnimSequence* Sequence = CRPABake::BakeSequence(Settings))
+	{
+		const FScopedTransaction Transaction(LOCTEXT("BakeOutputTransaction", "Bake CRPA Output"));
+		Modify();
+		Node.BakedSequence = Sequence;
+		FBlueprintEditorUtils::MarkBlueprintAsModified(AnimBlueprint);
+	}
+}
+
 void UAnimGraphNode_CRPA::CreateCustomPins(TArray<UEdGraphPin*>* OldPins)
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
@@ -197,6 +245,9 @@ void UAnimGraphNode_CRPA::CreateCustomPins(TArray<UEdGraphPin*>* OldPins)
 	{
 		if (UControlRig* CDO = ControlRigClass->GetDefaultObject<UControlRig>())
 		{
+			// pose asset values are used as pin defaults, the node only holds a soft reference
+			UControlRigPoseAsset* PoseAsset = Node.PoseAsset.LoadSynchronous();
+
 			if (const URigHierarchy* Hierarchy = CDO->GetHierarchy())
 			{
 				Hierarchy->ForEach<FRigControlElement>([&](FRigControlElement* ControlElement) -> bool
@@ -232,12 +283,12 @@ void UAnimGraphNode_CRPA::CreateCustomPins(TArray<UEdGraphPin*>* OldPins)
 
 							FString DefaultValue = "";
 							// Extract default values from the Target Control Rig if possible
-							if (Node.PoseAsset && Node.PoseAsset->Pose.ContainsName(ControlName))
+							if (PoseAsset && PoseAsset->Pose.ContainsName(ControlName))
 							{
-								const int index = Node.PoseAsset->Pose.CopyOfControlsNameToIndex.FindChecked(
+								const int index = PoseAsset->Pose.CopyOfControlsNameToIndex.FindChecked(
 									ControlName);
 								DefaultValue = GetControlValueAsString(
-									Node.PoseAsset->Pose.CopyOfControls[index], ControlElement);
+									PoseAsset->Pose.CopyOfControls[index], ControlElement);
 							}
 							else
 							{
@@ -389,6 +440,24 @@ void UAnimGraphNode_CRPA::ValidateAnimNodeDuringCompilation(USkeleton* ForSkelet
 	Super::ValidateAnimNodeDuringCompilation(ForSkeleton, MessageLog);
 }
 
+void UAnimGraphNode_CRPA::OnProcessDuringCompilation(IAnimBlueprintCompilationContext& InCompilationContext,
+                                                     IAnimBlueprintGeneratedClassCompiledData& OutCompiledData)
+{
+	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+	// this fills in the source/dest property names first
+	Super::OnProcessDuringCompilation(InCompilationContext, OutCompiledData);
+
+	// bake the bindings against the rig CDO, instances share its hierarchy layout and property offsets
+	const UControlRig* CDO = nullptr;
+	if (const UClass* TargetClass = GetTargetClass())
+	{
+		CDO = TargetClass->GetDefaultObject<UControlRig>();
+	}
+	Node.BakeBindings(CDO);
+	Node.BakeAffectedBones(GetTargetClass());
+}
+
 void UAnimGraphNode_CRPA::RebuildExposedProperties()
 {
 	DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
@@ -639,14 +708,16 @@ void UAnimGraphNode_CRPA::PostEditChangeProperty(FPropertyChangedEvent& Property
 		if (ChangedProperty->GetFName() == GET_MEMBER_NAME_CHECKED(FAnimNode_CRPA, PoseAsset) || ChangedProperty->
 			GetFName() == GET_MEMBER_NAME_CHECKED(FAnimNode_CRPA, NeutralPoseAsset))
 		{
-			if (Node.NeutralPoseAsset && Node.PoseAsset)
+			UControlRigPoseAsset* NeutralPoseAsset = Node.NeutralPoseAsset.LoadSynchronous();
+			UControlRigPoseAsset* PoseAsset = Node.PoseAsset.LoadSynchronous();
+			if (NeutralPoseAsset && PoseAsset)
 			{
 				FScopedTransaction Transaction(LOCTEXT("ChangeAlphaInputType", "Change Alpha Input Type"));
 				Modify();
 
-				for (auto& Pose : Node.PoseAsset->Pose.GetPoses())
+				for (auto& Pose : PoseAsset->Pose.GetPoses())
 				{
-					const FRigControlCopy& NeutralPose = GetRigControlCopy(Pose.Name, Node.NeutralPoseAsset);
+					const FRigControlCopy& NeutralPose = GetRigControlCopy(Pose.Name, NeutralPoseAsset);
 					constexpr float Tolerance = 0.0001f;
 					bool bAddPin = !NeutralPose.LocalTransform.Equals(Pose.LocalTransform, Tolerance);
 
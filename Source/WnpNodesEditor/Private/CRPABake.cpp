@@ -0,0 +1,189 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPABake.h"
+#include "Animation/AnimSequence.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "ControlRig.h"
+#include "CRPAPoseAtlas.h"
+#include "Engine/SkeletalMesh.h"
+#include "Rigs/RigHierarchy.h"
+#include "Tools/ControlRigPose.h"
+
+namespace CRPABake
+{
+	// frame rate of the baked sequence, every frame is one pose so it only matters for previews
+	static const FFrameRate BakeFrameRate(30, 1);
+
+	UAnimSequence* BakeSequence(const FSettings& InSettings)
+	{
+		DECLARE_SCOPE_HIERARCHICAL_COUNTER_FUNC()
+
+		if (InSettings.ControlRigClass == nullptr || !InSettings.ControlRigClass->IsChildOf(UControlRig::StaticClass()) ||
+			InSettings.SkeletalMesh == nullptr || InSettings.SkeletalMesh->GetSkeleton() == nullptr ||
+			InSettings.PackageName.IsEmpty())
+		{
+			UE_LOG(LogAnimation, Error, TEXT("CRPA bake needs a control rig class, a skeletal mesh with a skeleton and a package name"));
+			return nullptr;
+		}
+
+		UControlRig* ControlRig = NewObject<UControlRig>(GetTransientPackage(), InSettings.ControlRigClass, NAME_None,
+		                                                 RF_Transient);
+		ControlRig->Initialize(true);
+		URigHierarchy* Hierarchy = ControlRig->GetHierarchy();
+
+		const FReferenceSkeleton& RefSkeleton = InSettings.SkeletalMesh->GetRefSkeleton();
+		const TArray<FTransform>& RefPose = RefSkeleton.GetRefBonePose();
+		TArray<int32> RigBoneIndices;
+		for (int32 Bone = 0; Bone < RefSkeleton.GetNum(); ++Bone)
+		{
+			RigBoneIndices.Add(Hierarchy->GetIndex(FRigElementKey(RefSkeleton.GetBoneName(Bone), ERigElementType::Bone)));
+		}
+
+		// one key per pose, every key starts from the initial controls and the ref pose
+		TArray<TArray<FTransform>> Keys;
+		auto BakeKey = [&](TFunctionRef<void()> InApplyPose)
+		{
+			Hierarchy->ResetPoseToInitial(ERigElementType::All);
+			for (int32 Bone = 0; Bone < RigBoneIndices.Num(); ++Bone)
+			{
+				if (RigBoneIndices[Bone] != INDEX_NONE)
+				{
+					Hierarchy->SetLocalTransform(RigBoneIndices[Bone], RefPose[Bone]);
+				}
+			}
+
+			InApplyPose();
+			ControlRig->Evaluate_AnyThread();
+
+			TArray<FTransform>& Key = Keys.Add_GetRef(RefPose);
+			for (int32 Bone = 0; Bone < RigBoneIndices.Num(); ++Bone)
+			{
+				if (RigBoneIndices[Bone] != INDEX_NONE)
+				{
+					Key[Bone] = Hierarchy->GetLocalTransform(RigBoneIndices[Bone]);
+				}
+			}
+		};
+
+		if (const UCRPAPoseAtlas* PoseAtlas = InSettings.PoseAtlas)
+		{
+			// same writes as FAnimNode_CRPA::ApplyPoseAtlas
+			const TArray<FName>& ControlNames = PoseAtlas->GetControlNames();
+			const TArray<ERigControlType>& ControlTypes = PoseAtlas->GetControlTypes();
+			TArray<FTransform> Transforms;
+			for (int32 Pose = 0; Pose < PoseAtlas->GetNumPoses(); ++Pose)
+			{
+				BakeKey([&]()
+				{
+					PoseAtlas->EvaluatePose(Pose, INDEX_NONE, 0.f, Transforms);
+					FRigControlValue Value;
+					for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+					{
+						const FRigElementKey Key(ControlNames[Control], ERigElementType::Control);
+						FRigControlElement* ControlElement = Hierarchy->Find<FRigControlElement>(Key);
+						if (ControlElement && ControlElement->Settings.ControlType == ControlTypes[Control] &&
+							ControlTypes[Control] != ERigControlType::Rotator &&
+							ControlTypes[Control] != ERigControlType::EulerTransform)
+						{
+							Value.SetFromTransform(Transforms[Control], ControlTypes[Control], ERigControlAxis::X);
+							Hierarchy->SetControlValue(ControlElement, Value, ERigControlValueType::Current);
+						}
+					}
+				});
+			}
+		}
+		else
+		{
+			BakeKey([&]()
+			{
+				if (InSettings.PoseAsset)
+				{
+					const_cast<UControlRigPoseAsset*>(InSettings.PoseAsset)->PastePose(ControlRig);
+				}
+			});
+		}
+
+		ControlRig->MarkAsGarbage();
+
+		if (Keys.Num() == 0)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("CRPA bake of %s has no poses"), *InSettings.PackageName);
+			return nullptr;
+		}
+
+		// a sequence needs at least one frame, so two keys
+		if (Keys.Num() == 1)
+		{
+			Keys.Add(Keys[0]);
+		}
+
+		// baking again keeps the asset so nodes referencing it pick up the new poses
+		UPackage* Package = CreatePackage(*InSettings.PackageName);
+		const FString AssetName = FPackageName::GetShortName(InSettings.PackageName);
+		UAnimSequence* Sequence = FindObject<UAnimSequence>(Package, *AssetName);
+		const bool bExisting = Sequence != nullptr;
+		if (!bExisting)
+		{
+			Sequence = NewObject<UAnimSequence>(Package, FName(AssetName), RF_Public | RF_Standalone);
+		}
+		Sequence->SetSkeleton(InSettings.SkeletalMesh->GetSkeleton());
+		Sequence->SetPreviewMesh(InSettings.SkeletalMesh);
+
+		IAnimationDataController& Controller = Sequence->GetController();
+		Controller.OpenBracket(INVTEXT("Bake CRPA output"), false);
+		if (bExisting)
+		{
+			Controller.ResetModel(false);
+		}
+		else
+		{
+			Controller.InitializeModel();
+		}
+		Controller.SetFrameRate(BakeFrameRate, false);
+		Controller.SetNumberOfFrames(FFrameNumber(Keys.Num() - 1), false);
+
+		int32 NumTracks = 0;
+		TArray<FVector3f> Positions;
+		TArray<FQuat4f> Rotations;
+		TArray<FVector3f> Scales;
+		for (int32 Bone = 0; Bone < RefSkeleton.GetNum(); ++Bone)
+		{
+			const bool bMoved = Keys.ContainsByPredicate([Bone, &RefPose](const TArray<FTransform>& Key)
+			{
+				return !Key[Bone].Equals(RefPose[Bone], KINDA_SMALL_NUMBER);
+			});
+			if (!bMoved)
+			{
+				continue;
+			}
+
+			Positions.Reset();
+			Rotations.Reset();
+			Scales.Reset();
+			for (const TArray<FTransform>& Key : Keys)
+			{
+				Positions.Add(FVector3f(Key[Bone].GetTranslation()));
+				Rotations.Add(FQuat4f(Key[Bone].GetRotation()));
+				Scales.Add(FVector3f(Key[Bone].GetScale3D()));
+			}
+
+			const FName BoneName = RefSkeleton.GetBoneName(Bone);
+			Controller.AddBoneCurve(BoneName, false);
+			Controller.SetBoneTrackKeys(BoneName, Positions, Rotations, Scales, false);
+			++NumTracks;
+		}
+
+		Controller.NotifyPopulated();
+		Controller.CloseBracket(false);
+
+		if (!bExisting)
+		{
+			FAssetRegistryModule::AssetCreated(Sequence);
+		}
+		Sequence->MarkPackageDirty();
+
+		UE_LOG(LogAnimation, Display, TEXT("Baked %s: %d poses, %d bone tracks"), *InSettings.PackageName,
+		       InSettings.PoseAtlas ? InSettings.PoseAtlas->GetNumPoses() : 1, NumTracks);
+		return Sequence;
+	}
+}
@@ -0,0 +1,124 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPABakeCommandlet.h"
+#include "AnimNode_CRPA.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/AnimBlueprintGeneratedClass.h"
+#include "Animation/AnimSequence.h"
+#include "CRPABake.h"
+#include "CRPAPoseAtlas.h"
+#include "Engine/SkeletalMesh.h"
+#include "UObject/SavePackage.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CRPABakeCommandlet)
+
+UCRPABakeCommandlet::UCRPABakeCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UCRPABakeCommandlet::Main(const FString& Params)
+{
+	FString OutputPackage;
+	FString AnimBlueprintPath;
+	FString RigPath;
+	FString MeshPath;
+	FString AtlasPath;
+	FString PoseAssetPath;
+	FParse::Value(*Params, TEXT("Output="), OutputPackage);
+	FParse::Value(*Params, TEXT("AnimBP="), AnimBlueprintPath);
+	FParse::Value(*Params, TEXT("Rig="), RigPath);
+	FParse::Value(*Params, TEXT("Mesh="), MeshPath);
+	FParse::Value(*Params, TEXT("Atlas="), AtlasPath);
+	FParse::Value(*Params, TEXT("PoseAsset="), PoseAssetPath);
+
+	if (OutputPackage.IsEmpty() || (AnimBlueprintPath.IsEmpty() && RigPath.IsEmpty()))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Usage: -run=CRPABake -Output=<package> (-AnimBP=<anim blueprint> [-Mesh=<mesh>] | -Rig=<class> -Mesh=<mesh> [-Atlas=<atlas> | -PoseAsset=<pose>])"));
+		return 1;
+	}
+
+	USkeletalMesh* SkeletalMesh = MeshPath.IsEmpty() ? nullptr : LoadObject<USkeletalMesh>(nullptr, *MeshPath);
+	if (!MeshPath.IsEmpty() && SkeletalMesh == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to load skeletal mesh %s"), *MeshPath);
+		return 1;
+	}
+
+	TArray<CRPABake::FSettings> Bakes;
+	if (!AnimBlueprintPath.IsEmpty())
+	{
+		UAnimBlueprint* AnimBlueprint = LoadObject<UAnimBlueprint>(nullptr, *AnimBlueprintPath);
+		UAnimBlueprintGeneratedClass* GeneratedClass = AnimBlueprint
+			                                               ? Cast<UAnimBlueprintGeneratedClass>(AnimBlueprint->GeneratedClass)
+			                                               : nullptr;
+		if (GeneratedClass == nullptr)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("Unable to load compiled anim blueprint %s"), *AnimBlueprintPath);
+			return 1;
+		}
+
+		UObject* DefaultObject = GeneratedClass->GetDefaultObject();
+		for (const FStructProperty* NodeProperty : GeneratedClass->GetAnimNodeProperties())
+		{
+			if (!NodeProperty->Struct->IsChildOf(FAnimNode_CRPA::StaticStruct()))
+			{
+				continue;
+			}
+
+			const FAnimNode_CRPA* Node = NodeProperty->ContainerPtrToValuePtr<FAnimNode_CRPA>(DefaultObject);
+			CRPABake::FSettings& Settings = Bakes.AddDefaulted_GetRef();
+			Settings.ControlRigClass = Node->GetControlRigClass();
+			Settings.SkeletalMesh = SkeletalMesh ? SkeletalMesh : AnimBlueprint->GetPreviewMesh();
+			Settings.PoseAtlas = Node->GetPoseAtlas();
+			Settings.PoseAsset = Node->GetPoseAsset().LoadSynchronous();
+		}
+
+		if (Bakes.Num() == 0)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("%s has no CRPA node"), *AnimBlueprintPath);
+			return 1;
+		}
+	}
+	else
+	{
+		CRPABake::FSettings& Settings = Bakes.AddDefaulted_GetRef();
+		Settings.ControlRigClass = LoadObject<UClass>(nullptr, *RigPath);
+		Settings.SkeletalMesh = SkeletalMesh;
+		Settings.PoseAtlas = AtlasPath.IsEmpty() ? nullptr : LoadObject<UCRPAPoseAtlas>(nullptr, *AtlasPath);
+		Settings.PoseAsset = PoseAssetPath.IsEmpty() ? nullptr : LoadObject<UControlRigPoseAsset>(nullptr, *PoseAssetPath);
+		if ((!AtlasPath.IsEmpty() && Settings.PoseAtlas == nullptr) ||
+			(!PoseAssetPath.IsEmpty() && Settings.PoseAsset == nullptr))
+		{
+			UE_LOG(LogAnimation, Error, TEXT("Unable to load %s"), AtlasPath.IsEmpty() ? *PoseAssetPath : *AtlasPath);
+			return 1;
+		}
+	}
+
+	for (int32 Index = 0; Index < Bakes.Num(); ++Index)
+	{
+		CRPABake::FSettings& Settings = Bakes[Index];
+		Settings.PackageName = Bakes.Num() > 1 ? FString::Printf(TEXT("%s_%d"), *OutputPackage, Index) : OutputPackage;
+
+		UAnimSequence* Sequence = CRPABake::BakeSequence(Settings);
+		if (Sequence == nullptr)
+		{
+			return 1;
+		}
+
+		FSavePackageArgs SaveArgs;
+		SaveArgs.TopLevelFlags = RF_Public | RF_Standalone;
+		const FString Filename = FPackageName::LongPackageNameToFilename(Settings.PackageName,
+		                                                                 FPackageName::GetAssetPackageExtension());
+		if (!UPackage::SavePackage(Sequence->GetPackage(), Sequence, *Filename, SaveArgs))
+		{
+			UE_LOG(LogAnimation, Error, TEXT("Unable to save %s"), *Filename);
+			return 1;
+		}
+	}
+
+	return 0;
+}
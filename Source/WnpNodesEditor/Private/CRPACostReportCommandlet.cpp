@@ -0,0 +1,311 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPACostReportCommandlet.h"
+#include "AnimGraphNode_CRPA.h"
+#include "Animation/AnimBlueprint.h"
+#include "Animation/Skeleton.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "ControlRig.h"
+#include "CRPABindings.h"
+#include "CRPACurveControlMatrix.h"
+#include "CRPAPoseAtlas.h"
+#include "Kismet2/BlueprintEditorUtils.h"
+#include "Misc/FileHelper.h"
+#include "Tools/ControlRigPose.h"
+#include "UObject/StrongObjectPtr.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CRPACostReportCommandlet)
+
+namespace CRPACostReport
+{
+	// rough relative cost of what a node does per frame for each binding, only meant to rank nodes against each other
+	static constexpr float ControlWriteCost = 4.f;
+	static constexpr float VariableWriteCost = 1.f;
+	static constexpr float ContainerWriteCost = 8.f;
+	static constexpr float CurveMappingCost = 2.f;
+	static constexpr float AtlasControlCost = 4.f;
+	static constexpr float MatrixMultiplyAddCost = 0.25f;
+	static constexpr float ControlCurveOutputCost = 2.f;
+
+	struct FNodeReport
+	{
+		FString AnimBlueprint;
+		FString Node;
+		FString Skeleton;
+		FString ControlRig;
+		int32 NumPins = 0;
+		int32 NumControlPins = 0;
+		int32 NumVariablePins = 0;
+		int32 NumUnconnectedPins = 0;
+		TMap<FString, int32> PinTypes;
+		int32 NumInputMappings = 0;
+		int32 NumOutputMappings = 0;
+		int32 NumPoseAssetControls = 0;
+		float PoseAssetKB = 0.f;
+		int32 NumAtlasPoses = 0;
+		int32 NumAtlasControls = 0;
+		float AtlasKB = 0.f;
+		int32 NumMatrixChannels = 0;
+		int32 NumControlCurveOutputs = 0;
+		TArray<FString> Unresolved;
+		float EstimatedCost = 0.f;
+
+		static FString GetHeader()
+		{
+			return TEXT("AnimBlueprint,Node,Skeleton,ControlRig,EstimatedCost,Pins,ControlPins,VariablePins,UnconnectedPins,")
+				TEXT("PinTypes,InputMappings,OutputMappings,PoseAssetControls,PoseAssetKB,AtlasPoses,AtlasControls,AtlasKB,")
+				TEXT("MatrixChannels,ControlCurveOutputs,NumUnresolved,Unresolved");
+		}
+
+		FString ToCSV() const
+		{
+			TArray<FString> Types;
+			for (const TPair<FString, int32>& Type : PinTypes)
+			{
+				Types.Add(FString::Printf(TEXT("%s:%d"), *Type.Key, Type.Value));
+			}
+			Types.Sort();
+
+			// text fields are quoted, asset and pin names can hold commas and quotes
+			return FString::Printf(TEXT("%s,%s,%s,%s,%.1f,%d,%d,%d,%d,%s,%d,%d,%d,%.1f,%d,%d,%.1f,%d,%d,%d,%s"),
+			                       *QuoteField(AnimBlueprint), *QuoteField(Node), *QuoteField(Skeleton),
+			                       *QuoteField(ControlRig), EstimatedCost, NumPins, NumControlPins, NumVariablePins,
+			                       NumUnconnectedPins, *QuoteField(FString::Join(Types, TEXT(" "))), NumInputMappings,
+			                       NumOutputMappings, NumPoseAssetControls, PoseAssetKB, NumAtlasPoses, NumAtlasControls,
+			                       AtlasKB, NumMatrixChannels, NumControlCurveOutputs, Unresolved.Num(),
+			                       *QuoteField(FString::Join(Unresolved, TEXT(";"))));
+		}
+
+		static FString QuoteField(const FString& InField)
+		{
+			return TEXT("\"") + InField.Replace(TEXT("\""), TEXT("\"\"")) + TEXT("\"");
+		}
+	};
+
+	static float GetResourceKB(UObject* InObject)
+	{
+		return InObject ? InObject->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal) / 1024.f : 0.f;
+	}
+}
+
+UCRPACostReportCommandlet::UCRPACostReportCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UCRPACostReportCommandlet::Main(const FString& Params)
+{
+	using namespace CRPACostReport;
+
+	FString SearchPath = TEXT("/Game");
+	FString OutputPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("CRPACostReport.csv"));
+	FParse::Value(*Params, TEXT("Path="), SearchPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	FARFilter Filter;
+	Filter.ClassPaths.Add(UAnimBlueprint::StaticClass()->GetClassPathName());
+	Filter.bRecursiveClasses = true;
+	Filter.PackagePaths.Add(*SearchPath);
+	Filter.bRecursivePaths = true;
+	TArray<FAssetData> AnimBlueprintAssets;
+	AssetRegistry.GetAssets(Filter, AnimBlueprintAssets);
+
+	// one initialized instance per rig class to resolve names against, created on first use
+	TMap<UClass*, TStrongObjectPtr<UControlRig>> Rigs;
+	auto GetRig = [&Rigs](UClass* InClass) -> UControlRig*
+	{
+		if (InClass == nullptr)
+		{
+			return nullptr;
+		}
+		if (const TStrongObjectPtr<UControlRig>* Rig = Rigs.Find(InClass))
+		{
+			return Rig->Get();
+		}
+
+		UControlRig* Rig = NewObject<UControlRig>(GetTransientPackage(), InClass, NAME_None, RF_Transient);
+		Rig->Initialize(true);
+		Rigs.Add(InClass, TStrongObjectPtr<UControlRig>(Rig));
+		return Rig;
+	};
+
+	TArray<FNodeReport> Reports;
+	for (int32 AssetIndex = 0; AssetIndex < AnimBlueprintAssets.Num(); ++AssetIndex)
+	{
+		UAnimBlueprint* AnimBlueprint = Cast<UAnimBlueprint>(AnimBlueprintAssets[AssetIndex].GetAsset());
+		if (AnimBlueprint == nullptr)
+		{
+			UE_LOG(LogAnimation, Warning, TEXT("Unable to load %s"), *AnimBlueprintAssets[AssetIndex].GetObjectPathString());
+			continue;
+		}
+
+		TArray<UAnimGraphNode_CRPA*> GraphNodes;
+		FBlueprintEditorUtils::GetAllNodesOfClass<UAnimGraphNode_CRPA>(AnimBlueprint, GraphNodes);
+
+		const USkeleton* Skeleton = AnimBlueprint->TargetSkeleton;
+		const FSmartNameMapping* CurveMapping = Skeleton ? Skeleton->GetSmartNameContainer(USkeleton::AnimCurveMappingName) : nullptr;
+		for (UAnimGraphNode_CRPA* GraphNode : GraphNodes)
+		{
+			FAnimNode_CRPA& Node = GraphNode->Node;
+			UControlRig* Rig = GetRig(Node.ControlRigClass.Get());
+			const URigHierarchy* Hierarchy = Rig ? Rig->GetHierarchy() : nullptr;
+
+			FNodeReport& Report = Reports.AddDefaulted_GetRef();
+			Report.AnimBlueprint = AnimBlueprint->GetPathName();
+			Report.Node = FString::Printf(TEXT("%s.%s"), *GetNameSafe(GraphNode->GetGraph()), *GraphNode->GetName());
+			Report.Skeleton = GetNameSafe(Skeleton);
+			Report.ControlRig = GetNameSafe(Node.ControlRigClass.Get());
+
+			auto CheckCurve = [&Report, CurveMapping](const FName& InCurve)
+			{
+				if (!InCurve.IsNone() && (CurveMapping == nullptr || !CurveMapping->Exists(InCurve)))
+				{
+					Report.Unresolved.AddUnique(FString::Printf(TEXT("curve %s"), *InCurve.ToString()));
+				}
+			};
+			auto CheckControl = [&Report, Hierarchy](const FName& InControl)
+			{
+				if (Hierarchy == nullptr || Hierarchy->Find<FRigControlElement>(FRigElementKey(InControl, ERigElementType::Control)) == nullptr)
+				{
+					Report.Unresolved.AddUnique(FString::Printf(TEXT("control %s"), *InControl.ToString()));
+				}
+			};
+
+			// pins, resolved the way the node bakes them when the anim BP compiles
+			for (const FName& PinName : Node.DestPropertyNames)
+			{
+				++Report.NumPins;
+
+				const UEdGraphPin* Pin = GraphNode->FindPin(PinName, EGPD_Input);
+				Report.NumUnconnectedPins += Pin == nullptr || Pin->LinkedTo.Num() == 0 ? 1 : 0;
+
+				FCRPABakedBinding Binding;
+				if (Rig == nullptr || !CRPABindings::ResolveByName(Rig, PinName, Binding))
+				{
+					Report.Unresolved.AddUnique(FString::Printf(TEXT("pin %s"), *PinName.ToString()));
+					continue;
+				}
+
+				if (Binding.Type == ECRPABindingType::Control)
+				{
+					++Report.NumControlPins;
+					++Report.PinTypes.FindOrAdd(StaticEnum<ERigControlType>()->GetNameStringByValue((int64)Binding.ControlType));
+					Report.EstimatedCost += ControlWriteCost;
+				}
+				else
+				{
+					++Report.NumVariablePins;
+					++Report.PinTypes.FindOrAdd(StaticEnum<ECRPABindingType>()->GetNameStringByValue((int64)Binding.Type));
+					const bool bContainer = Binding.Type == ECRPABindingType::Struct || Binding.Type == ECRPABindingType::Array;
+					Report.EstimatedCost += bContainer ? ContainerWriteCost : VariableWriteCost;
+				}
+			}
+
+			// curve mappings, rig float variable to skeleton curve
+			auto CheckMapping = [&](const TMap<FName, FName>& Mapping, bool bInput)
+			{
+				for (const TPair<FName, FName>& Pair : Mapping)
+				{
+					const FRigVMExternalVariable Variable = Rig ? Rig->GetPublicVariableByName(Pair.Key) : FRigVMExternalVariable();
+					if (!CRPABindings::IsCurveVariable(Variable) || (bInput && Variable.bIsReadOnly))
+					{
+						Report.Unresolved.AddUnique(FString::Printf(TEXT("variable %s"), *Pair.Key.ToString()));
+					}
+					CheckCurve(Pair.Value);
+					Report.EstimatedCost += CurveMappingCost;
+				}
+			};
+			Report.NumInputMappings = Node.InputMapping.Num();
+			Report.NumOutputMappings = Node.OutputMapping.Num();
+			CheckMapping(Node.InputMapping, true);
+			CheckMapping(Node.OutputMapping, false);
+
+			if (Node.AlphaInputType == EAnimAlphaInputType::Curve)
+			{
+				CheckCurve(Node.AlphaCurveName);
+			}
+
+			// the pose asset is applied once at initialization, so it costs memory rather than time
+			if (UControlRigPoseAsset* PoseAsset = Node.PoseAsset.LoadSynchronous())
+			{
+				Report.NumPoseAssetControls = PoseAsset->Pose.GetPoses().Num();
+				Report.PoseAssetKB = GetResourceKB(PoseAsset);
+				for (const FRigControlCopy& Copy : PoseAsset->Pose.GetPoses())
+				{
+					CheckControl(Copy.Name);
+				}
+			}
+
+			// an atlas selection writes every atlas control, twice the reads while cross-fading
+			if (UCRPAPoseAtlas* PoseAtlas = Node.PoseAtlas)
+			{
+				Report.NumAtlasPoses = PoseAtlas->GetNumPoses();
+				Report.NumAtlasControls = PoseAtlas->GetNumControls();
+				Report.AtlasKB = GetResourceKB(PoseAtlas);
+				Report.EstimatedCost += PoseAtlas->GetNumControls() * AtlasControlCost;
+				for (const FName& Control : PoseAtlas->GetControlNames())
+				{
+					CheckControl(Control);
+				}
+			}
+
+			if (const UCRPACurveControlMatrix* Matrix = Node.CurveControlMatrix)
+			{
+				Report.NumMatrixChannels = Matrix->GetNumChannels();
+				Report.EstimatedCost += Matrix->GetNumChannels() * Matrix->GetInputStride() * MatrixMultiplyAddCost;
+				for (const FName& Curve : Matrix->GetInputCurves())
+				{
+					CheckCurve(Curve);
+				}
+				for (const FName& Control : Matrix->GetChannelControls())
+				{
+					CheckControl(Control);
+				}
+			}
+
+			Report.NumControlCurveOutputs = Node.ControlCurveOutputs.Num();
+			for (const FCRPAControlCurveOutput& Output : Node.ControlCurveOutputs)
+			{
+				CheckControl(Output.Control);
+				CheckCurve(Output.Curve);
+				Report.EstimatedCost += ControlCurveOutputCost;
+			}
+
+			for (const FString& Name : Report.Unresolved)
+			{
+				UE_LOG(LogAnimation, Warning, TEXT("%s %s: unresolved %s"), *Report.AnimBlueprint, *Report.Node, *Name);
+			}
+		}
+
+		// loaded anim BPs aren't needed once reported
+		if (AssetIndex % 32 == 31)
+		{
+			CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+		}
+	}
+
+	Reports.Sort([](const FNodeReport& A, const FNodeReport& B) { return A.EstimatedCost > B.EstimatedCost; });
+
+	TArray<FString> Lines;
+	Lines.Add(FNodeReport::GetHeader());
+	for (const FNodeReport& Report : Reports)
+	{
+		Lines.Add(Report.ToCSV());
+	}
+
+	if (!FFileHelper::SaveStringArrayToFile(Lines, *OutputPath))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to write %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogAnimation, Display, TEXT("Reported %d CRPA nodes in %d anim blueprints to %s"), Reports.Num(),
+	       AnimBlueprintAssets.Num(), *OutputPath);
+	return 0;
+}
@@ -0,0 +1,303 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPANodeHarness.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimInstanceProxy.h"
+#include "Animation/AnimNodeBase.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "ControlRig.h"
+
+// proxy with the bone container of a skeleton instead of a mesh, it only exposes what the graph calls
+class FCRPANodeHarnessProxy : public FAnimInstanceProxy
+{
+public:
+	FCRPANodeHarnessProxy(UAnimInstance* InAnimInstance, USkeletalMeshComponent* InComponent, USkeleton* InSkeleton)
+		: FAnimInstanceProxy(InAnimInstance)
+		, Component(InComponent)
+		, Skeleton(InSkeleton)
+	{
+		InitializeObjects(InAnimInstance);
+		RefreshRequiredBones();
+	}
+
+	// required bones of the component, for the predicted LOD
+	void RefreshRequiredBones()
+	{
+		FAnimInstanceProxy::RecalcRequiredBones(Component, Skeleton);
+	}
+
+	void BeginFrame(UAnimInstance* InAnimInstance, float InDeltaTime)
+	{
+		PreUpdate(InAnimInstance, InDeltaTime);
+	}
+
+private:
+	USkeletalMeshComponent* Component;
+	USkeleton* Skeleton;
+};
+
+TSharedPtr<FCRPANodeHarness> FCRPANodeHarness::Create(const FAnimNode_CRPA& InNode,
+                                                      TSubclassOf<UAnimInstance> InAnimInstanceClass,
+                                                      USkeleton* InSkeleton)
+{
+	if (InNode.ControlRigClass == nullptr || InAnimInstanceClass == nullptr || InSkeleton == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("CRPA node harness needs a node with a rig class, an anim instance class and a skeleton"));
+		return nullptr;
+	}
+
+	if (!HasPins(InNode, InAnimInstanceClass))
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness(new FCRPANodeHarness());
+	Harness->Skeleton = InSkeleton;
+
+	// the anim instance has to be outered to a component, the node creates its rig there
+	Harness->Component = NewObject<USkeletalMeshComponent>(GetTransientPackage(), NAME_None, RF_Transient);
+	Harness->Component->RequiredBones.Reset();
+	for (int32 Bone = 0; Bone < InSkeleton->GetReferenceSkeleton().GetNum(); ++Bone)
+	{
+		Harness->Component->RequiredBones.Add(static_cast<FBoneIndexType>(Bone));
+	}
+
+	Harness->AnimInstance = NewObject<UAnimInstance>(Harness->Component, InAnimInstanceClass, NAME_None, RF_Transient);
+	Harness->AnimInstance->CurrentSkeleton = InSkeleton;
+	Harness->Proxy = MakeShared<FCRPANodeHarnessProxy>(Harness->AnimInstance, Harness->Component, InSkeleton);
+
+	if (!Harness->InitializeNode(InNode))
+	{
+		return nullptr;
+	}
+	return Harness;
+}
+
+TSharedPtr<FCRPANodeHarness> FCRPANodeHarness::CreateInSameInstance(const FAnimNode_CRPA& InNode,
+                                                                    FCRPANodeHarness& InOther)
+{
+	if (InNode.ControlRigClass == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("CRPA node harness needs a node with a rig class"));
+		return nullptr;
+	}
+
+	if (!HasPins(InNode, InOther.AnimInstance->GetClass()))
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness(new FCRPANodeHarness());
+	Harness->Skeleton = InOther.Skeleton;
+	Harness->Component = InOther.Component;
+	Harness->AnimInstance = InOther.AnimInstance;
+	Harness->Proxy = InOther.Proxy;
+
+	if (!Harness->InitializeNode(InNode))
+	{
+		return nullptr;
+	}
+	return Harness;
+}
+
+bool FCRPANodeHarness::HasPins(const FAnimNode_CRPA& InNode, const UClass* InAnimInstanceClass)
+{
+	for (const FName& SourcePropertyName : InNode.SourcePropertyNames)
+	{
+		if (InAnimInstanceClass->FindPropertyByName(SourcePropertyName) == nullptr)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("%s has no pin %s"), *InAnimInstanceClass->GetName(),
+			       *SourcePropertyName.ToString());
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FCRPANodeHarness::InitializeNode(const FAnimNode_CRPA& InNode)
+{
+	Node = InNode;
+	SourceNode.Harness = this;
+	Node.Source.SetLinkNode(&SourceNode);
+	ResetSourcePose();
+
+	Node.OnInitializeAnimInstance(Proxy.Get(), AnimInstance);
+	{
+		FAnimationInitializeContext Context(Proxy.Get(), &SharedContext);
+		Node.Initialize_AnyThread(Context);
+	}
+
+	if (Node.ControlRig == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("CRPA node harness couldn't create an instance of %s"),
+		       *GetNameSafe(InNode.ControlRigClass));
+		return false;
+	}
+	return true;
+}
+
+FCRPANodeHarness::~FCRPANodeHarness() = default;
+
+bool FCRPANodeHarness::SetNodeProperty(FAnimNode_CRPA& InNode, const FName& InName, const TCHAR* InValue)
+{
+	const FProperty* Property = FAnimNode_CRPA::StaticStruct()->FindPropertyByName(InName);
+	if (Property == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("CRPA node has no property %s"), *InName.ToString());
+		return false;
+	}
+
+	if (Property->ImportText_Direct(InValue, Property->ContainerPtrToValuePtr<void>(&InNode), nullptr, PPF_None) == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to set CRPA node property %s to %s"), *InName.ToString(), InValue);
+		return false;
+	}
+	return true;
+}
+
+bool FCRPANodeHarness::SetNodeProperty(FAnimNode_CRPA& InNode, const FName& InName, UObject* InValue)
+{
+	const FObjectPropertyBase* Property = CastField<FObjectPropertyBase>(
+		FAnimNode_CRPA::StaticStruct()->FindPropertyByName(InName));
+	if (Property == nullptr || (InValue != nullptr && !InValue->IsA(Property->PropertyClass)))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("CRPA node has no object property %s that can hold %s"), *InName.ToString(),
+		       *GetNameSafe(InValue));
+		return false;
+	}
+
+	Property->SetObjectPropertyValue(Property->ContainerPtrToValuePtr<void>(&InNode), InValue);
+	return true;
+}
+
+const FBoneContainer& FCRPANodeHarness::GetRequiredBones() const
+{
+	return Proxy->GetRequiredBones();
+}
+
+void FCRPANodeHarness::SetLODLevel(int32 InLODLevel, TArrayView<const FBoneIndexType> InRequiredBones)
+{
+	Component->SetPredictedLODLevel(InLODLevel);
+
+	Component->RequiredBones.Reset();
+	if (InRequiredBones.Num() > 0)
+	{
+		Component->RequiredBones.Append(InRequiredBones.GetData(), InRequiredBones.Num());
+	}
+	else
+	{
+		for (int32 Bone = 0; Bone < Skeleton->GetReferenceSkeleton().GetNum(); ++Bone)
+		{
+			Component->RequiredBones.Add(static_cast<FBoneIndexType>(Bone));
+		}
+	}
+
+	Proxy->RefreshRequiredBones();
+	ResetSourcePose();
+	bCacheBonesPending = true;
+}
+
+void FCRPANodeHarness::SetSourceCurve(SmartName::UID_Type InCurveUID, float InValue)
+{
+	for (TPair<SmartName::UID_Type, float>& Curve : SourceCurves)
+	{
+		if (Curve.Key == InCurveUID)
+		{
+			Curve.Value = InValue;
+			return;
+		}
+	}
+	SourceCurves.Emplace(InCurveUID, InValue);
+}
+
+void FCRPANodeHarness::SetAlpha(float InAlpha)
+{
+	Node.AlphaInputType = EAnimAlphaInputType::Float;
+	Node.Alpha = InAlpha;
+	Node.AlphaScaleBias = FInputScaleBias();
+	Node.AlphaScaleBiasClamp = FInputScaleBiasClamp();
+}
+
+void FCRPANodeHarness::Update(float InDeltaTime)
+{
+	// the engine advances the frame once per tick, here a harness updated twice has started the next tick
+	if (LastUpdateFrame == GFrameCounter)
+	{
+		++GFrameCounter;
+	}
+	LastUpdateFrame = GFrameCounter;
+
+	Proxy->BeginFrame(AnimInstance, InDeltaTime);
+	if (Node.HasPreUpdate())
+	{
+		// the render time of the component is never set without a world, what the node read is replaced the same way
+		const bool bWasRendered = Node.bRecentlyRendered;
+		Node.PreUpdate(AnimInstance);
+		if (bRendered && !bWasRendered)
+		{
+			Node.PendingCatchUpEvaluations = Node.CatchUpEvaluations;
+		}
+		Node.bRecentlyRendered = bRendered;
+	}
+
+	if (bCacheBonesPending)
+	{
+		FAnimationCacheBonesContext Context(Proxy.Get());
+		Node.CacheBones_AnyThread(Context);
+		bCacheBonesPending = false;
+	}
+
+	FAnimationUpdateContext Context(Proxy.Get(), InDeltaTime, &SharedContext);
+	Node.Update_AnyThread(Context);
+}
+
+void FCRPANodeHarness::Evaluate(TFunctionRef<void(const FPoseContext& Output)> InReadOutput)
+{
+	FMemMark Mark(FMemStack::Get());
+	FPoseContext Output(Proxy.Get());
+	Node.Evaluate_AnyThread(Output);
+	InReadOutput(Output);
+}
+
+void FCRPANodeHarness::AddReferencedObjects(FReferenceCollector& Collector)
+{
+	Collector.AddReferencedObject(Component);
+	Collector.AddReferencedObject(AnimInstance);
+	Collector.AddReferencedObject(Skeleton);
+	Collector.AddReferencedObject(Node.ControlRig);
+	Collector.AddReferencedObjects(Node.LODControlRigs);
+}
+
+FString FCRPANodeHarness::GetReferencerName() const
+{
+	return TEXT("FCRPANodeHarness");
+}
+
+void FCRPANodeHarness::ResetSourcePose()
+{
+	const FBoneContainer& RequiredBones = Proxy->GetRequiredBones();
+	SourcePose.SetNum(RequiredBones.GetCompactPoseNumBones());
+	for (int32 Bone = 0; Bone < SourcePose.Num(); ++Bone)
+	{
+		SourcePose[Bone] = RequiredBones.GetRefPoseTransform(FCompactPoseBoneIndex(Bone));
+	}
+}
+
+void FCRPANodeHarness::FSourceNode::Evaluate_AnyThread(FPoseContext& Output)
+{
+	Output.ResetToRefPose();
+
+	const TArray<FTransform>& Pose = Harness->SourcePose;
+	if (Output.Pose.GetNumBones() == Pose.Num())
+	{
+		for (const FCompactPoseBoneIndex Bone : Output.Pose.ForEachBoneIndex())
+		{
+			Output.Pose[Bone] = Pose[Bone.GetInt()];
+		}
+	}
+
+	for (const TPair<SmartName::UID_Type, float>& Curve : Harness->SourceCurves)
+	{
+		Output.Curve.Set(Curve.Key, Curve.Value);
+	}
+}
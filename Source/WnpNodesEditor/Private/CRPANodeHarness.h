@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AnimNode_CRPA.h"
+#include "UObject/GCObject.h"
+
+class FCRPANodeHarnessProxy;
+class UAnimInstance;
+class USkeletalMeshComponent;
+class USkeleton;
+
+/**
+ * One FAnimNode_CRPA driven outside of an anim graph, the way the graph drives it
+ * The node is initialized, has its bones cached, is updated and evaluated through FAnimNode_Base with a proxy whose
+ * required bones come from the skeleton. Pins are read from an anim instance of the given class and the source pose
+ * is set by the caller. Used by the CRPA replay commandlet and the CRPA automation tests.
+ */
+class FCRPANodeHarness : public FGCObject
+{
+public:
+	/** Runs a copy of InNode, null if the node has no rig class or the anim instance class can't hold its pins */
+	static TSharedPtr<FCRPANodeHarness> Create(const FAnimNode_CRPA& InNode, TSubclassOf<UAnimInstance> InAnimInstanceClass,
+	                                           USkeleton* InSkeleton);
+
+	/**
+	 * Runs a copy of InNode on the anim instance and proxy of InOther, like a second node of the same anim graph
+	 * Both read their pins from that instance and can share a rig. The LOD of either can't change, the other one
+	 * wouldn't cache its bones again.
+	 */
+	static TSharedPtr<FCRPANodeHarness> CreateInSameInstance(const FAnimNode_CRPA& InNode, FCRPANodeHarness& InOther);
+	virtual ~FCRPANodeHarness() override;
+
+	/** Set a node property from its exported text, like the details panel does */
+	static bool SetNodeProperty(FAnimNode_CRPA& InNode, const FName& InName, const TCHAR* InValue);
+	static bool SetNodeProperty(FAnimNode_CRPA& InNode, const FName& InName, UObject* InValue);
+
+	FAnimNode_CRPA& GetNode() { return Node; }
+	UControlRig* GetControlRig() const { return Node.ControlRig; }
+
+	/** Whether the node writes its pins with the bindings baked at compile time instead of resolving them by name */
+	bool UsesBakedBindings() const { return Node.bBakedBindingsValid; }
+
+	/** Instance the node reads its pins from */
+	UAnimInstance* GetAnimInstance() const { return AnimInstance; }
+
+	const FBoneContainer& GetRequiredBones() const;
+
+	/**
+	 * LOD the proxy reports from the next update. The bones are cached again then, like when a mesh changes LOD,
+	 * with InRequiredBones as the required bones, or every bone of the skeleton if it is empty
+	 */
+	void SetLODLevel(int32 InLODLevel, TArrayView<const FBoneIndexType> InRequiredBones = TArrayView<const FBoneIndexType>());
+
+	/** Source pose by compact pose bone index, the ref pose until set */
+	TArray<FTransform>& GetSourcePose() { return SourcePose; }
+
+	/** Curve set on the source pose, by skeleton curve UID */
+	void SetSourceCurve(SmartName::UID_Type InCurveUID, float InValue);
+
+	/** Blend alpha the node runs with from the next update, it replaces the alpha inputs and their scale and bias */
+	void SetAlpha(float InAlpha);
+
+	/**
+	 * Whether the mesh counts as recently rendered from the next update, on by default
+	 * The component has no world, so the harness decides it instead of the render time of the component.
+	 */
+	void SetRendered(bool bInRendered) { bRendered = bInRendered; }
+
+	/**
+	 * Game thread pre update then node update, bones are cached first when they changed
+	 * Updating a harness again advances GFrameCounter, so harnesses updated in turn share a frame like nodes of
+	 * one tick do and every round of updates is a new frame.
+	 */
+	void Update(float InDeltaTime);
+
+	/** Evaluate the node, the output is only valid inside InReadOutput */
+	void Evaluate(TFunctionRef<void(const FPoseContext& Output)> InReadOutput);
+
+	// FGCObject
+	virtual void AddReferencedObjects(FReferenceCollector& Collector) override;
+	virtual FString GetReferencerName() const override;
+
+private:
+	FCRPANodeHarness() = default;
+
+	static bool HasPins(const FAnimNode_CRPA& InNode, const UClass* InAnimInstanceClass);
+
+	/** Initialize a copy of InNode on the component, anim instance and proxy already set, false without a rig */
+	bool InitializeNode(const FAnimNode_CRPA& InNode);
+
+	void ResetSourcePose();
+
+	/** Source of the node under test, outputs the harness source pose */
+	struct FSourceNode : public FAnimNode_Base
+	{
+		const FCRPANodeHarness* Harness = nullptr;
+
+		virtual void Evaluate_AnyThread(FPoseContext& Output) override;
+	};
+
+	FAnimNode_CRPA Node;
+	FSourceNode SourceNode;
+
+	TSharedPtr<FCRPANodeHarnessProxy> Proxy;
+	FAnimationUpdateSharedContext SharedContext;
+
+	TObjectPtr<USkeletalMeshComponent> Component = nullptr;
+	TObjectPtr<UAnimInstance> AnimInstance = nullptr;
+	TObjectPtr<USkeleton> Skeleton = nullptr;
+
+	TArray<FTransform> SourcePose;
+	TArray<TPair<SmartName::UID_Type, float>> SourceCurves;
+
+	bool bCacheBonesPending = true;
+	bool bRendered = true;
+
+	uint64 LastUpdateFrame = MAX_uint64;
+};
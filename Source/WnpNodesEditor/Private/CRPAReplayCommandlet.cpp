@@ -0,0 +1,117 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAReplayCommandlet.h"
+#include "ControlRig.h"
+#include "CRPACapture.h"
+#include "CRPAHotPath.h"
+#include "CRPAReplayNode.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CRPAReplayCommandlet)
+
+UCRPAReplayCommandlet::UCRPAReplayCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UCRPAReplayCommandlet::Main(const FString& Params)
+{
+	FString Filename;
+	if (!FParse::Value(*Params, TEXT("File="), Filename))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Usage: -run=CRPAReplay -File=<capture.crpa> [-Loops=N] [-DetectAllocations [-WarmupFrames=N]]"));
+		return 1;
+	}
+
+	int32 NumLoops = 1;
+	FParse::Value(*Params, TEXT("Loops="), NumLoops);
+
+#if WITH_CRPA_HOT_PATH_CHECKS
+	// frames before tracking starts, the rig and its VM allocate their working memory on the first runs
+	const bool bDetectAllocations = FParse::Param(*Params, TEXT("DetectAllocations"));
+	int32 NumWarmupFrames = 30;
+	FParse::Value(*Params, TEXT("WarmupFrames="), NumWarmupFrames);
+#endif
+
+	int32 NumFrames = 0;
+	uint64 TotalCycles = 0;
+	uint64 MinCycles = MAX_uint64;
+	uint64 MaxCycles = 0;
+
+	for (int32 Loop = 0; Loop < FMath::Max(1, NumLoops); ++Loop)
+	{
+		TSharedPtr<FCRPACaptureReader> Reader = FCRPACaptureReader::Open(Filename);
+		if (!Reader.IsValid())
+		{
+			return 1;
+		}
+
+		TSharedPtr<FCRPAReplayNode> ReplayNode = FCRPAReplayNode::Create(*Reader);
+		if (!ReplayNode.IsValid())
+		{
+			return 1;
+		}
+
+		FCRPACaptureFrame Frame;
+		while (Reader->ReadFrame(Frame))
+		{
+			if (!ReplayNode->SyncNames(*Reader))
+			{
+				return 1;
+			}
+
+			// staging reads names back from the file, only what the node does with its inputs is timed
+			ReplayNode->SetInputs(Frame);
+
+#if WITH_CRPA_HOT_PATH_CHECKS
+			if (bDetectAllocations && Loop == 0 && NumFrames == NumWarmupFrames)
+			{
+				CRPAHotPath::StartTracking();
+			}
+#endif
+
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			ReplayNode->Run();
+
+			const uint64 FrameCycles = FPlatformTime::Cycles64() - StartCycles;
+			TotalCycles += FrameCycles;
+			MinCycles = FMath::Min(MinCycles, FrameCycles);
+			MaxCycles = FMath::Max(MaxCycles, FrameCycles);
+			++NumFrames;
+		}
+	}
+
+	if (NumFrames == 0)
+	{
+		UE_LOG(LogAnimation, Warning, TEXT("%s has no frames"), *Filename);
+		return 1;
+	}
+
+	UE_LOG(LogAnimation, Display, TEXT("CRPA replay of %s: %d frames, avg %.2f us, min %.2f us, max %.2f us"),
+	       *Filename, NumFrames,
+	       FPlatformTime::ToMilliseconds64(TotalCycles) * 1000.0 / NumFrames,
+	       FPlatformTime::ToMilliseconds64(MinCycles) * 1000.0,
+	       FPlatformTime::ToMilliseconds64(MaxCycles) * 1000.0);
+
+#if WITH_CRPA_HOT_PATH_CHECKS
+	if (bDetectAllocations)
+	{
+		if (NumFrames <= NumWarmupFrames)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("%s has %d frames, not enough to get past %d warm up frames"),
+			       *Filename, NumFrames, NumWarmupFrames);
+			return 1;
+		}
+
+		if (CRPAHotPath::StopTracking() > 0)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("CRPA replay of %s allocated in steady state"), *Filename);
+			return 1;
+		}
+	}
+#endif
+
+	return 0;
+}
@@ -0,0 +1,147 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAReplayNode.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/Skeleton.h"
+#include "CRPACapture.h"
+#include "CRPANodeHarness.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/NameAsStringProxyArchive.h"
+
+TSharedPtr<FCRPAReplayNode> FCRPAReplayNode::Create(const FCRPACaptureReader& InReader)
+{
+	const FCRPACaptureHeader& Header = InReader.Header;
+	UClass* AnimClass = LoadObject<UClass>(nullptr, *Header.AnimClassPath);
+	if (AnimClass == nullptr || !AnimClass->IsChildOf(UAnimInstance::StaticClass()))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to load anim class %s"), *Header.AnimClassPath);
+		return nullptr;
+	}
+
+	const FStructProperty* NodeProperty = FindFProperty<FStructProperty>(AnimClass, Header.NodePropertyName);
+	if (NodeProperty == nullptr || !NodeProperty->Struct->IsChildOf(FAnimNode_CRPA::StaticStruct()))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("%s has no CRPA node %s"), *Header.AnimClassPath,
+		       *Header.NodePropertyName.ToString());
+		return nullptr;
+	}
+
+	USkeleton* Skeleton = LoadObject<USkeleton>(nullptr, *Header.SkeletonPath);
+	if (Skeleton == nullptr)
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to load skeleton %s"), *Header.SkeletonPath);
+		return nullptr;
+	}
+
+	// the node as compiled into the class, before any instance touched it
+	const FAnimNode_CRPA* ClassNode = NodeProperty->ContainerPtrToValuePtr<FAnimNode_CRPA>(AnimClass->GetDefaultObject());
+
+	TSharedPtr<FCRPAReplayNode> ReplayNode(new FCRPAReplayNode());
+	ReplayNode->Harness = FCRPANodeHarness::Create(*ClassNode, AnimClass, Skeleton);
+	if (!ReplayNode->Harness.IsValid())
+	{
+		return nullptr;
+	}
+
+	ReplayNode->AnimClass = AnimClass;
+	ReplayNode->Skeleton = Skeleton;
+	return ReplayNode;
+}
+
+bool FCRPAReplayNode::SyncNames(const FCRPACaptureReader& InReader)
+{
+	// the captured bones are the required bones of the LOD they were captured at
+	if (InReader.bBoneNamesChanged)
+	{
+		const FReferenceSkeleton& RefSkeleton = Skeleton->GetReferenceSkeleton();
+		TArray<int32> SkeletonBoneIndices;
+		for (const FName& BoneName : InReader.BoneNames)
+		{
+			const int32 SkeletonBoneIndex = RefSkeleton.FindBoneIndex(BoneName);
+			if (SkeletonBoneIndex == INDEX_NONE)
+			{
+				UE_LOG(LogAnimation, Error, TEXT("%s has no bone %s, it doesn't match the capture"), *GetNameSafe(Skeleton),
+				       *BoneName.ToString());
+				return false;
+			}
+			SkeletonBoneIndices.Add(SkeletonBoneIndex);
+		}
+
+		TArray<FBoneIndexType> RequiredBones;
+		for (const int32 SkeletonBoneIndex : SkeletonBoneIndices)
+		{
+			RequiredBones.AddUnique(static_cast<FBoneIndexType>(SkeletonBoneIndex));
+		}
+		RequiredBones.Sort();
+		Harness->SetLODLevel(InReader.LODLevel, RequiredBones);
+
+		PoseBoneIndices.Reset(SkeletonBoneIndices.Num());
+		for (const int32 SkeletonBoneIndex : SkeletonBoneIndices)
+		{
+			PoseBoneIndices.Add(Harness->GetRequiredBones().MakeCompactPoseIndex(FMeshPoseBoneIndex(SkeletonBoneIndex)).GetInt());
+		}
+	}
+
+	if (InReader.bPinNamesChanged)
+	{
+		PinProperties.Reset(InReader.PinNames.Num());
+		for (const FName& PinName : InReader.PinNames)
+		{
+			const FProperty* PinProperty = AnimClass->FindPropertyByName(PinName);
+			if (PinProperty == nullptr)
+			{
+				UE_LOG(LogAnimation, Error, TEXT("%s has no pin %s, it doesn't match the capture"), *GetNameSafe(AnimClass),
+				       *PinName.ToString());
+				return false;
+			}
+			PinProperties.Add(PinProperty);
+		}
+	}
+
+	if (InReader.bInputCurvesChanged)
+	{
+		InputCurveUIDs.Reset(InReader.InputCurveVariableNames.Num());
+		for (const FName& VariableName : InReader.InputCurveVariableNames)
+		{
+			const FName CurveName = Harness->GetNode().GetIOMapping(true, VariableName);
+			InputCurveUIDs.Add(Skeleton->GetUIDByName(USkeleton::AnimCurveMappingName, CurveName));
+		}
+	}
+
+	return true;
+}
+
+void FCRPAReplayNode::SetInputs(const FCRPACaptureFrame& InFrame)
+{
+	TArray<FTransform>& SourcePose = Harness->GetSourcePose();
+	for (int32 Index = 0; Index < PoseBoneIndices.Num() && Index < InFrame.SourcePose.Num(); ++Index)
+	{
+		if (SourcePose.IsValidIndex(PoseBoneIndices[Index]))
+		{
+			SourcePose[PoseBoneIndices[Index]] = FTransform(InFrame.SourcePose[Index]);
+		}
+	}
+
+	for (int32 Index = 0; Index < InputCurveUIDs.Num() && Index < InFrame.InputCurves.Num(); ++Index)
+	{
+		if (InputCurveUIDs[Index] != SmartName::MaxUID)
+		{
+			Harness->SetSourceCurve(InputCurveUIDs[Index], InFrame.InputCurves[Index]);
+		}
+	}
+
+	FMemoryReader MemoryReader(InFrame.SourcePinData);
+	FNameAsStringProxyArchive PinArchive(MemoryReader);
+	CRPACapture::SerializeSourcePinValues(PinArchive, PinProperties, Harness->GetAnimInstance());
+
+	Harness->SetAlpha(InFrame.Alpha);
+	DeltaTime = InFrame.DeltaTime;
+}
+
+void FCRPAReplayNode::Run()
+{
+	Harness->Update(DeltaTime);
+	Harness->Evaluate([](const FPoseContext&)
+	{
+	});
+}
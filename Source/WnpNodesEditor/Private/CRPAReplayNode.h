@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/SmartName.h"
+
+class FCRPACaptureReader;
+class FCRPANodeHarness;
+class USkeleton;
+struct FCRPACaptureFrame;
+
+/**
+ * Copy of the CRPA node a capture was made with, run through its update and evaluate and fed with the capture frames
+ * The node comes from the anim class of the capture, its pins are written into an instance of that class
+ */
+class FCRPAReplayNode
+{
+public:
+	/** Null if the anim class, its node or the skeleton of the capture can't be loaded */
+	static TSharedPtr<FCRPAReplayNode> Create(const FCRPACaptureReader& InReader);
+
+	/** Resolve the names the reader just read, false if the anim class or the skeleton don't match the capture */
+	bool SyncNames(const FCRPACaptureReader& InReader);
+
+	/** Stage the source pose, curves, alpha and pins of InFrame for the next run */
+	void SetInputs(const FCRPACaptureFrame& InFrame);
+
+	/** Update and evaluate the node once, with the inputs staged last */
+	void Run();
+
+private:
+	FCRPAReplayNode() = default;
+
+	TSharedPtr<FCRPANodeHarness> Harness;
+	const UClass* AnimClass = nullptr;
+	const USkeleton* Skeleton = nullptr;
+
+	// compact pose bone of every captured bone
+	TArray<int32> PoseBoneIndices;
+	TArray<SmartName::UID_Type> InputCurveUIDs;
+	TArray<const FProperty*> PinProperties;
+
+	float DeltaTime = 0.f;
+};
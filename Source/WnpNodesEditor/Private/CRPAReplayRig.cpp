@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAReplayRig.h"
+#include "ControlRig.h"
+#include "CRPACapture.h"
+#include "Rigs/RigHierarchy.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/NameAsStringProxyArchive.h"
+
+TSharedPtr<FCRPAReplayRig> FCRPAReplayRig::Create(const FCRPACaptureReader& InReader)
+{
+	TSharedPtr<FCRPAReplayRig> ReplayRig(new FCRPAReplayRig());
+	if (!ReplayRig->CreateControlRig(InReader.Header.ControlRigClassPath))
+	{
+		return nullptr;
+	}
+	return ReplayRig;
+}
+
+FCRPAReplayRig::~FCRPAReplayRig()
+{
+	if (ControlRig)
+	{
+		ControlRig->MarkAsGarbage();
+	}
+}
+
+bool FCRPAReplayRig::CreateControlRig(const FString& InControlRigClassPath)
+{
+	UClass* ControlRigClass = LoadObject<UClass>(nullptr, *InControlRigClassPath);
+	if (ControlRigClass == nullptr || !ControlRigClass->IsChildOf(UControlRig::StaticClass()))
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Unable to load control rig class %s"), *InControlRigClassPath);
+		return false;
+	}
+
+	if (ControlRig)
+	{
+		ControlRig->MarkAsGarbage();
+	}
+
+	ControlRig = NewObject<UControlRig>(GetTransientPackage(), ControlRigClass, NAME_None, RF_Transient);
+	ControlRig->Initialize(true);
+	Hierarchy = ControlRig->GetHierarchy();
+	return true;
+}
+
+bool FCRPAReplayRig::SyncNames(const FCRPACaptureReader& InReader)
+{
+	// rig LODs can run another class, the names below are resolved against the new rig
+	const bool bRigChanged = InReader.bBindingsChanged &&
+		InReader.Header.ControlRigClassPath != GetPathNameSafe(ControlRig->GetClass());
+	if (bRigChanged && !CreateControlRig(InReader.Header.ControlRigClassPath))
+	{
+		return false;
+	}
+
+	if (InReader.bBoneNamesChanged || bRigChanged)
+	{
+		RigBoneIndices.Reset(InReader.BoneNames.Num());
+		for (const FName& BoneName : InReader.BoneNames)
+		{
+			RigBoneIndices.Add(Hierarchy->GetIndex(FRigElementKey(BoneName, ERigElementType::Bone)));
+		}
+	}
+
+	// the pin data can only be read back with the exact same bindings
+	if (InReader.bBindingsChanged)
+	{
+		Bindings.Reset();
+		VariableProperties.Reset();
+		for (const FName& BindingName : InReader.BindingNames)
+		{
+			FCRPABakedBinding Binding;
+			if (!CRPABindings::ResolveByName(ControlRig, BindingName, Binding))
+			{
+				UE_LOG(LogAnimation, Error, TEXT("[%s] can't resolve %s, the rig doesn't match the capture"),
+				       *GetNameSafe(ControlRig->GetClass()), *BindingName.ToString());
+				return false;
+			}
+
+			FCRPAResolvedBinding& Resolved = Bindings.AddDefaulted_GetRef();
+			Resolved.Name = BindingName;
+			Resolved.ControlIndex = Binding.ControlIndex;
+			Resolved.VariableOffset = Binding.VariableOffset;
+			Resolved.Type = Binding.Type;
+			Resolved.ControlType = Binding.ControlType;
+			VariableProperties.Add(Binding.Type == ECRPABindingType::Control
+				                       ? nullptr
+				                       : CRPABindings::FindVariableProperty(ControlRig, Binding.VariableOffset));
+		}
+	}
+
+	if (InReader.bInputCurvesChanged || bRigChanged)
+	{
+		InputCurveVariables.Reset();
+		for (const FName& VariableName : InReader.InputCurveVariableNames)
+		{
+			InputCurveVariables.Add(ControlRig->GetPublicVariableByName(VariableName));
+		}
+	}
+
+	return true;
+}
+
+void FCRPAReplayRig::SetInputs(const FCRPACaptureFrame& InFrame)
+{
+	for (int32 Index = 0; Index < RigBoneIndices.Num() && Index < InFrame.SourcePose.Num(); ++Index)
+	{
+		if (RigBoneIndices[Index] != INDEX_NONE)
+		{
+			Hierarchy->SetLocalTransform(RigBoneIndices[Index], FTransform(InFrame.SourcePose[Index]));
+		}
+	}
+
+	for (int32 Index = 0; Index < InputCurveVariables.Num() && Index < InFrame.InputCurves.Num(); ++Index)
+	{
+		FRigVMExternalVariable& Variable = InputCurveVariables[Index];
+		if (Variable.bIsReadOnly || !CRPABindings::IsCurveVariable(Variable))
+		{
+			continue;
+		}
+
+		if (Variable.Property->IsA<FDoubleProperty>())
+		{
+			Variable.SetValue<double>(InFrame.InputCurves[Index]);
+		}
+		else
+		{
+			Variable.SetValue<float>(InFrame.InputCurves[Index]);
+		}
+	}
+
+	FMemoryReader MemoryReader(InFrame.PinData);
+	FNameAsStringProxyArchive PinArchive(MemoryReader);
+	CRPACapture::SerializePinValues(PinArchive, Bindings, VariableProperties, ControlRig, Hierarchy);
+
+	ControlRig->SetDeltaTime(InFrame.DeltaTime);
+}
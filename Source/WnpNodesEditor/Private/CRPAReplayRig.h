@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CRPABindings.h"
+#include "RigVMCore/RigVMExternalVariable.h"
+
+class FCRPACaptureReader;
+struct FCRPACaptureFrame;
+class UControlRig;
+class URigHierarchy;
+
+/** Control rig instance fed with the frames of a CRPA capture, used by the commandlets */
+class FCRPAReplayRig
+{
+public:
+	/** New instance of the rig class the capture was made with, null if it can't be loaded */
+	static TSharedPtr<FCRPAReplayRig> Create(const FCRPACaptureReader& InReader);
+	~FCRPAReplayRig();
+
+	/** Resolve the names the reader just read against the rig, false if the rig doesn't match the capture */
+	bool SyncNames(const FCRPACaptureReader& InReader);
+
+	/** Write the source pose, curves and pins of InFrame into the rig */
+	void SetInputs(const FCRPACaptureFrame& InFrame);
+
+	UControlRig* GetControlRig() const { return ControlRig; }
+	URigHierarchy* GetHierarchy() const { return Hierarchy; }
+
+	/** Rig bone of every captured bone, INDEX_NONE for bones the rig doesn't have */
+	const TArray<int32>& GetRigBoneIndices() const { return RigBoneIndices; }
+
+private:
+	FCRPAReplayRig() = default;
+
+	// replaces the rig with a new instance of the class
+	bool CreateControlRig(const FString& InControlRigClassPath);
+
+	UControlRig* ControlRig = nullptr;
+	URigHierarchy* Hierarchy = nullptr;
+
+	TArray<int32> RigBoneIndices;
+	TArray<FCRPAResolvedBinding> Bindings;
+	TArray<const FProperty*> VariableProperties;
+	TArray<FRigVMExternalVariable> InputCurveVariables;
+};
@@ -0,0 +1,354 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPAVerifyCommandlet.h"
+#include "ControlRig.h"
+#include "CRPACapture.h"
+#include "CRPACurveControlMatrix.h"
+#include "CRPAPoseAtlas.h"
+#include "CRPAReplayRig.h"
+#include "Rigs/RigHierarchy.h"
+#include "Tasks/Task.h"
+#include "Tools/ControlRigPose.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CRPAVerifyCommandlet)
+
+namespace CRPAVerify
+{
+	// worst error of every element of one check, by element
+	struct FErrorReport
+	{
+		FString Check;
+		TArray<FName> Names;
+		TArray<double> MaxErrors;
+		int32 NumSamples = 0;
+
+		explicit FErrorReport(const TCHAR* InCheck)
+			: Check(InCheck)
+		{
+		}
+
+		void Add(int32 Index, const FName& Name, double Error)
+		{
+			if (Index >= MaxErrors.Num())
+			{
+				MaxErrors.SetNumZeroed(Index + 1);
+				Names.SetNum(Index + 1);
+			}
+			Names[Index] = Name;
+			MaxErrors[Index] = FMath::Max(MaxErrors[Index], Error);
+			++NumSamples;
+		}
+
+		// logs the worst elements, returns false if any is above the tolerance
+		bool Log(double Tolerance) const
+		{
+			TArray<int32> Order;
+			for (int32 Index = 0; Index < MaxErrors.Num(); ++Index)
+			{
+				Order.Add(Index);
+			}
+			Order.Sort([this](int32 A, int32 B) { return MaxErrors[A] > MaxErrors[B]; });
+
+			const double MaxError = Order.Num() > 0 ? MaxErrors[Order[0]] : 0.0;
+			const bool bPassed = MaxError <= Tolerance;
+			UE_LOG(LogAnimation, Display, TEXT("%s %s: %d samples, max error %g"), *Check,
+			       bPassed ? TEXT("passed") : TEXT("FAILED"), NumSamples, MaxError);
+
+			for (int32 Rank = 0; Rank < Order.Num() && Rank < 10 && MaxErrors[Order[Rank]] > 0.0; ++Rank)
+			{
+				UE_LOG(LogAnimation, Display, TEXT("    %s: %g"), *Names[Order[Rank]].ToString(), MaxErrors[Order[Rank]]);
+			}
+			return bPassed;
+		}
+	};
+
+	// translation and scale distance, rotation angle in radians
+	static double TransformError(const FTransform& A, const FTransform& B)
+	{
+		return FMath::Max3(FVector::Dist(A.GetTranslation(), B.GetTranslation()),
+		                   A.GetRotation().AngularDistance(B.GetRotation()),
+		                   FVector::Dist(A.GetScale3D(), B.GetScale3D()));
+	}
+
+	// what FAnimationRuntime::BlendTwoPosesTogether does for one bone, atlas poses are blended that way
+	static FTransform ReferenceLerp(const FTransform& Source, const FTransform& Target, float Alpha)
+	{
+		FTransform Result = Source * ScalarRegister(1.f - Alpha);
+		Result.AccumulateWithShortestRotation(Target, ScalarRegister(Alpha));
+		Result.NormalizeRotation();
+		return Result;
+	}
+
+	static void ReadRigPose(const FCRPAReplayRig& ReplayRig, const TArray<FTransform>& InSourcePose,
+	                        TArray<FTransform>& OutPose)
+	{
+		const TArray<int32>& RigBoneIndices = ReplayRig.GetRigBoneIndices();
+		OutPose = InSourcePose;
+		for (int32 Index = 0; Index < RigBoneIndices.Num() && Index < OutPose.Num(); ++Index)
+		{
+			if (RigBoneIndices[Index] != INDEX_NONE)
+			{
+				OutPose[Index] = ReplayRig.GetHierarchy()->GetLocalTransform(RigBoneIndices[Index]);
+			}
+		}
+	}
+
+	static bool VerifyCapture(const FString& Filename, double Tolerance)
+	{
+		TSharedPtr<FCRPACaptureReader> Reader = FCRPACaptureReader::Open(Filename);
+		if (!Reader.IsValid())
+		{
+			return false;
+		}
+
+		// the reference rig, a second instance fed the same inputs and one evaluated in a task
+		// any difference means the result depends on something the inputs don't capture
+		TSharedPtr<FCRPAReplayRig> ReferenceRig = FCRPAReplayRig::Create(*Reader);
+		TSharedPtr<FCRPAReplayRig> RepeatRig = FCRPAReplayRig::Create(*Reader);
+		TSharedPtr<FCRPAReplayRig> TaskRig = FCRPAReplayRig::Create(*Reader);
+		if (!ReferenceRig.IsValid() || !RepeatRig.IsValid() || !TaskRig.IsValid())
+		{
+			return false;
+		}
+
+		FErrorReport RepeatReport(TEXT("Second rig instance on the same inputs"));
+		FErrorReport TaskReport(TEXT("Rig evaluated in a task"));
+
+		TArray<FTransform> SourcePose;
+		TArray<FTransform> ReferencePose;
+		TArray<FTransform> OtherPose;
+
+		FCRPACaptureFrame Frame;
+		int32 NumFrames = 0;
+		while (Reader->ReadFrame(Frame))
+		{
+			if (!ReferenceRig->SyncNames(*Reader) || !RepeatRig->SyncNames(*Reader) || !TaskRig->SyncNames(*Reader))
+			{
+				return false;
+			}
+			++NumFrames;
+
+			SourcePose.Reset(Frame.SourcePose.Num());
+			for (const FTransform3f& Transform : Frame.SourcePose)
+			{
+				SourcePose.Add(FTransform(Transform));
+			}
+			const TArray<FName>& BoneNames = Reader->BoneNames;
+			const int32 NumBones = FMath::Min(SourcePose.Num(), BoneNames.Num());
+
+			ReferenceRig->SetInputs(Frame);
+			ReferenceRig->GetControlRig()->Evaluate_AnyThread();
+			ReadRigPose(*ReferenceRig, SourcePose, ReferencePose);
+
+			// the rigs keep their own state, so they are all fed every frame
+			RepeatRig->SetInputs(Frame);
+			RepeatRig->GetControlRig()->Evaluate_AnyThread();
+			ReadRigPose(*RepeatRig, SourcePose, OtherPose);
+			for (int32 Bone = 0; Bone < NumBones; ++Bone)
+			{
+				RepeatReport.Add(Bone, BoneNames[Bone], TransformError(ReferencePose[Bone], OtherPose[Bone]));
+			}
+
+			UControlRig* TaskControlRig = TaskRig->GetControlRig();
+			TaskRig->SetInputs(Frame);
+			UE::Tasks::Launch(UE_SOURCE_LOCATION, [TaskControlRig]()
+			{
+				TaskControlRig->Evaluate_AnyThread();
+			}).Wait();
+			ReadRigPose(*TaskRig, SourcePose, OtherPose);
+			for (int32 Bone = 0; Bone < NumBones; ++Bone)
+			{
+				TaskReport.Add(Bone, BoneNames[Bone], TransformError(ReferencePose[Bone], OtherPose[Bone]));
+			}
+		}
+
+		if (NumFrames == 0)
+		{
+			UE_LOG(LogAnimation, Warning, TEXT("%s has no frames"), *Filename);
+			return false;
+		}
+
+		bool bPassed = RepeatReport.Log(Tolerance);
+		bPassed &= TaskReport.Log(Tolerance);
+		return bPassed;
+	}
+
+	static bool VerifyAtlas(const UCRPAPoseAtlas* Atlas, int32 NumSamples, FRandomStream& Random, double Tolerance)
+	{
+		// the source transforms of every pose, read the way the atlas was built
+		const TArray<FName>& ControlNames = Atlas->GetControlNames();
+		const TArray<ERigControlType>& ControlTypes = Atlas->GetControlTypes();
+		const UControlRigPoseAsset* Neutral = Atlas->NeutralPose.LoadSynchronous();
+
+		TArray<TArray<FTransform>> SourcePoses;
+		for (const TSoftObjectPtr<UControlRigPoseAsset>& SourcePose : Atlas->SourcePoses)
+		{
+			const UControlRigPoseAsset* Pose = SourcePose.LoadSynchronous();
+			if (Pose == nullptr)
+			{
+				continue;
+			}
+
+			TArray<FTransform>& Transforms = SourcePoses.AddDefaulted_GetRef();
+			for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+			{
+				const FRigControlCopy* ControlCopy = nullptr;
+				for (const UControlRigPoseAsset* Candidate : {Pose, Neutral})
+				{
+					const int32* Index = Candidate ? Candidate->Pose.CopyOfControlsNameToIndex.Find(ControlNames[Control]) : nullptr;
+					if (Index && ControlCopy == nullptr)
+					{
+						ControlCopy = &Candidate->Pose.CopyOfControls[*Index];
+					}
+				}
+				Transforms.Add(ControlCopy
+					               ? ControlCopy->Value.GetAsTransform(ControlTypes[Control], ERigControlAxis::X)
+					               : FTransform::Identity);
+			}
+		}
+
+		if (SourcePoses.Num() != Atlas->GetNumPoses())
+		{
+			UE_LOG(LogAnimation, Error, TEXT("%s has %d poses for %d source poses, it needs a rebuild"),
+			       *GetNameSafe(Atlas), Atlas->GetNumPoses(), SourcePoses.Num());
+			return false;
+		}
+
+		FErrorReport PoseReport(TEXT("Atlas poses"));
+		FErrorReport BlendReport(TEXT("Atlas pose blends"));
+		TArray<FTransform> Transforms;
+		for (int32 Pose = 0; Pose < SourcePoses.Num(); ++Pose)
+		{
+			Atlas->EvaluatePose(Pose, INDEX_NONE, 0.f, Transforms);
+			for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+			{
+				PoseReport.Add(Control, ControlNames[Control], TransformError(SourcePoses[Pose][Control], Transforms[Control]));
+			}
+		}
+
+		for (int32 Sample = 0; Sample < NumSamples && SourcePoses.Num() > 0; ++Sample)
+		{
+			const int32 Pose = Random.RandHelper(SourcePoses.Num());
+			const int32 BlendPose = Random.RandHelper(SourcePoses.Num());
+			const float Blend = Random.FRand();
+			Atlas->EvaluatePose(Pose, BlendPose, Blend, Transforms);
+			for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+			{
+				const FTransform Expected = ReferenceLerp(SourcePoses[Pose][Control], SourcePoses[BlendPose][Control], Blend);
+				BlendReport.Add(Control, ControlNames[Control], TransformError(Expected, Transforms[Control]));
+			}
+		}
+
+		bool bPassed = PoseReport.Log(Tolerance);
+		bPassed &= BlendReport.Log(Tolerance);
+		return bPassed;
+	}
+
+	static bool VerifyMatrix(const UCRPACurveControlMatrix* Matrix, int32 NumSamples, FRandomStream& Random,
+	                         double Tolerance)
+	{
+		const TArray<FName>& InputCurves = Matrix->GetInputCurves();
+		const TArray<FName>& ChannelControls = Matrix->GetChannelControls();
+		const TArray<ECRPAControlChannel>& Channels = Matrix->GetChannels();
+
+		FErrorReport Report(TEXT("Curve control matrix"));
+		TArray<float> Inputs;
+		TArray<float> Outputs;
+		TArray<double> Expected;
+		for (int32 Sample = 0; Sample < NumSamples; ++Sample)
+		{
+			Inputs.SetNumZeroed(Matrix->GetInputStride());
+			for (int32 Input = 0; Input < InputCurves.Num(); ++Input)
+			{
+				Inputs[Input] = Random.FRandRange(-1.f, 1.f);
+			}
+			Outputs.SetNumUninitialized(Matrix->GetNumChannels());
+			Matrix->Multiply(Inputs.GetData(), Outputs.GetData());
+
+			// straight from the authored weights, duplicated entries add up
+			Expected.SetNumZeroed(Channels.Num());
+			for (const FCRPACurveControlWeight& Weight : Matrix->Weights)
+			{
+				const int32 Input = InputCurves.IndexOfByKey(Weight.Curve);
+				for (int32 Channel = 0; Channel < Channels.Num() && Input != INDEX_NONE; ++Channel)
+				{
+					if (ChannelControls[Channel] == Weight.Control && Channels[Channel] == Weight.Channel)
+					{
+						Expected[Channel] += (double)Weight.Weight * Inputs[Input];
+					}
+				}
+			}
+
+			for (int32 Channel = 0; Channel < Channels.Num(); ++Channel)
+			{
+				const FName Name(*FString::Printf(TEXT("%s.%s"), *ChannelControls[Channel].ToString(),
+				                                  *StaticEnum<ECRPAControlChannel>()->GetNameStringByValue((int64)Channels[Channel])));
+				Report.Add(Channel, Name, FMath::Abs(Expected[Channel] - Outputs[Channel]));
+			}
+		}
+
+		return Report.Log(Tolerance);
+	}
+}
+
+UCRPAVerifyCommandlet::UCRPAVerifyCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UCRPAVerifyCommandlet::Main(const FString& Params)
+{
+	FString Filename;
+	FString AtlasPath;
+	FString MatrixPath;
+	FParse::Value(*Params, TEXT("File="), Filename);
+	FParse::Value(*Params, TEXT("Atlas="), AtlasPath);
+	FParse::Value(*Params, TEXT("Matrix="), MatrixPath);
+	if (Filename.IsEmpty() && AtlasPath.IsEmpty() && MatrixPath.IsEmpty())
+	{
+		UE_LOG(LogAnimation, Error, TEXT("Usage: -run=CRPAVerify [-File=<capture.crpa>] [-Atlas=<asset>] [-Matrix=<asset>] [-Samples=N] [-Seed=N] [-Tolerance=T]"));
+		return 1;
+	}
+
+	int32 NumSamples = 16;
+	int32 Seed = 0;
+	double Tolerance = 1e-4;
+	FParse::Value(*Params, TEXT("Samples="), NumSamples);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("Tolerance="), Tolerance);
+
+	FRandomStream Random(Seed);
+	bool bPassed = true;
+
+	if (!Filename.IsEmpty())
+	{
+		bPassed &= CRPAVerify::VerifyCapture(Filename, Tolerance);
+	}
+
+	if (!AtlasPath.IsEmpty())
+	{
+		const UCRPAPoseAtlas* Atlas = LoadObject<UCRPAPoseAtlas>(nullptr, *AtlasPath);
+		if (Atlas == nullptr)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("Unable to load pose atlas %s"), *AtlasPath);
+			return 1;
+		}
+		bPassed &= CRPAVerify::VerifyAtlas(Atlas, NumSamples, Random, Tolerance);
+	}
+
+	if (!MatrixPath.IsEmpty())
+	{
+		const UCRPACurveControlMatrix* Matrix = LoadObject<UCRPACurveControlMatrix>(nullptr, *MatrixPath);
+		if (Matrix == nullptr)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("Unable to load curve control matrix %s"), *MatrixPath);
+			return 1;
+		}
+		bPassed &= CRPAVerify::VerifyMatrix(Matrix, NumSamples, Random, Tolerance);
+	}
+
+	return bPassed ? 0 : 1;
+}
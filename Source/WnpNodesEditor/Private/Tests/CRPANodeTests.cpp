@@ -0,0 +1,1075 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "AnimationRuntime.h"
+#include "Animation/AnimSequence.h"
+#include "CRPABake.h"
+#include "CRPABindings.h"
+#include "ControlRig.h"
+#include "CRPACurveControlMatrix.h"
+#include "CRPAHotPath.h"
+#include "CRPANodeHarness.h"
+#include "CRPAPoseAtlas.h"
+#include "CRPAScalability.h"
+#include "CRPATestFixture.h"
+#include "Engine/SkeletalMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+#include "Rigs/RigHierarchyController.h"
+#include "Tools/ControlRigPose.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace CRPANodeTests
+{
+	static constexpr float DeltaTime = 1.f / 30.f;
+	static constexpr double Tolerance = 1.e-4;
+
+	struct FFixture
+	{
+		USkeletalMesh* SkeletalMesh = nullptr;
+		UClass* ControlRigClass = nullptr;
+
+		bool Create(FAutomationTestBase& Test)
+		{
+			SkeletalMesh = CRPATestFixture::CreateSkeletalMesh();
+			ControlRigClass = CRPATestFixture::CreateControlRigClass(SkeletalMesh->GetSkeleton());
+			return Test.TestNotNull(TEXT("Test rig"), ControlRigClass);
+		}
+
+		// InSetup changes the settings of the node before it is initialized
+		TSharedPtr<FCRPANodeHarness> MakeHarness(FAutomationTestBase& Test,
+		                                         TFunctionRef<void(FAnimNode_CRPA& Node)> InSetup) const
+		{
+			FAnimNode_CRPA Node = CRPATestFixture::MakeNode(ControlRigClass);
+			InSetup(Node);
+			TSharedPtr<FCRPANodeHarness> Harness = FCRPANodeHarness::Create(Node, UCRPATestAnimInstance::StaticClass(),
+			                                                                SkeletalMesh->GetSkeleton());
+			Test.TestTrue(TEXT("Node harness created"), Harness.IsValid());
+			return Harness;
+		}
+
+		// second node of the anim instance of InOther
+		TSharedPtr<FCRPANodeHarness> MakeHarnessInSameInstance(FAutomationTestBase& Test, FCRPANodeHarness& InOther,
+		                                                       TFunctionRef<void(FAnimNode_CRPA& Node)> InSetup) const
+		{
+			FAnimNode_CRPA Node = CRPATestFixture::MakeNode(ControlRigClass);
+			InSetup(Node);
+			TSharedPtr<FCRPANodeHarness> Harness = FCRPANodeHarness::CreateInSameInstance(Node, InOther);
+			Test.TestTrue(TEXT("Node harness created in the same instance"), Harness.IsValid());
+			return Harness;
+		}
+
+		TSharedPtr<FCRPANodeHarness> MakeReference(FAutomationTestBase& Test) const
+		{
+			return MakeHarness(Test, [](FAnimNode_CRPA&) {});
+		}
+	};
+
+	// int console variable set for the lifetime of the scope
+	struct FScopedConsoleVariable
+	{
+		IConsoleVariable* Variable;
+		int32 PreviousValue;
+
+		FScopedConsoleVariable(const TCHAR* InName, int32 InValue)
+			: Variable(IConsoleManager::Get().FindConsoleVariable(InName))
+			, PreviousValue(Variable ? Variable->GetInt() : 0)
+		{
+			if (Variable)
+			{
+				Variable->Set(InValue, ECVF_SetByCode);
+			}
+		}
+
+		~FScopedConsoleVariable()
+		{
+			if (Variable)
+			{
+				Variable->Set(PreviousValue, ECVF_SetByCode);
+			}
+		}
+	};
+
+	// update and evaluate with the inputs already staged
+	static void RunFrame(FCRPANodeHarness& Harness, TArray<FTransform>& OutPose)
+	{
+		Harness.Update(DeltaTime);
+		Harness.Evaluate([&OutPose](const FPoseContext& Output)
+		{
+			OutPose.Reset();
+			for (const FCompactPoseBoneIndex Bone : Output.Pose.ForEachBoneIndex())
+			{
+				OutPose.Add(Output.Pose[Bone]);
+			}
+		});
+	}
+
+	static void RunFrame(FCRPANodeHarness& Harness, int32 InFrame, TArray<FTransform>& OutPose)
+	{
+		CRPATestFixture::SetInputs(Harness, InFrame);
+		RunFrame(Harness, OutPose);
+	}
+
+	// source pose with every bone moved by a random offset, different for every frame
+	static void RandomizeSourcePose(FCRPANodeHarness& Harness, const TArray<FTransform>& InRefPose, int32 InFrame)
+	{
+		FRandomStream Random = CRPATestFixture::MakeFrameRandom(InFrame, 1);
+		TArray<FTransform>& SourcePose = Harness.GetSourcePose();
+		for (int32 Bone = 0; Bone < SourcePose.Num() && Bone < InRefPose.Num(); ++Bone)
+		{
+			SourcePose[Bone] = FTransform(FRotator(Random.FRandRange(-10., 10.), Random.FRandRange(-10., 10.), 0.),
+			                              InRefPose[Bone].GetTranslation() + Random.VRand(), FVector(1.));
+		}
+	}
+
+	// worst difference of every bone over a run, translation and scale distance or rotation angle in radians
+	struct FBoneErrors
+	{
+		TArray<double> MaxErrors;
+		TArray<int32> WorstFrames;
+
+		void Add(int32 InFrame, const TArray<FTransform>& A, const TArray<FTransform>& B)
+		{
+			const int32 NumBones = FMath::Max(A.Num(), B.Num());
+			if (MaxErrors.Num() < NumBones)
+			{
+				MaxErrors.SetNumZeroed(NumBones);
+				WorstFrames.SetNumZeroed(NumBones);
+			}
+
+			for (int32 Bone = 0; Bone < NumBones; ++Bone)
+			{
+				const double Error = Bone >= A.Num() || Bone >= B.Num() ? MAX_dbl : FMath::Max3(
+					FVector::Dist(A[Bone].GetTranslation(), B[Bone].GetTranslation()),
+					A[Bone].GetRotation().AngularDistance(B[Bone].GetRotation()),
+					FVector::Dist(A[Bone].GetScale3D(), B[Bone].GetScale3D()));
+				if (Error > MaxErrors[Bone])
+				{
+					MaxErrors[Bone] = Error;
+					WorstFrames[Bone] = InFrame;
+				}
+			}
+		}
+
+		// every bone is logged, the ones over the tolerance are errors
+		bool Report(FAutomationTestBase& Test, const TCHAR* What, const FBoneContainer& RequiredBones) const
+		{
+			const FReferenceSkeleton& RefSkeleton = RequiredBones.GetReferenceSkeleton();
+			bool bPassed = true;
+			for (int32 Bone = 0; Bone < MaxErrors.Num(); ++Bone)
+			{
+				const FName BoneName = Bone < RequiredBones.GetCompactPoseNumBones()
+					                       ? RefSkeleton.GetBoneName(
+						                       RequiredBones.MakeMeshPoseIndex(FCompactPoseBoneIndex(Bone)).GetInt())
+					                       : NAME_None;
+				const FString Message = FString::Printf(TEXT("%s: bone %s max error %g at frame %d (input seed %d)"), What,
+				                                        *BoneName.ToString(), MaxErrors[Bone], WorstFrames[Bone],
+				                                        CRPATestFixture::InputSeed);
+				if (MaxErrors[Bone] > Tolerance)
+				{
+					Test.AddError(Message);
+					bPassed = false;
+				}
+				else
+				{
+					Test.AddInfo(Message);
+				}
+			}
+			return bPassed;
+		}
+	};
+
+	// both nodes get the inputs of InputFrame(Frame) every frame and have to output the same pose
+	static bool RunAndCompare(FAutomationTestBase& Test, const TCHAR* What, FCRPANodeHarness& Harness,
+	                          FCRPANodeHarness& Reference, int32 NumFrames,
+	                          TFunctionRef<int32(int32 Frame)> InputFrame = [](int32 Frame) { return Frame; })
+	{
+		TArray<FTransform> Pose;
+		TArray<FTransform> ReferencePose;
+		FBoneErrors Errors;
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			RunFrame(Harness, InputFrame(Frame), Pose);
+			RunFrame(Reference, InputFrame(Frame), ReferencePose);
+			Errors.Add(InputFrame(Frame), Pose, ReferencePose);
+		}
+		return Errors.Report(Test, What, Reference.GetRequiredBones());
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeBakedBindingsTest, "CRPA.Node.BakedBindings",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeBakedBindingsTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// baked like the anim BP compile does, against the class default rig
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [&Fixture](FAnimNode_CRPA& Node)
+	{
+		Node.BakeBindings(Fixture.ControlRigClass->GetDefaultObject<UControlRig>());
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	TestTrue(TEXT("Baked bindings used"), Harness->UsesBakedBindings());
+	TestFalse(TEXT("Reference resolves by name"), Reference->UsesBakedBindings());
+	return CRPANodeTests::RunAndCompare(*this, TEXT("Baked bindings"), *Harness, *Reference, 60);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPABindingsRigHashTest, "CRPA.Bindings.RigHash",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPABindingsRigHashTest::RunTest(const FString& Parameters)
+{
+	URigHierarchy* Hierarchy = NewObject<URigHierarchy>(GetTransientPackage(), NAME_None, RF_Transient);
+	URigHierarchyController* Controller = Hierarchy->GetController(true);
+	if (!TestNotNull(TEXT("Hierarchy controller"), Controller))
+	{
+		return false;
+	}
+
+	auto AddControl = [Controller](const TCHAR* InName, ERigControlType InControlType)
+	{
+		FRigControlSettings Settings;
+		Settings.ControlType = InControlType;
+		Settings.SetupLimitArrayForType(false, false, false);
+		const FRigControlValue Value = InControlType == ERigControlType::Bool
+			                               ? FRigControlValue::Make<bool>(false)
+			                               : FRigControlValue::Make<float>(0.f);
+		Controller->AddControl(InName, FRigElementKey(), Settings, Value, FTransform::Identity, FTransform::Identity,
+		                       false);
+	};
+	AddControl(TEXT("jaw_weight"), ERigControlType::Float);
+	AddControl(TEXT("eye_open"), ERigControlType::Bool);
+	AddControl(TEXT("brow_2"), ERigControlType::Float);
+
+	// the hash is saved with the anim BP, a cooked game or the next editor session has to compute the same value.
+	// Native rig classes don't add anything to it.
+	const uint32 Hash = CRPABindings::ComputeRigHash(Hierarchy, UControlRig::StaticClass());
+	TestTrue(FString::Printf(TEXT("Rig hash %08x matches the saved value"), Hash), Hash == 0xeddb9a6a);
+
+	Hierarchy->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeAffectedBonesTest, "CRPA.Node.AffectedBones",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeAffectedBonesTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// probed like the anim BP compile does, eye_l only moves once the EyeWeight variable is off its default of 0
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [&Fixture](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("bRestrictToAffectedBones"), TEXT("True"));
+		Node.BakeAffectedBones(Fixture.ControlRigClass);
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	return CRPANodeTests::RunAndCompare(*this, TEXT("Restricted to affected bones"), *Harness, *Reference, 60);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodePartialAlphaTest, "CRPA.Node.PartialAlpha",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodePartialAlphaTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// the whole pose goes through the engine, a node restricted to its affected bones blends bone by bone
+	for (const bool bRestrict : {false, true})
+	{
+		TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [&Fixture, bRestrict](FAnimNode_CRPA& Node)
+		{
+			if (bRestrict)
+			{
+				FCRPANodeHarness::SetNodeProperty(Node, TEXT("bRestrictToAffectedBones"), TEXT("True"));
+				Node.BakeAffectedBones(Fixture.ControlRigClass);
+			}
+		});
+		TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+		if (!Harness.IsValid() || !Reference.IsValid())
+		{
+			return false;
+		}
+
+		// the base node makes the full weight result additive to the source pose and accumulates it with the alpha.
+		// Alphas of 0 and 1 are mixed in, they skip the rig and take the full weight path.
+		TArray<FTransform> Pose;
+		TArray<FTransform> FullPose;
+		CRPANodeTests::FBoneErrors Errors;
+		for (int32 Frame = 0; Frame < 60; ++Frame)
+		{
+			FRandomStream Random = CRPATestFixture::MakeFrameRandom(Frame, 2);
+			const float Alpha = Random.RandHelper(4) == 0 ? static_cast<float>(Random.RandHelper(2)) : Random.FRand();
+			Harness->SetAlpha(Alpha);
+
+			CRPANodeTests::RunFrame(*Harness, Frame, Pose);
+			CRPANodeTests::RunFrame(*Reference, Frame, FullPose);
+
+			const TArray<FTransform>& SourcePose = Reference->GetSourcePose();
+			TArray<FTransform> ExpectedPose = SourcePose;
+			for (int32 Bone = 0; Bone < ExpectedPose.Num() && Bone < FullPose.Num(); ++Bone)
+			{
+				FTransform Additive = FullPose[Bone];
+				FAnimationRuntime::ConvertTransformToAdditive(Additive, SourcePose[Bone]);
+				FTransform::BlendFromIdentityAndAccumulate(ExpectedPose[Bone], Additive, ScalarRegister(Alpha));
+				ExpectedPose[Bone].NormalizeRotation();
+			}
+			Errors.Add(Frame, Pose, ExpectedPose);
+		}
+
+		if (!Errors.Report(*this, bRestrict ? TEXT("Partial alpha on the affected bones") : TEXT("Partial alpha"),
+		                   Reference->GetRequiredBones()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeChangedControlsTest, "CRPA.Node.ChangedControls",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeChangedControlsTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("bOnlyWriteChangedControls"), TEXT("True"));
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// pins hold for three frames, so most frames write nothing
+	return CRPANodeTests::RunAndCompare(*this, TEXT("Changed controls only"), *Harness, *Reference, 90,
+	                                    [](int32 Frame) { return Frame / 3; });
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeSharedOutputTest, "CRPA.Node.SharedOutput",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeSharedOutputTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	auto ShareOutput = [](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("bShareOutput"), TEXT("True"));
+	};
+	TSharedPtr<FCRPANodeHarness> First = Fixture.MakeHarness(*this, ShareOutput);
+	TSharedPtr<FCRPANodeHarness> Second = Fixture.MakeHarness(*this, ShareOutput);
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	TSharedPtr<FCRPANodeHarness> SecondReference = Fixture.MakeReference(*this);
+	if (!First.IsValid() || !Second.IsValid() || !Reference.IsValid() || !SecondReference.IsValid())
+	{
+		return false;
+	}
+
+	// inputs repeat every 30 frames, from the second cycle on both nodes read results the other one stored
+	for (int32 Cycle = 0; Cycle < 3; ++Cycle)
+	{
+		if (!CRPANodeTests::RunAndCompare(*this, TEXT("First shared node"), *First, *Reference, 30) ||
+			!CRPANodeTests::RunAndCompare(*this, TEXT("Second shared node"), *Second, *SecondReference, 30))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeBoneSetCacheTest, "CRPA.Node.BoneSetCache",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeBoneSetCacheTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeReference(*this);
+	if (!Harness.IsValid())
+	{
+		return false;
+	}
+
+	// every bone, then without eye_r, then every bone again from the cache, each compared with a node that only saw it
+	static const FBoneIndexType AllBones[] = {0, 1, 2, 3, 4, 5};
+	static const FBoneIndexType WithoutEyeR[] = {0, 1, 2, 3, 4};
+	const TArrayView<const FBoneIndexType> BoneSets[] = {AllBones, WithoutEyeR, AllBones, WithoutEyeR};
+	for (int32 Switch = 0; Switch < UE_ARRAY_COUNT(BoneSets); ++Switch)
+	{
+		Harness->SetLODLevel(Switch % 2, BoneSets[Switch]);
+
+		TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+		if (!Reference.IsValid())
+		{
+			return false;
+		}
+		Reference->SetLODLevel(Switch % 2, BoneSets[Switch]);
+
+		if (!CRPANodeTests::RunAndCompare(*this, *FString::Printf(TEXT("Bone set %d"), Switch), *Harness, *Reference, 10))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeRigLODTest, "CRPA.Node.RigLOD",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeRigLODTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// a second instance of the same class from LOD 1, without a blend the output can't tell them apart
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [&Fixture](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("RigLODs"), *FString::Printf(
+			                                  TEXT("((ControlRigClass=\"%s\",MinLOD=1))"),
+			                                  *Fixture.ControlRigClass->GetPathName()));
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("RigLODBlendTime"), TEXT("0.0"));
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// random LOD switches, some of them to the LOD already set
+	FRandomStream Random(CRPATestFixture::InputSeed);
+	for (int32 Switch = 0; Switch < 8; ++Switch)
+	{
+		const int32 LODLevel = Random.RandHelper(2);
+		Harness->SetLODLevel(LODLevel);
+		Reference->SetLODLevel(LODLevel);
+		if (!CRPANodeTests::RunAndCompare(*this, *FString::Printf(TEXT("Rig LOD switch %d to LOD %d"), Switch, LODLevel),
+		                                  *Harness, *Reference, 10, [Switch](int32 Frame) { return Switch * 10 + Frame; }))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeBakedLODTest, "CRPA.Node.BakedLOD",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeBakedLODTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// without an atlas or a pose asset the bake holds the rig output for the initial controls
+	CRPABake::FSettings Settings;
+	Settings.ControlRigClass = Fixture.ControlRigClass;
+	Settings.SkeletalMesh = Fixture.SkeletalMesh;
+	Settings.PackageName = TEXT("/Temp/CRPATests/CRPATestBake");
+	UAnimSequence* BakedSequence = CRPABake::BakeSequence(Settings);
+	if (!TestNotNull(TEXT("Baked sequence"), BakedSequence))
+	{
+		return false;
+	}
+	BakedSequence->CacheDerivedDataForCurrentPlatform();
+	ON_SCOPE_EXIT
+	{
+		BakedSequence->ClearFlags(RF_Public | RF_Standalone);
+		BakedSequence->MarkAsGarbage();
+	};
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [BakedSequence](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("BakedSequence"), BakedSequence);
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("BakedLOD"), TEXT("1"));
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// the reference runs the rig at LOD 0 on the pins the bake used, the class defaults match the initial controls
+	Harness->SetLODLevel(1);
+	TArray<FTransform> Pose;
+	TArray<FTransform> ReferencePose;
+	CRPANodeTests::FBoneErrors Errors;
+	for (int32 Frame = 0; Frame < 3; ++Frame)
+	{
+		CRPANodeTests::RunFrame(*Harness, Pose);
+		CRPANodeTests::RunFrame(*Reference, ReferencePose);
+		Errors.Add(Frame, Pose, ReferencePose);
+	}
+	Errors.Report(*this, TEXT("Baked LOD on the ref pose"), Reference->GetRequiredBones());
+
+	// on an animated source pose, what the rig changed from the ref pose is added on top of the source
+	const TArray<FTransform> RefPose = Harness->GetSourcePose();
+	TArray<FTransform>& SourcePose = Harness->GetSourcePose();
+	for (int32 Bone = 1; Bone < SourcePose.Num(); ++Bone)
+	{
+		SourcePose[Bone] = FTransform(FRotator(5. * Bone, 0., -3. * Bone), SourcePose[Bone].GetTranslation() +
+		                              FVector(1., 0., 2.), FVector(1.));
+	}
+
+	TArray<FTransform> ExpectedPose = SourcePose;
+	for (int32 Bone = 0; Bone < ExpectedPose.Num() && Bone < ReferencePose.Num(); ++Bone)
+	{
+		FTransform Delta = ReferencePose[Bone];
+		FAnimationRuntime::ConvertTransformToAdditive(Delta, RefPose[Bone]);
+		FTransform::BlendFromIdentityAndAccumulate(ExpectedPose[Bone], Delta, ScalarRegister(1.f));
+		ExpectedPose[Bone].NormalizeRotation();
+	}
+
+	CRPANodeTests::RunFrame(*Harness, Pose);
+	CRPANodeTests::FBoneErrors AnimatedErrors;
+	AnimatedErrors.Add(3, Pose, ExpectedPose);
+	AnimatedErrors.Report(*this, TEXT("Baked LOD on an animated source"), Harness->GetRequiredBones());
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeNotRenderedTest, "CRPA.Node.NotRendered",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeNotRenderedTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// Hidden goes off screen after 10 frames, Late starts off screen and comes into view after 10 frames
+	TSharedPtr<FCRPANodeHarness> Hidden = Fixture.MakeReference(*this);
+	TSharedPtr<FCRPANodeHarness> Late = Fixture.MakeReference(*this);
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Hidden.IsValid() || !Late.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// off screen a node keeps its last result, or the source pose before it has one
+	TArray<FTransform> HiddenPose;
+	TArray<FTransform> LatePose;
+	TArray<FTransform> ReferencePose;
+	TArray<FTransform> LastRenderedPose;
+	CRPANodeTests::FBoneErrors HiddenErrors;
+	CRPANodeTests::FBoneErrors LateErrors;
+	for (int32 Frame = 0; Frame < 30; ++Frame)
+	{
+		const bool bHiddenRendered = Frame < 10 || Frame >= 20;
+		Hidden->SetRendered(bHiddenRendered);
+		Late->SetRendered(Frame >= 10);
+
+		CRPANodeTests::RunFrame(*Hidden, Frame, HiddenPose);
+		CRPANodeTests::RunFrame(*Late, Frame, LatePose);
+		CRPANodeTests::RunFrame(*Reference, Frame, ReferencePose);
+
+		if (bHiddenRendered)
+		{
+			LastRenderedPose = ReferencePose;
+		}
+		HiddenErrors.Add(Frame, HiddenPose, LastRenderedPose);
+		LateErrors.Add(Frame, LatePose, Frame >= 10 ? ReferencePose : Late->GetSourcePose());
+	}
+
+	const bool bHiddenPassed = HiddenErrors.Report(*this, TEXT("Off screen after a result"), Reference->GetRequiredBones());
+	const bool bLatePassed = LateErrors.Report(*this, TEXT("Off screen from the start"), Reference->GetRequiredBones());
+	return bHiddenPassed && bLatePassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeAsyncTest, "CRPA.Node.Async",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeAsyncTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("bEvaluateAsync"), TEXT("True"));
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// a task outputs the frame before, the first frame and the first after the alpha skipped the node run in place
+	static constexpr int32 FirstSkippedFrame = 20;
+	static constexpr int32 FirstResumedFrame = 22;
+	TArray<FTransform> Pose;
+	TArray<FTransform> ReferencePose;
+	TArray<FTransform> PreviousReferencePose;
+	CRPANodeTests::FBoneErrors Errors;
+	for (int32 Frame = 0; Frame < 40; ++Frame)
+	{
+		const bool bSkipped = Frame >= FirstSkippedFrame && Frame < FirstResumedFrame;
+		Harness->SetAlpha(bSkipped ? 0.f : 1.f);
+
+		CRPANodeTests::RunFrame(*Harness, Frame, Pose);
+		CRPANodeTests::RunFrame(*Reference, Frame, ReferencePose);
+
+		if (bSkipped)
+		{
+			Errors.Add(Frame, Pose, Harness->GetSourcePose());
+		}
+		else
+		{
+			const bool bInPlace = Frame == 0 || Frame == FirstResumedFrame;
+			Errors.Add(Frame, Pose, bInPlace ? ReferencePose : PreviousReferencePose);
+		}
+		PreviousReferencePose = ReferencePose;
+	}
+	return Errors.Report(*this, TEXT("Async evaluation"), Reference->GetRequiredBones());
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeRigSharingTest, "CRPA.Node.RigSharing",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeRigSharingTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// First writes the pins, Second only reads the rig, both of one anim instance
+	TSharedPtr<FCRPANodeHarness> First = Fixture.MakeHarness(*this, [](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("RigSharingGroup"), TEXT("Face"));
+	});
+	if (!First.IsValid())
+	{
+		return false;
+	}
+	TSharedPtr<FCRPANodeHarness> Second = Fixture.MakeHarnessInSameInstance(*this, *First, [](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("RigSharingGroup"), TEXT("Face"));
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("SourcePropertyNames"), TEXT("()"));
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("DestPropertyNames"), TEXT("()"));
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	TSharedPtr<FCRPANodeHarness> SecondReference = Fixture.MakeReference(*this);
+	if (!Second.IsValid() || !Reference.IsValid() || !SecondReference.IsValid())
+	{
+		return false;
+	}
+
+	TestTrue(TEXT("Nodes of the group share a rig"), First->GetControlRig() == Second->GetControlRig());
+
+	// on random frames the second node gets another source pose, the rig runs again for it with the first node's pins
+	const TArray<FTransform> RefPose = Second->GetSourcePose();
+	TArray<FTransform> Pose;
+	TArray<FTransform> SecondPose;
+	TArray<FTransform> ReferencePose;
+	TArray<FTransform> SecondReferencePose;
+	CRPANodeTests::FBoneErrors Errors;
+	CRPANodeTests::FBoneErrors SecondErrors;
+	for (int32 Frame = 0; Frame < 60; ++Frame)
+	{
+		if (CRPATestFixture::MakeFrameRandom(Frame, 3).RandHelper(2) == 0)
+		{
+			CRPANodeTests::RandomizeSourcePose(*Second, RefPose, Frame);
+			CRPANodeTests::RandomizeSourcePose(*SecondReference, RefPose, Frame);
+		}
+		else
+		{
+			Second->GetSourcePose() = RefPose;
+			SecondReference->GetSourcePose() = RefPose;
+		}
+
+		CRPANodeTests::RunFrame(*First, Frame, Pose);
+		CRPANodeTests::RunFrame(*Second, Frame, SecondPose);
+		CRPANodeTests::RunFrame(*Reference, Frame, ReferencePose);
+		CRPANodeTests::RunFrame(*SecondReference, Frame, SecondReferencePose);
+
+		Errors.Add(Frame, Pose, ReferencePose);
+		SecondErrors.Add(Frame, SecondPose, SecondReferencePose);
+	}
+
+	const bool bFirstPassed = Errors.Report(*this, TEXT("Node writing the shared rig"), Reference->GetRequiredBones());
+	const bool bSecondPassed = SecondErrors.Report(*this, TEXT("Node reading the shared rig"),
+	                                               SecondReference->GetRequiredBones());
+	return bFirstPassed && bSecondPassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeRateDivisorTest, "CRPA.Node.RateDivisor",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeRateDivisorTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeReference(*this);
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// only the node under test runs at the reduced rate, the reference runs every frame
+	static constexpr int32 RateDivisor = 3;
+	TArray<FTransform> Pose;
+	TArray<FTransform> ReferencePose;
+	TArray<FTransform> LastEvaluatedPose;
+	CRPANodeTests::FBoneErrors Errors;
+	int32 NumEvaluated = 0;
+	for (int32 Frame = 0; Frame < 60; ++Frame)
+	{
+		bool bEvaluationFrame;
+		{
+			CRPANodeTests::FScopedConsoleVariable ScopedRateDivisor(TEXT("a.CRPA.RateDivisor"), RateDivisor);
+			if (!TestNotNull(TEXT("a.CRPA.RateDivisor"), ScopedRateDivisor.Variable))
+			{
+				return false;
+			}
+			CRPANodeTests::RunFrame(*Harness, Frame, Pose);
+			bEvaluationFrame = Frame == 0 || CRPAScalability::IsEvaluationFrame(PointerHash(&Harness->GetNode()));
+		}
+		CRPANodeTests::RunFrame(*Reference, Frame, ReferencePose);
+
+		if (bEvaluationFrame)
+		{
+			LastEvaluatedPose = ReferencePose;
+			++NumEvaluated;
+		}
+		Errors.Add(Frame, Pose, LastEvaluatedPose);
+	}
+
+	TestTrue(FString::Printf(TEXT("Rig ran on %d of 60 frames at rate divisor %d"), NumEvaluated, RateDivisor),
+	         NumEvaluated >= 60 / RateDivisor && NumEvaluated <= 60 / RateDivisor + 1);
+	return Errors.Report(*this, TEXT("Reduced rate"), Reference->GetRequiredBones());
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeEvaluationBudgetTest, "CRPA.Node.EvaluationBudget",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeEvaluationBudgetTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Nodes[] = {Fixture.MakeReference(*this), Fixture.MakeReference(*this)};
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Nodes[0].IsValid() || !Nodes[1].IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// one evaluation per frame for two nodes taking turns to go first, each runs its rig every other frame.
+	// The first frame runs both, a node without a result ignores the budget.
+	TArray<FTransform> Poses[2];
+	TArray<FTransform> ReferencePose;
+	TArray<FTransform> LastEvaluatedPoses[2];
+	CRPANodeTests::FBoneErrors Errors[2];
+	for (int32 Frame = 0; Frame < 40; ++Frame)
+	{
+		const int32 FirstNode = Frame % 2;
+		{
+			CRPANodeTests::FScopedConsoleVariable ScopedBudget(TEXT("a.CRPA.MaxEvaluationsPerFrame"), 1);
+			if (!TestNotNull(TEXT("a.CRPA.MaxEvaluationsPerFrame"), ScopedBudget.Variable))
+			{
+				return false;
+			}
+			CRPANodeTests::RunFrame(*Nodes[FirstNode], Frame, Poses[FirstNode]);
+			CRPANodeTests::RunFrame(*Nodes[1 - FirstNode], Frame, Poses[1 - FirstNode]);
+		}
+		CRPANodeTests::RunFrame(*Reference, Frame, ReferencePose);
+
+		for (int32 Node = 0; Node < 2; ++Node)
+		{
+			if (Frame == 0 || Node == FirstNode)
+			{
+				LastEvaluatedPoses[Node] = ReferencePose;
+			}
+			Errors[Node].Add(Frame, Poses[Node], LastEvaluatedPoses[Node]);
+		}
+	}
+
+	const bool bFirstPassed = Errors[0].Report(*this, TEXT("Budgeted node 0"), Reference->GetRequiredBones());
+	const bool bSecondPassed = Errors[1].Report(*this, TEXT("Budgeted node 1"), Reference->GetRequiredBones());
+	return bFirstPassed && bSecondPassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodePoseAtlasTest, "CRPA.Node.PoseAtlas",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodePoseAtlasTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// two poses saved from a rig instance, like the pose library does
+	UControlRig* PoseRig = NewObject<UControlRig>(GetTransientPackage(), Fixture.ControlRigClass, NAME_None, RF_Transient);
+	PoseRig->Initialize(true);
+	URigHierarchy* PoseHierarchy = PoseRig->GetHierarchy();
+	auto SavePose = [PoseHierarchy, PoseRig](const FTransform& InJaw, float InJawWeight, const FTransform& InEye)
+	{
+		auto SetControl = [PoseHierarchy](const FName& InControl, const FRigControlValue& InValue)
+		{
+			PoseHierarchy->SetControlValue(FRigElementKey(InControl, ERigElementType::Control), InValue,
+			                               ERigControlValueType::Current);
+		};
+		SetControl(CRPATestFixture::JawControl, FRigControlValue::Make<FTransform_Float>(InJaw));
+		SetControl(CRPATestFixture::JawWeightControl, FRigControlValue::Make<float>(InJawWeight));
+		SetControl(CRPATestFixture::EyeControl, FRigControlValue::Make<FTransform_Float>(InEye));
+
+		UControlRigPoseAsset* Pose = NewObject<UControlRigPoseAsset>(GetTransientPackage(), MakeUniqueObjectName(
+			                                                             GetTransientPackage(),
+			                                                             UControlRigPoseAsset::StaticClass(),
+			                                                             TEXT("CRPATestPose")), RF_Transient);
+		Pose->SavePose(PoseRig, true);
+		return Pose;
+	};
+
+	UCRPAPoseAtlas* Atlas = NewObject<UCRPAPoseAtlas>(GetTransientPackage(), NAME_None, RF_Transient);
+	Atlas->SourcePoses.Emplace(SavePose(FTransform(FRotator(0., 0., 20.), FVector(0., 5., 1.)), 0.8f,
+	                                FTransform(FRotator(8., -15., 0.), FVector(-3., 8., 8.))));
+	Atlas->SourcePoses.Emplace(SavePose(FTransform(FRotator(0., 0., -25.), FVector(0., 4., 2.)), 0.3f,
+	                                FTransform(FRotator(-6., 12., 0.), FVector(-3., 8., 8.))));
+	Atlas->Build();
+	if (!TestEqual(TEXT("Atlas poses"), Atlas->GetNumPoses(), 2) ||
+		!TestEqual(TEXT("Atlas controls"), Atlas->GetNumControls(), 3))
+	{
+		return false;
+	}
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [Atlas](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("PoseAtlas"), Atlas);
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// the atlas overrides every pin, so the reference gets the atlas pose on its pins
+	const TArray<FName>& ControlNames = Atlas->GetControlNames();
+	TArray<FTransform> Pose;
+	TArray<FTransform> ReferencePose;
+	TArray<FTransform> AtlasTransforms;
+	CRPANodeTests::FBoneErrors Errors;
+	for (int32 Frame = 0; Frame < 60; ++Frame)
+	{
+		FRandomStream Random = CRPATestFixture::MakeFrameRandom(Frame, 4);
+		const int32 PoseIndex = Random.RandHelper(2);
+		const int32 BlendPoseIndex = Random.RandHelper(3) - 1;
+		const float PoseBlend = Random.FRand();
+		FAnimNode_CRPA& Node = Harness->GetNode();
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("PoseIndex"), *FString::FromInt(PoseIndex));
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("BlendPoseIndex"), *FString::FromInt(BlendPoseIndex));
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("PoseBlend"), *FString::SanitizeFloat(PoseBlend));
+
+		CRPANodeTests::RunFrame(*Harness, Frame, Pose);
+
+		CRPATestFixture::SetInputs(*Reference, Frame);
+		Atlas->EvaluatePose(PoseIndex, BlendPoseIndex, PoseBlend, AtlasTransforms);
+		UCRPATestAnimInstance* AnimInstance = CastChecked<UCRPATestAnimInstance>(Reference->GetAnimInstance());
+		for (int32 Control = 0; Control < ControlNames.Num(); ++Control)
+		{
+			if (ControlNames[Control] == CRPATestFixture::JawControl)
+			{
+				AnimInstance->JawControl = AtlasTransforms[Control];
+			}
+			else if (ControlNames[Control] == CRPATestFixture::JawWeightControl)
+			{
+				AnimInstance->JawWeight = static_cast<float>(AtlasTransforms[Control].GetTranslation().X);
+			}
+			else if (ControlNames[Control] == CRPATestFixture::EyeControl)
+			{
+				AnimInstance->EyeControl = AtlasTransforms[Control];
+			}
+		}
+		CRPANodeTests::RunFrame(*Reference, ReferencePose);
+
+		Errors.Add(Frame, Pose, ReferencePose);
+	}
+	return Errors.Report(*this, TEXT("Pose atlas"), Reference->GetRequiredBones());
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeCurveControlMatrixTest, "CRPA.Node.CurveControlMatrix",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeCurveControlMatrixTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// the EyeWeight curve also drives the jaw, over its pins
+	static constexpr float JawWeightScale = -0.6f;
+	static constexpr float JawDrop = 2.f;
+	static constexpr float JawRoll = 25.f;
+	UCRPACurveControlMatrix* Matrix = NewObject<UCRPACurveControlMatrix>(GetTransientPackage(), NAME_None, RF_Transient);
+	auto AddWeight = [Matrix](const FName& InControl, ECRPAControlChannel InChannel, float InWeight)
+	{
+		FCRPACurveControlWeight& Weight = Matrix->Weights.AddDefaulted_GetRef();
+		Weight.Curve = CRPATestFixture::EyeWeightCurve;
+		Weight.Control = InControl;
+		Weight.Channel = InChannel;
+		Weight.Weight = InWeight;
+	};
+	AddWeight(CRPATestFixture::JawWeightControl, ECRPAControlChannel::TranslationX, JawWeightScale);
+	AddWeight(CRPATestFixture::JawControl, ECRPAControlChannel::TranslationZ, JawDrop);
+	AddWeight(CRPATestFixture::JawControl, ECRPAControlChannel::RotationRoll, JawRoll);
+	Matrix->Build();
+
+	TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [Matrix](FAnimNode_CRPA& Node)
+	{
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("CurveControlMatrix"), Matrix);
+	});
+	TSharedPtr<FCRPANodeHarness> Reference = Fixture.MakeReference(*this);
+	if (!Harness.IsValid() || !Reference.IsValid())
+	{
+		return false;
+	}
+
+	// every channel is the initial value of its control plus the weighted curve, the jaw controls start at identity and 1
+	const USkeleton* Skeleton = Reference->GetRequiredBones().GetSkeletonAsset();
+	const SmartName::UID_Type EyeWeightUID = Skeleton->GetUIDByName(USkeleton::AnimCurveMappingName,
+	                                                                CRPATestFixture::EyeWeightCurve);
+	TArray<FTransform> Pose;
+	TArray<FTransform> ReferencePose;
+	CRPANodeTests::FBoneErrors Errors;
+	for (int32 Frame = 0; Frame < 60; ++Frame)
+	{
+		const float EyeWeight = CRPATestFixture::MakeFrameRandom(Frame, 5).FRand();
+		CRPATestFixture::SetInputs(*Harness, Frame);
+		Harness->SetSourceCurve(EyeWeightUID, EyeWeight);
+		CRPANodeTests::RunFrame(*Harness, Pose);
+
+		CRPATestFixture::SetInputs(*Reference, Frame);
+		Reference->SetSourceCurve(EyeWeightUID, EyeWeight);
+		UCRPATestAnimInstance* AnimInstance = CastChecked<UCRPATestAnimInstance>(Reference->GetAnimInstance());
+		AnimInstance->JawWeight = 1.f + JawWeightScale * EyeWeight;
+		AnimInstance->JawControl = FEulerTransform(FVector(0., 0., JawDrop * EyeWeight),
+		                                           FRotator(0., 0., JawRoll * EyeWeight), FVector(1.)).ToFTransform();
+		CRPANodeTests::RunFrame(*Reference, ReferencePose);
+
+		Errors.Add(Frame, Pose, ReferencePose);
+	}
+	return Errors.Report(*this, TEXT("Curve control matrix"), Reference->GetRequiredBones());
+}
+
+#if WITH_CRPA_HOT_PATH_CHECKS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FCRPANodeHotPathTest, "CRPA.Node.HotPath",
+                                 EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FCRPANodeHotPathTest::RunTest(const FString& Parameters)
+{
+	CRPANodeTests::FFixture Fixture;
+	if (!Fixture.Create(*this))
+	{
+		return false;
+	}
+
+	// the rig VM and the node caches allocate their working memory on the first frames, inputs repeat every 30 frames
+	static constexpr int32 NumWarmupFrames = 60;
+	static constexpr int32 NumTrackedFrames = 120;
+
+	struct FSetting
+	{
+		const TCHAR* Name;
+		const TCHAR* Value;
+	};
+	static const FSetting Settings[] = {
+		{TEXT("Alpha"), TEXT("1.0")},
+		{TEXT("Alpha"), TEXT("0.5")},
+		{TEXT("bOnlyWriteChangedControls"), TEXT("True")},
+		{TEXT("bShareOutput"), TEXT("True")},
+	};
+
+	for (const FSetting& Setting : Settings)
+	{
+		TSharedPtr<FCRPANodeHarness> Harness = Fixture.MakeHarness(*this, [&Setting](FAnimNode_CRPA& Node)
+		{
+			FCRPANodeHarness::SetNodeProperty(Node, Setting.Name, Setting.Value);
+		});
+		if (!Harness.IsValid())
+		{
+			return false;
+		}
+
+		TArray<FTransform> Pose;
+		for (int32 Frame = 0; Frame < NumWarmupFrames; ++Frame)
+		{
+			CRPANodeTests::RunFrame(*Harness, Frame % 30, Pose);
+		}
+
+		CRPAHotPath::StartTracking();
+		for (int32 Frame = NumWarmupFrames; Frame < NumWarmupFrames + NumTrackedFrames; ++Frame)
+		{
+			CRPANodeTests::RunFrame(*Harness, Frame % 30, Pose);
+		}
+
+		TestEqual(FString::Printf(TEXT("Allocations in node update and evaluate with %s=%s"), Setting.Name, Setting.Value),
+		          CRPAHotPath::StopTracking(), 0);
+	}
+
+	return true;
+}
+
+#endif
+
+#endif
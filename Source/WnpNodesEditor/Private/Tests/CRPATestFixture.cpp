@@ -0,0 +1,179 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CRPATestFixture.h"
+#include "Animation/Skeleton.h"
+#include "ControlRig.h"
+#include "ControlRigBlueprint.h"
+#include "ControlRigBlueprintGeneratedClass.h"
+#include "CRPANodeHarness.h"
+#include "Engine/SkeletalMesh.h"
+#include "Kismet2/KismetEditorUtilities.h"
+#include "ReferenceSkeleton.h"
+#include "RigVMModel/RigVMController.h"
+#include "Rigs/RigHierarchyController.h"
+#include "Units/Execution/RigUnit_BeginExecution.h"
+#include "Units/Hierarchy/RigUnit_GetControlTransform.h"
+#include "Units/Hierarchy/RigUnit_GetTransform.h"
+#include "Units/Hierarchy/RigUnit_SetTransform.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CRPATestFixture)
+
+namespace CRPATestFixture
+{
+	const FName JawBone(TEXT("jaw"));
+	const FName EyeBone(TEXT("eye_l"));
+	const FName EyeWeightCurve(TEXT("EyeWeight"));
+
+	const FName JawControl(TEXT("jaw_ctrl"));
+	const FName JawWeightControl(TEXT("jaw_weight"));
+	const FName EyeControl(TEXT("eye_ctrl"));
+
+	const int32 InputSeed = 0x43525041;
+
+	USkeletalMesh* CreateSkeletalMesh()
+	{
+		struct FBone
+		{
+			const TCHAR* Name;
+			int32 Parent;
+			FVector Location;
+		};
+		static const FBone Bones[] = {
+			{TEXT("root"), INDEX_NONE, FVector::ZeroVector},
+			{TEXT("spine"), 0, FVector(0., 0., 100.)},
+			{TEXT("head"), 1, FVector(0., 0., 50.)},
+			{TEXT("jaw"), 2, FVector(0., 5., 2.)},
+			{TEXT("eye_l"), 2, FVector(-3., 8., 8.)},
+			{TEXT("eye_r"), 2, FVector(3., 8., 8.)},
+		};
+
+		USkeletalMesh* SkeletalMesh = NewObject<USkeletalMesh>(GetTransientPackage(), NAME_None, RF_Transient);
+		{
+			FReferenceSkeletonModifier Modifier(SkeletalMesh->GetRefSkeleton(), nullptr);
+			for (const FBone& Bone : Bones)
+			{
+				Modifier.Add(FMeshBoneInfo(Bone.Name, Bone.Name, Bone.Parent), FTransform(Bone.Location));
+			}
+		}
+
+		// the bone tree is filled from the mesh like on import, sampling a sequence reads it
+		USkeleton* Skeleton = NewObject<USkeleton>(GetTransientPackage(), NAME_None, RF_Transient);
+		Skeleton->MergeAllBonesToBoneTree(SkeletalMesh);
+		SkeletalMesh->SetSkeleton(Skeleton);
+
+		FSmartName CurveName;
+		Skeleton->AddSmartNameAndModify(USkeleton::AnimCurveMappingName, EyeWeightCurve, CurveName);
+		return SkeletalMesh;
+	}
+
+	UClass* CreateControlRigClass(const USkeleton* InSkeleton)
+	{
+		UControlRigBlueprint* Blueprint = CastChecked<UControlRigBlueprint>(FKismetEditorUtilities::CreateBlueprint(
+			UControlRig::StaticClass(), GetTransientPackage(), MakeUniqueObjectName(GetTransientPackage(),
+				UControlRigBlueprint::StaticClass(), TEXT("CRPATestRig")), BPTYPE_Normal,
+			UControlRigBlueprint::StaticClass(), UControlRigBlueprintGeneratedClass::StaticClass()));
+
+		URigHierarchyController* HierarchyController = Blueprint->GetHierarchyController();
+		HierarchyController->ImportBones(InSkeleton->GetReferenceSkeleton(), NAME_None, false, false, false, false);
+
+		FRigControlSettings TransformSettings;
+		TransformSettings.ControlType = ERigControlType::Transform;
+		TransformSettings.SetupLimitArrayForType(false, false, false);
+		HierarchyController->AddControl(JawControl, FRigElementKey(), TransformSettings,
+		                                FRigControlValue::Make<FTransform_Float>(FTransform::Identity),
+		                                FTransform::Identity, FTransform::Identity, false);
+		HierarchyController->AddControl(EyeControl, FRigElementKey(), TransformSettings,
+		                                FRigControlValue::Make<FTransform_Float>(FTransform::Identity),
+		                                FTransform::Identity, FTransform::Identity, false);
+
+		FRigControlSettings FloatSettings;
+		FloatSettings.ControlType = ERigControlType::Float;
+		FloatSettings.SetupLimitArrayForType(false, false, false);
+		HierarchyController->AddControl(JawWeightControl, FRigElementKey(), FloatSettings,
+		                                FRigControlValue::Make<float>(1.f), FTransform::Identity, FTransform::Identity,
+		                                false);
+
+		Blueprint->AddMemberVariable(EyeWeightCurve, TEXT("float"), true, false);
+
+		// begin > set jaw from jaw_ctrl weighted by jaw_weight > set eye_l from eye_ctrl weighted by EyeWeight
+		URigVMController* Controller = Blueprint->GetController();
+		URigVMNode* Begin = Controller->AddUnitNode(FRigUnit_BeginExecution::StaticStruct(), TEXT("Execute"),
+		                                            FVector2D::ZeroVector, FString(), false);
+		FString ExecutePin = Begin->FindPin(TEXT("ExecuteContext"))->GetPinPath();
+
+		auto AddSetBone = [&](const FName& InBone, const FName& InControl, const FString& InWeightPin)
+		{
+			URigVMNode* GetControl = Controller->AddUnitNode(FRigUnit_GetTransform::StaticStruct(), TEXT("Execute"),
+			                                                 FVector2D::ZeroVector, FString(), false);
+			Controller->SetPinDefaultValue(GetControl->FindPin(TEXT("Item"))->GetPinPath(),
+			                               FString::Printf(TEXT("(Type=Control,Name=\"%s\")"), *InControl.ToString()),
+			                               true, false);
+			Controller->SetPinDefaultValue(GetControl->FindPin(TEXT("Space"))->GetPinPath(), TEXT("LocalSpace"), true,
+			                               false);
+
+			URigVMNode* SetBone = Controller->AddUnitNode(FRigUnit_SetTransform::StaticStruct(), TEXT("Execute"),
+			                                              FVector2D::ZeroVector, FString(), false);
+			Controller->SetPinDefaultValue(SetBone->FindPin(TEXT("Item"))->GetPinPath(),
+			                               FString::Printf(TEXT("(Type=Bone,Name=\"%s\")"), *InBone.ToString()),
+			                               true, false);
+			Controller->SetPinDefaultValue(SetBone->FindPin(TEXT("Space"))->GetPinPath(), TEXT("LocalSpace"), true,
+			                               false);
+
+			Controller->AddLink(ExecutePin, SetBone->FindPin(TEXT("ExecuteContext"))->GetPinPath(), false);
+			Controller->AddLink(GetControl->FindPin(TEXT("Transform"))->GetPinPath(),
+			                    SetBone->FindPin(TEXT("Value"))->GetPinPath(), false);
+			Controller->AddLink(InWeightPin, SetBone->FindPin(TEXT("Weight"))->GetPinPath(), false);
+			ExecutePin = SetBone->FindPin(TEXT("ExecuteContext"))->GetPinPath();
+		};
+
+		URigVMNode* GetJawWeight = Controller->AddUnitNode(FRigUnit_GetControlFloat::StaticStruct(), TEXT("Execute"),
+		                                                   FVector2D::ZeroVector, FString(), false);
+		Controller->SetPinDefaultValue(GetJawWeight->FindPin(TEXT("Control"))->GetPinPath(),
+		                               JawWeightControl.ToString(), true, false);
+		AddSetBone(JawBone, JawControl, GetJawWeight->FindPin(TEXT("FloatValue"))->GetPinPath());
+
+		URigVMNode* GetEyeWeight = Controller->AddVariableNode(EyeWeightCurve, TEXT("float"), nullptr, true, FString(),
+		                                                       FVector2D::ZeroVector, FString(), false);
+		AddSetBone(EyeBone, EyeControl, GetEyeWeight->FindPin(TEXT("Value"))->GetPinPath());
+
+		FKismetEditorUtilities::CompileBlueprint(Blueprint);
+		if (Blueprint->Status == BS_Error || Blueprint->GeneratedClass == nullptr)
+		{
+			UE_LOG(LogAnimation, Error, TEXT("CRPA test rig failed to compile"));
+			return nullptr;
+		}
+		return Blueprint->GeneratedClass;
+	}
+
+	FAnimNode_CRPA MakeNode(UClass* InControlRigClass)
+	{
+		FAnimNode_CRPA Node;
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("ControlRigClass"), InControlRigClass);
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("SourcePropertyNames"),
+		                                  TEXT("(\"JawControl\",\"JawWeight\",\"EyeControl\")"));
+		FCRPANodeHarness::SetNodeProperty(Node, TEXT("DestPropertyNames"),
+		                                  *FString::Printf(TEXT("(\"%s\",\"%s\",\"%s\")"), *JawControl.ToString(),
+		                                                   *JawWeightControl.ToString(), *EyeControl.ToString()));
+		Node.SetIOMapping(true, EyeWeightCurve, EyeWeightCurve);
+		return Node;
+	}
+
+	FRandomStream MakeFrameRandom(int32 InFrame, uint32 InStream)
+	{
+		return FRandomStream(static_cast<int32>(HashCombine(HashCombine(InputSeed, InStream), GetTypeHash(InFrame))));
+	}
+
+	void SetInputs(FCRPANodeHarness& InHarness, int32 InFrame)
+	{
+		FRandomStream Random = MakeFrameRandom(InFrame);
+		UCRPATestAnimInstance* AnimInstance = CastChecked<UCRPATestAnimInstance>(InHarness.GetAnimInstance());
+		AnimInstance->JawControl = FTransform(FRotator(0., 0., Random.FRandRange(-30., 30.)),
+		                                      FVector(0., 5., Random.FRandRange(1., 2.)));
+		AnimInstance->JawWeight = Random.FRandRange(0.25f, 1.f);
+		AnimInstance->EyeControl = FTransform(FRotator(Random.FRandRange(-10., 10.), Random.FRandRange(-20., 20.), 0.),
+		                                      FVector(-3., 8., 8.));
+
+		const USkeleton* Skeleton = InHarness.GetRequiredBones().GetSkeletonAsset();
+		InHarness.SetSourceCurve(Skeleton->GetUIDByName(USkeleton::AnimCurveMappingName, EyeWeightCurve), Random.FRand());
+	}
+}
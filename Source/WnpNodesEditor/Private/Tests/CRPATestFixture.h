@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "AnimNode_CRPA.h"
+#include "CRPATestFixture.generated.h"
+
+class FCRPANodeHarness;
+class USkeletalMesh;
+class USkeleton;
+
+/** Anim instance holding the pins of the CRPA test node */
+UCLASS(Transient, HideDropdown, NotBlueprintable)
+class UCRPATestAnimInstance : public UAnimInstance
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	FTransform JawControl;
+
+	UPROPERTY()
+	float JawWeight = 1.f;
+
+	UPROPERTY()
+	FTransform EyeControl;
+};
+
+/**
+ * Assets generated for the CRPA automation tests, nothing is loaded from disk
+ * The rig sets the jaw from the jaw_ctrl control weighted by the jaw_weight control,
+ * and eye_l from the eye_ctrl control weighted by the EyeWeight variable, which the node maps from the EyeWeight curve
+ */
+namespace CRPATestFixture
+{
+	extern const FName JawBone;
+	extern const FName EyeBone;
+	extern const FName EyeWeightCurve;
+
+	extern const FName JawControl;
+	extern const FName JawWeightControl;
+	extern const FName EyeControl;
+
+	/** Seed of every generated input, failing tests report it */
+	extern const int32 InputSeed;
+
+	/** Mesh without render data, its skeleton is root > spine > head > jaw, eye_l, eye_r with the EyeWeight curve */
+	USkeletalMesh* CreateSkeletalMesh();
+
+	/** Generated class of a new transient rig blueprint, null if it failed to compile */
+	UClass* CreateControlRigClass(const USkeleton* InSkeleton);
+
+	/** Node running InControlRigClass, with its pins bound to UCRPATestAnimInstance and its input curve mapped */
+	FAnimNode_CRPA MakeNode(UClass* InControlRigClass);
+
+	/** Random values of a frame, the same frame and stream always give the same ones */
+	FRandomStream MakeFrameRandom(int32 InFrame, uint32 InStream = 0);
+
+	/** Random pins and EyeWeight curve for a frame, from MakeFrameRandom so a frame always gets the same inputs */
+	void SetInputs(FCRPANodeHarness& InHarness, int32 InFrame);
+}
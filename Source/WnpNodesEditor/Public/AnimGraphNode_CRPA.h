@@ -26,6 +26,10 @@ private:
 	virtual FText GetNodeTitle(ENodeTitleType::Type TitleType) const override;
 	virtual void CustomizePinData(UEdGraphPin* Pin, FName SourcePropertyName, int32 ArrayIndex) const override;
 	virtual FText GetTooltipText() const override;
+	virtual void GetNodeContextMenuActions(class UToolMenu* Menu, class UGraphNodeContextMenuContext* Context) const override;
+
+	// bake the rig output on the preview mesh into a sequence next to the anim BP, see CRPABake
+	void BakeOutput();
 
 	virtual FAnimNode_CustomProperty* GetCustomPropertyNode() override { return &Node; }
 	virtual const FAnimNode_CustomProperty* GetCustomPropertyNode() const override { return &Node; }
@@ -40,6 +44,8 @@ private:
 	virtual void CreateCustomPins(TArray<UEdGraphPin*>* OldPins) override;
 	FString GetControlValueAsString(const FRigControlCopy& Pose, const FRigControlElement* InControlElement) const;
 	virtual void ValidateAnimNodeDuringCompilation(USkeleton* ForSkeleton, FCompilerResultsLog& MessageLog) override;
+	virtual void OnProcessDuringCompilation(IAnimBlueprintCompilationContext& InCompilationContext,
+	                                        IAnimBlueprintGeneratedClassCompiledData& OutCompiledData) override;
 
 	// pin option related
 	void SetPinForProperty(ECheckBoxState NewState, FName PropertyName);
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UAnimSequence;
+class UControlRig;
+class UControlRigPoseAsset;
+class UCRPAPoseAtlas;
+class USkeletalMesh;
+
+/**
+ * Bakes the output of a CRPA rig into an anim sequence the node samples at far LODs, see FAnimNode_CRPA::BakedLOD
+ * The rig runs on the mesh ref pose once per pose, frame N of the sequence is the output for atlas pose N,
+ * or the single pose asset when there is no atlas. Only bones the rig moves away from the ref pose get a track.
+ * Keys are the local transforms the rig output, the node applies their difference from the ref pose to its source pose.
+ */
+namespace CRPABake
+{
+	struct FSettings
+	{
+		UClass* ControlRigClass = nullptr;
+		USkeletalMesh* SkeletalMesh = nullptr;
+		const UCRPAPoseAtlas* PoseAtlas = nullptr;
+		const UControlRigPoseAsset* PoseAsset = nullptr;
+
+		/** Long package name of the sequence, an existing asset is replaced */
+		FString PackageName;
+	};
+
+	/** Bake and create the sequence asset, the package is left dirty. Returns null on failure. */
+	WNPNODESEDITOR_API UAnimSequence* BakeSequence(const FSettings& InSettings);
+}
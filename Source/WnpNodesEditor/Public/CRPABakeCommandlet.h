@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "CRPABakeCommandlet.generated.h"
+
+/**
+ * Bakes CRPA rig output into anim sequences for far LODs and crowds, see CRPABake
+ * Usage: UnrealEditor-Cmd <Project> -run=CRPABake -Output=<package> -nullrhi
+ *        -AnimBP=<anim blueprint> [-Mesh=<skeletal mesh>]
+ *     or -Rig=<control rig class> -Mesh=<skeletal mesh> [-Atlas=<pose atlas> | -PoseAsset=<pose asset>]
+ * An anim BP bakes every CRPA node with its own rig, atlas and pose asset, numbered when it has several,
+ * on the preview mesh of the anim BP unless -Mesh is given.
+ */
+UCLASS()
+class UCRPABakeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UCRPABakeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
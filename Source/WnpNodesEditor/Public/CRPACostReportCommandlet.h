@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "CRPACostReportCommandlet.generated.h"
+
+/**
+ * Static cost report of every CRPA node in the project's anim BPs, one CSV row per node, most expensive first
+ * Usage: UnrealEditor-Cmd <Project> -run=CRPACostReport [-Path=/Game] [-Output=<csv>] -nullrhi
+ * A row has the rig, its pins by control type and how many are left unconnected, the curve mappings, pose asset
+ * and atlas sizes, the curves, controls and variables that don't resolve against the rig or the anim BP skeleton,
+ * and an estimated per frame binding cost in rough relative units, only meant to rank nodes.
+ * The output defaults to Saved/CRPACostReport.csv.
+ */
+UCLASS()
+class UCRPACostReportCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UCRPACostReportCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "CRPAReplayCommandlet.generated.h"
+
+/**
+ * Feeds a CRPA capture back through a copy of the node it was made with, no game or running anim graph required
+ * Only the node update and evaluate are timed, staging the captured inputs isn't
+ * Usage: UnrealEditor-Cmd <Project> -run=CRPAReplay -File=<capture.crpa> [-Loops=N] -nullrhi
+ * -DetectAllocations [-WarmupFrames=N] fails the run if the node allocates once warmed up
+ */
+UCLASS()
+class UCRPAReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UCRPAReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
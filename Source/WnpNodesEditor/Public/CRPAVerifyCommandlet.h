@@ -0,0 +1,28 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "CRPAVerifyCommandlet.generated.h"
+
+/**
+ * Compares the optimised CRPA paths against their reference implementation and reports the max error per bone
+ * Usage: UnrealEditor-Cmd <Project> -run=CRPAVerify [-File=<capture.crpa>] [-Atlas=<asset>] [-Matrix=<asset>]
+ *        [-Samples=N] [-Seed=N] [-Tolerance=T] -nullrhi
+ * -File checks that other instances of the captured rig, one of them evaluated in a task, give the same result on
+ *       the same inputs
+ * -Atlas checks the packed poses against the pose assets they were built from
+ * -Matrix checks the packed weights against the authored ones on random curve values
+ * Returns 1 if any error is above the tolerance.
+ */
+UCLASS()
+class UCRPAVerifyCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UCRPAVerifyCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -76,7 +76,8 @@ public class WnpNodesEditor : ModuleRules
 				"ToolWidgets",
 				"AnimationWidgets",
 				"Constraints",
-				"AnimationEditMode"
+				"AnimationEditMode",
+				"AssetRegistry"
 
 				// ... add private dependencies that you statically link with here ...	
 			}